@@ -21,11 +21,14 @@
 
 #include <src/libext/FileID.h>
 #include <src/libext/Logger.h>
+#include <future/memory.hpp> // For std::make_unique<>
 #include <iostream>
 #include <string>
 #include <vector>
 #include <thread>
 #include <utility>
+#include <chrono>
+#include <algorithm> // For std::max().
 #include <cstdlib> // For abort().
 
 #include "sync_queue_impl_selector.h"
@@ -36,6 +39,8 @@
 #include "MatchList.h"
 #include "FileScanner.h"
 #include "OutputTask.h"
+#include "AutoTuner.h"
+#include "RunStats.h"
 
 
 int main(int argc, char **argv)
@@ -45,6 +50,8 @@ int main(int argc, char **argv)
 		// First thing, set up logging.
 		Logger::Init(argv[0]);
 
+		auto start_time = std::chrono::steady_clock::now();
+
 		// We'll keep the scanner threads in this vector so we can join() them later.
 		std::vector<std::thread> scanner_threads;
 
@@ -65,20 +72,66 @@ int main(int argc, char **argv)
 
 		LOG(INFO) << "Num scanner jobs: " << arg_parser.m_jobs;
 
+		// The directories of the files in the Globber->FileScanner queue.  Must outlive the queue and the scanners.
+		DirTable dir_table;
+
 		// Create the Globber->FileScanner queue.
-		sync_queue<std::shared_ptr<FileID>> files_to_scan_queue;
+		sync_queue<FileRecord> files_to_scan_queue;
 
 		// Create the FileScanner->OutputTask queue.
 		sync_queue<MatchList> match_queue;
 
+		// Set up the gates for runtime tuning of the number of running traversal and scanner threads.
+		// When a pool is tuned, we start the maximum number of threads it could use, and the gate lets only
+		// as many run as the AutoTuner decides.
+		std::unique_ptr<WorkerGate> scanner_gate;
+		std::unique_ptr<WorkerGate> dirjob_gate;
+		int num_scanner_threads = arg_parser.m_jobs;
+		if(arg_parser.m_auto_tune_jobs)
+		{
+			scanner_gate = std::make_unique<WorkerGate>(AutoTuner::MaxScannerJobs(arg_parser.m_jobs), arg_parser.m_jobs);
+			num_scanner_threads = scanner_gate->max();
+		}
+		if(arg_parser.m_auto_tune_dirjobs)
+		{
+			dirjob_gate = std::make_unique<WorkerGate>(AutoTuner::MaxDirJobs(arg_parser.m_dirjobs), arg_parser.m_dirjobs);
+		}
+
+		// For ordered output, the window bounding how far the scanners can get ahead of the output task.
+		std::unique_ptr<ReorderWindow> reorder_window;
+		if(arg_parser.m_sort_files)
+		{
+			reorder_window = std::make_unique<ReorderWindow>();
+		}
+
+		// If a --stats report was asked for, the stages add their stats up in here.
+		std::unique_ptr<RunStats> run_stats;
+		if(arg_parser.m_stats)
+		{
+			run_stats = std::make_unique<RunStats>();
+		}
+
+		FileID::SetDirDescriptorCacheCapacity(arg_parser.m_max_dir_fds);
+
 		// Set up the globber.
 		Globber globber(arg_parser.m_paths, type_manager, dir_inclusion_manager, arg_parser.m_recurse, arg_parser.m_follow_symlinks,
-				arg_parser.m_dirjobs, files_to_scan_queue);
+				arg_parser.m_sort_files, arg_parser.m_dirjobs, files_to_scan_queue, dir_table, dirjob_gate.get());
+		globber.SetLowLatency(arg_parser.m_latency);
+		globber.SetUseIgnoreFiles(arg_parser.m_use_ignore_files);
+		globber.SetMaxDepth(arg_parser.m_max_depth);
+		globber.SetOneFileSystem(arg_parser.m_one_file_system);
+		globber.SetFilesystemPolicy(arg_parser.m_fs_policy);
+		globber.SetRunStats(run_stats.get());
 
 		// Set up the output task object.
 		OutputTask output_task(arg_parser.m_color, arg_parser.m_prefix_file,
                                        arg_parser.m_line_number, 
-                                       arg_parser.m_column, arg_parser.m_nullsep, match_queue);
+                                       arg_parser.m_column, arg_parser.m_nullsep, match_queue,
+                                       arg_parser.m_output_format);
+		output_task.SetReorderWindow(reorder_window.get());
+		output_task.SetContextLines(arg_parser.m_context_before, arg_parser.m_context_after);
+		output_task.SetLowLatency(arg_parser.m_latency);
+		output_task.SetRunStats(run_stats.get());
 
 		// Create the FileScanner object.
 		std::unique_ptr<FileScanner> file_scanner(FileScanner::Create(files_to_scan_queue, match_queue, arg_parser.m_pattern, arg_parser.m_ignore_case, arg_parser.m_word_regexp, arg_parser.m_pattern_is_literal));
@@ -87,13 +140,46 @@ int main(int argc, char **argv)
 		std::thread output_task_thread {&OutputTask::Run, &output_task};
 
 		// Start the scanner threads.
-		file_scanner->ThreadLocalSetup(arg_parser.m_jobs);
-		for(int t=0; t<arg_parser.m_jobs; ++t)
+		if(arg_parser.m_numa)
+		{
+			file_scanner->EnableNumaPlacement();
+		}
+		file_scanner->SetWorkerGate(scanner_gate.get());
+		file_scanner->SetReorderWindow(reorder_window.get());
+		file_scanner->SetOutputContext(&output_task.GetOutputContext());
+		file_scanner->SetMaxLineLength(arg_parser.m_max_columns);
+		file_scanner->SetContextLines(arg_parser.m_context_before, arg_parser.m_context_after);
+		file_scanner->SetOnlyMatching(arg_parser.m_only_matching);
+		file_scanner->SetCodepointColumns(arg_parser.m_codepoint_columns);
+		file_scanner->SetLowLatency(arg_parser.m_latency);
+		file_scanner->SetRunStats(run_stats.get());
+		if(arg_parser.m_fs_policy)
+		{
+			// A slow server or FUSE daemon shouldn't be able to tie up every scanner.
+			file_scanner->SetNetworkReadLimit(std::max(1, num_scanner_threads / 4));
+		}
+		if(type_manager.HasFirstLineRegexes())
+		{
+			file_scanner->SetFirstLineFilter([&type_manager](const char *file_data, size_t size) {
+				return type_manager.FirstLineShouldBeScanned(file_data, size); });
+		}
+		file_scanner->ThreadLocalSetup(num_scanner_threads);
+		for(int t=0; t<num_scanner_threads; ++t)
 		{
 			std::thread fst {&FileScanner::Run, file_scanner.get(), t};
 			scanner_threads.push_back(std::move(fst));
 		}
 
+		// Start the tuner, if we have anything for it to tune.
+		std::unique_ptr<AutoTuner> auto_tuner;
+		std::thread auto_tuner_thread;
+		if(scanner_gate || dirjob_gate)
+		{
+			auto_tuner = std::make_unique<AutoTuner>(files_to_scan_queue, match_queue, file_scanner->GetThroughput(),
+					scanner_gate.get(), dirjob_gate.get());
+			auto_tuner_thread = std::thread(&AutoTuner::Run, auto_tuner.get());
+		}
+
 		// Start the globber threads last.
 		// We do this last because the globber is the ultimate source for the work queue; all other threads will be
 		// waiting for it to start sending data to the Globber->FileScanner queue.  If we started it
@@ -106,6 +192,17 @@ int main(int argc, char **argv)
 		// Close the Globber->FileScanner queue.
 		files_to_scan_queue.close();
 
+		// Nothing more to tune.  Let all scanner threads run so that any parked ones see the closed queue and exit.
+		if(auto_tuner)
+		{
+			auto_tuner->Stop();
+			auto_tuner_thread.join();
+		}
+		if(scanner_gate)
+		{
+			scanner_gate->Open();
+		}
+
 		// Wait for all scanner threads to complete.
 		for (auto& scanner_thread_ref : scanner_threads)
 		{
@@ -119,6 +216,30 @@ int main(int argc, char **argv)
 		// Wait for the output thread to complete.
 		output_task_thread.join();
 
+		if(auto time_to_first_output = output_task.GetTimeToFirstOutput())
+		{
+			LOG(INFO) << "Time to first output: "
+					<< std::chrono::duration_cast<std::chrono::microseconds>(*time_to_first_output).count() << " us";
+		}
+
+		if(run_stats)
+		{
+#ifndef USE_SYNC_QUEUE_BOOST
+			run_stats->m_file_queue_high_water = files_to_scan_queue.high_water();
+			run_stats->m_match_queue_high_water = match_queue.high_water();
+#endif
+			if(auto time_to_first_output = output_task.GetTimeToFirstOutput())
+			{
+				run_stats->m_time_to_first_output = std::chrono::duration_cast<std::chrono::nanoseconds>(*time_to_first_output);
+			}
+			auto dir_fd_stats = FileID::GetDirDescriptorStats();
+			run_stats->m_dir_fds_opened = dir_fd_stats.m_opens;
+			run_stats->m_dir_fds_evicted = dir_fd_stats.m_evictions;
+			run_stats->m_dir_fds_max_open = dir_fd_stats.m_max_open;
+			run_stats->m_elapsed = std::chrono::steady_clock::now() - start_time;
+			std::cerr << *run_stats;
+		}
+
 		auto total_matched_lines = output_task.GetTotalMatchedLines();
 
 		if(total_matched_lines == 0)
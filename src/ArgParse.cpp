@@ -118,11 +118,17 @@ enum OPT
 	OPT_COLOR,
 	OPT_PREFIX_FILE,
 	OPT_NULLSEP,
+	OPT_OUTPUT_FORMAT,
+	OPT_SORT_FILES,
 	OPT_IGNORE_DIR,
 	OPT_IGNORE_FILE,
+	OPT_GITIGNORE,
 	OPT_INCLUDE,
 	OPT_EXCLUDE,
 	OPT_FOLLOW,
+	OPT_MAX_DEPTH,
+	OPT_ONE_FILE_SYSTEM,
+	OPT_FS_POLICY,
 	OPT_RECURSE_SUBDIRS,
 	OPT_ONLY_KNOWN_TYPES,
 	OPT_TYPE,
@@ -132,12 +138,23 @@ enum OPT
 	OPT_TYPE_DEL,
 	OPT_PERF_DIRJOBS,
 	OPT_PERF_SCANJOBS,
+	OPT_PERF_AUTO_TUNE,
+	OPT_PERF_NUMA,
+	OPT_PERF_LATENCY,
+	OPT_PERF_DIR_FDS,
+	OPT_STATS,
 	OPT_HELP,
 	OPT_HELP_TYPES,
 	OPT_USAGE,
 	OPT_VERSION,
 	OPT_LINE_NUMBER,
 	OPT_COLUMN,
+	OPT_MAX_COLUMNS,
+	OPT_COLUMN_UNIT,
+	OPT_ONLY_MATCHING,
+	OPT_AFTER_CONTEXT,
+	OPT_BEFORE_CONTEXT,
+	OPT_CONTEXT,
 	OPT_TEST_LOG_ALL,
 	OPT_TEST_NOENV_USER,
 	OPT_TEST_USE_MMAP,
@@ -528,22 +545,34 @@ static const std::array f_raw_options = std::to_array<PreDescriptor>({
 		{ OPT_LINE_NUMBER, DISABLE, "", "no-line-number", Arg::None, "Don't print the line number."},
 		{ OPT_COLUMN, ENABLE, "", "column", Arg::None, "Print column of first match after line number."},
 		{ OPT_COLUMN, DISABLE, "", "nocolumn", Arg::None, "Don't print column of first match (default)."},
+		{ OPT_COLUMN_UNIT, 0, "", "column-unit", "UNIT", Arg::NonEmpty, "Count columns in UNIT: 'byte' (default) or 'codepoint' (UTF-8 code points)."},
+		{ OPT_MAX_COLUMNS, 0, "", "max-columns", "NUM", Arg::IntegerGreater<-1>, "Print at most NUM bytes of each matched line, around the match.  0 means no limit (default)."},
+		{ OPT_ONLY_MATCHING, 0, "o", "only-matching", Arg::None, "Print only the matched part of each line.  Disables context lines."},
+		{ OPT_AFTER_CONTEXT, 0, "A", "after-context", "NUM", Arg::IntegerGreater<-1>, "Print NUM lines of context after each match."},
+		{ OPT_BEFORE_CONTEXT, 0, "B", "before-context", "NUM", Arg::IntegerGreater<-1>, "Print NUM lines of context before each match."},
+		{ OPT_CONTEXT, 0, "C", "context", "NUM", Arg::IntegerGreater<-1>, "Print NUM lines of context before and after each match."},
 	{ "File presentation:" },
 		{ OPT_COLOR, ENABLE, "", "color,colour", Arg::None, "Render the output with ANSI color codes."},
 		{ OPT_COLOR, DISABLE, "", "nocolor,nocolour", Arg::None, "Render the output without ANSI color codes."},
 		{ OPT_NULLSEP, ENABLE, "", "null", Arg::None,
                   "Print a zero character \'\\0\' instead of a colon \':\' after a file name."},
+		{ OPT_OUTPUT_FORMAT, 0, "", "output-format", "FORMAT", Arg::NonEmpty, "Print results in FORMAT: 'text' (default), 'json' (JSON Lines, in the same form as ripgrep's --json), or 'binary' (length-prefixed binary records, for IPC)."},
+		{ OPT_SORT_FILES, ENABLE, DISABLE, "", "[no]sort-files", "", Arg::None, "[Do not] print results in a deterministic order, sorted by file path (default: nosort-files)." },
 	{ "File/directory inclusion/exclusion:" },
-		{ OPT_IGNORE_DIR, ENABLE, DISABLE, "", "[no]ignore-dir,[no]ignore-directory", "NAME", Arg::NonEmpty, "[Do not] exclude directories with NAME."},
+		{ OPT_IGNORE_DIR, ENABLE, DISABLE, "", "[no]ignore-dir,[no]ignore-directory", "NAME", Arg::NonEmpty, "[Do not] exclude directories with NAME.  NAME may be a glob, and if it contains a '/', it's matched against the directory's path relative to the path given it was found under."},
 		// grep-style --include=glob and --exclude=glob
 		{ OPT_INCLUDE, 0, "", "include", "GLOB", Arg::NonEmpty, "Only files matching GLOB will be searched."},
 		{ OPT_EXCLUDE, 0, "", "exclude,ignore", "GLOB", Arg::NonEmpty, "Files matching GLOB will be ignored."},  	// ag-style --ignore=GLOB
 																													// In ag, this option applies to both files and directories.  For the present, ucg will only apply this to files.
 		// ack-style --ignore-file=FILTER:FILTERARGS
 		{ OPT_IGNORE_FILE, 0, "", "ignore-file", "FILTER:FILTERARGS", Arg::NonEmpty, "Files matching FILTER:FILTERARGS (e.g. ext:txt,cpp) will be ignored." },
+		{ OPT_GITIGNORE, ENABLE, DISABLE, "", "[no]gitignore", "", Arg::None, "[Do not] skip files and directories excluded by .gitignore, .ignore and .ucgignore files in the directories searched (default: gitignore)." },
 		{ OPT_RECURSE_SUBDIRS, ENABLE, "r,R", "recurse", Arg::None, "Recurse into subdirectories (default: on)." },
 		{ OPT_RECURSE_SUBDIRS, DISABLE, "", "no-recurse", Arg::None, "Do not recurse into subdirectories."},
 		{ OPT_FOLLOW, ENABLE, DISABLE, "", "[no]follow", "", Arg::None, "[Do not] follow symlinks (default: nofollow)." },
+		{ OPT_MAX_DEPTH, 0, "", "max-depth", "NUM", Arg::IntegerGreater<-1>, "Descend at most NUM directory levels below the paths given.  0 searches only files given on the command line, 1 only the files directly in the directories given (default: no limit)." },
+		{ OPT_ONE_FILE_SYSTEM, ENABLE, DISABLE, "", "[no]one-file-system", "", Arg::None, "[Do not] skip directories on other filesystems than the path given they were found under, e.g. mounts below it (default: noone-file-system)." },
+		{ OPT_FS_POLICY, ENABLE, DISABLE, "", "[no]fs-policy", "", Arg::None, "[Do not] skip pseudo filesystems such as /proc mounted below the paths given, and limit how many files on network and FUSE filesystems are read at once (default: fs-policy)." },
 		{ OPT_ONLY_KNOWN_TYPES, ENABLE, "k", "known-types", Arg::None, "Only search in files of recognized types (default: on)."},
 		{ OPT_TYPE, ENABLE, "", "type", "[no]TYPE", Arg::NonEmpty, "Include only [exclude all] TYPE files.  Types may also be specified as --[no]TYPE."},
 	{ "File type specification:" },
@@ -553,8 +582,13 @@ static const std::array f_raw_options = std::to_array<PreDescriptor>({
 	{ "Performance tuning:" },
 		{ OPT_PERF_DIRJOBS, 0, "", "dirjobs", "NUM_JOBS", Arg::IntegerGreater<0>, "Number of directory traversal jobs (std::thread<>s) to use." },
 		{ OPT_PERF_SCANJOBS, 0, "j", "jobs", "NUM_JOBS", Arg::IntegerGreater<0>, "Number of scanner jobs (std::thread<>s) to use."},
+		{ OPT_PERF_AUTO_TUNE, ENABLE, DISABLE, "", "[no]auto-tune", "", Arg::None, "[Do not] adjust the number of running scanner and directory traversal jobs at runtime (default: on).  Job counts given with --jobs or --dirjobs are not adjusted." },
+		{ OPT_PERF_NUMA, ENABLE, DISABLE, "", "[no]numa", "", Arg::None, "[Do not] pin scanner jobs to NUMA nodes and allocate their buffers from node-local memory (default: off)." },
+		{ OPT_PERF_LATENCY, ENABLE, DISABLE, "", "[no]latency", "", Arg::None, "[Do not] favor the time to the first result over the total search time, e.g. for editor integrations.  Files are scanned as soon as they're found, and results are written as soon as they're ready (default: nolatency)." },
+		{ OPT_PERF_DIR_FDS, 0, "", "dir-fds", "NUM", Arg::IntegerGreater<0>, "Keep at most NUM directories open at once.  Directories closed to stay under the limit are reopened when needed (default: half the open file limit)." },
 	{ "Miscellaneous:" },
 		{ OPT_NOENV, 0, "", "noenv", Arg::None, "Ignore .ucgrc configuration files."},
+		{ OPT_STATS, ENABLE, DISABLE, "", "[no]stats", "", Arg::None, "[Do not] print statistics about the search to stderr when it's done: file and match counts, the time spent in each stage, and how full the queues got (default: nostats)." },
 	{ "Informational options:" },
 		{ OPT_HELP,  0, "?", "help", Arg::None, "Give this help list" },
 		{ OPT_HELP_TYPES, 0, "", "help-types,list-file-types", Arg::None, "Print list of supported file types." },  // --list-file-types for ag compatibility.
@@ -788,6 +822,34 @@ void ArgParse::Parse(int argc, char **argv)
 		m_color = (options[OPT_COLOR].last()->type() == ENABLE);
 	}
 
+	if(lmcppop::Option* opt = options[OPT_OUTPUT_FORMAT])
+	{
+		std::string format = opt->last()->arg;
+		if(format == "text")
+		{
+			m_output_format = OutputFormat::TEXT;
+		}
+		else if(format == "json")
+		{
+			m_output_format = OutputFormat::JSON;
+		}
+		else if(format == "binary")
+		{
+			m_output_format = OutputFormat::BINARY;
+		}
+		else
+		{
+			std::cerr << "ucg: Unknown output format '" << format << "'.\n";
+			exit(STATUS_EX_USAGE);
+		}
+
+		if(m_output_format != OutputFormat::TEXT)
+		{
+			// Color escapes would only corrupt the machine-readable formats.
+			m_color = false;
+		}
+	}
+
         if(options[OPT_PREFIX_FILE])
           {
             m_prefix_file = (options[OPT_PREFIX_FILE].last()->type() == ENABLE);
@@ -802,11 +864,69 @@ void ArgParse::Parse(int argc, char **argv)
             m_line_number = true;
           }
         
+	if(lmcppop::Option* opt = options[OPT_COLUMN_UNIT])
+	{
+		std::string unit = opt->last()->arg;
+		if(unit == "byte")
+		{
+			m_codepoint_columns = false;
+		}
+		else if(unit == "codepoint")
+		{
+			m_codepoint_columns = true;
+		}
+		else
+		{
+			std::cerr << "ucg: Unknown column unit '" << unit << "'.\n";
+			exit(STATUS_EX_USAGE);
+		}
+	}
+
+	if(lmcppop::Option* opt = options[OPT_MAX_COLUMNS])
+	{
+		m_max_columns = std::stoul(opt->last()->arg);
+	}
+
+	m_only_matching = options[OPT_ONLY_MATCHING];
+
+	// As with grep, -A and -B override -C, whatever the order they're given in.
+	if(lmcppop::Option* opt = options[OPT_CONTEXT])
+	{
+		m_context_before = m_context_after = std::stoul(opt->last()->arg);
+	}
+	if(lmcppop::Option* opt = options[OPT_BEFORE_CONTEXT])
+	{
+		m_context_before = std::stoul(opt->last()->arg);
+	}
+	if(lmcppop::Option* opt = options[OPT_AFTER_CONTEXT])
+	{
+		m_context_after = std::stoul(opt->last()->arg);
+	}
+	if(m_only_matching)
+	{
+		// There's no line around an only-matching match for context to be relative to.
+		m_context_before = m_context_after = 0;
+	}
+
 	if(options[OPT_RECURSE_SUBDIRS]) // m_recurse defaults to true, so only assign if option was really given.
 	{
 		m_recurse = (options[OPT_RECURSE_SUBDIRS].last()->type() == ENABLE);
 	}
 	m_follow_symlinks = (options[OPT_FOLLOW].last()->type() == ENABLE);
+	if(lmcppop::Option* opt = options[OPT_MAX_DEPTH])
+	{
+		m_max_depth = std::stoul(opt->last()->arg);
+	}
+	m_one_file_system = (options[OPT_ONE_FILE_SYSTEM].last()->type() == ENABLE);
+	if(options[OPT_FS_POLICY]) // m_fs_policy defaults to true, so only assign if option was really given.
+	{
+		m_fs_policy = (options[OPT_FS_POLICY].last()->type() == ENABLE);
+	}
+	m_sort_files = (options[OPT_SORT_FILES].last()->type() == ENABLE);
+	if(options[OPT_GITIGNORE]) // m_use_ignore_files defaults to true, so only assign if option was really given.
+	{
+		m_use_ignore_files = (options[OPT_GITIGNORE].last()->type() == ENABLE);
+	}
 
 	for(lmcppop::Option* opt = options[OPT_IGNORE_DIR]; opt; opt=opt->next())
 	{
@@ -857,6 +977,24 @@ void ArgParse::Parse(int argc, char **argv)
 	{
 		m_jobs = std::stoi(opt->arg);
 	}
+	if(lmcppop::Option* opt = options[OPT_PERF_DIR_FDS])
+	{
+		m_max_dir_fds = std::stoul(opt->arg);
+	}
+
+	m_numa = (options[OPT_PERF_NUMA].last()->type() == ENABLE);
+	m_latency = (options[OPT_PERF_LATENCY].last()->type() == ENABLE);
+	m_stats = (options[OPT_STATS].last()->type() == ENABLE);
+
+	// Only tune the job counts the user didn't explicitly give us.
+	bool auto_tune = true;
+	if(options[OPT_PERF_AUTO_TUNE]) // Defaults to enabled, so only assign if option was really given.
+	{
+		auto_tune = (options[OPT_PERF_AUTO_TUNE].last()->type() == ENABLE);
+	}
+	m_auto_tune_jobs = auto_tune && (m_jobs == 0);
+	// A sorted traversal is single-threaded, so there's nothing to tune there.
+	m_auto_tune_dirjobs = auto_tune && (m_dirjobs == 0) && !m_sort_files;
 
 	//// Now set up some defaults which we can only determine after all arg parsing is complete.
 
@@ -27,8 +27,10 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <limits>
 #include <cstdio>
 
+#include "OutputContext.h"
 
 class TypeManager;
 class File;
@@ -130,6 +132,24 @@ public:
 	/// also set m_line_number to true.
 	bool m_column { false };
 
+	/// true if columns should be counted in UTF-8 code points instead of bytes.
+	bool m_codepoint_columns { false };
+
+	/// Maximum number of bytes of each matched line to print.  0 means no limit.
+	size_t m_max_columns { 0 };
+
+	/// true if only the matched text should be printed instead of the whole line.  Turns off context.
+	bool m_only_matching { false };
+
+	/// The format to print the results in.
+	OutputFormat m_output_format { OutputFormat::TEXT };
+
+	/// @name Number of lines of context to print before and after each match.
+	///@{
+	size_t m_context_before { 0 };
+	size_t m_context_after { 0 };
+	///@}
+
 	/// The file and directory paths given on the command line.
 	std::vector<std::string> m_paths;
 
@@ -142,6 +162,24 @@ public:
 	/// Number of Globber threads to use.
 	int m_dirjobs { 0 };
 
+	/// Whether the number of running FileScanner threads should be adjusted at runtime, starting from #m_jobs.
+	bool m_auto_tune_jobs { false };
+
+	/// Whether the number of running Globber threads should be adjusted at runtime, starting from #m_dirjobs.
+	bool m_auto_tune_dirjobs { false };
+
+	/// Whether to place the FileScanner threads and their buffers on NUMA nodes.
+	bool m_numa { false };
+
+	/// Whether to favor time-to-first-result over throughput.
+	bool m_latency { false };
+
+	/// The most directory file descriptors to keep open at once, 0 for the default.
+	size_t m_max_dir_fds { 0 };
+
+	/// Whether to print the --stats report.
+	bool m_stats { false };
+
 	/// Whether to use color output or not.
 	bool m_color { true };
 
@@ -151,11 +189,26 @@ public:
 	/// Whether to write a null after a filename instead of ':'.
 	bool m_nullsep { false };
 
+	/// Whether to print the results in a deterministic order, sorted by file path.
+	bool m_sort_files { false };
+
 	/// Whether to recurse into subdirectories or not.
 	bool m_recurse { true };
 
+	/// Whether to skip what .gitignore, .ignore and .ucgignore files exclude.
+	bool m_use_ignore_files { true };
+
 	bool m_follow_symlinks { false };
 
+	/// How many directory levels below the given paths to descend.
+	size_t m_max_depth { std::numeric_limits<size_t>::max() };
+
+	/// Whether to stay on the filesystems of the given paths.
+	bool m_one_file_system { false };
+
+	/// Whether to skip pseudo filesystems and limit reads from network filesystems mounted below the given paths.
+	bool m_fs_policy { true };
+
 	bool m_use_mmap { false };
 
 	///@}
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "AutoTuner.h"
+
+#include <libext/Logger.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <sys/time.h>
+#include <sys/resource.h> // For getrusage().
+
+/// How often we sample and adjust.
+static constexpr std::chrono::milliseconds f_sample_period {50};
+
+/// Files queued per running scanner above which we consider the scanners to be the bottleneck.
+static constexpr size_t f_file_backlog_per_scanner = 16;
+
+/// Number of MatchLists queued for output above which we consider output to be the bottleneck.
+static constexpr size_t f_output_backlog_limit = 256;
+
+/// Fraction of the scanners' time spent reading above which we consider them I/O-bound.
+static constexpr double f_io_bound_fraction = 0.5;
+
+/// How many consecutive samples of an empty file queue before we shrink the scanner pool.
+static constexpr int f_starved_samples_before_shrink = 4;
+
+/// When I/O-bound, allow this many scanner threads per core.
+static constexpr int f_max_scanners_per_core = 2;
+
+/// Upper limit on the number of traversal threads.
+static constexpr int f_max_dirjobs = 16;
+
+
+AutoTuner::AutoTuner(sync_queue<FileRecord> &file_queue,
+		sync_queue<MatchList> &match_queue,
+		const FileScannerThroughput &scanner_throughput,
+		WorkerGate *scanner_gate,
+		WorkerGate *dirjob_gate)
+	: m_file_queue(file_queue), m_match_queue(match_queue), m_scanner_throughput(scanner_throughput),
+	  m_scanner_gate(scanner_gate), m_dirjob_gate(dirjob_gate)
+{
+	m_num_cores = std::max(1U, std::thread::hardware_concurrency());
+}
+
+int AutoTuner::MaxScannerJobs(int num_cores) noexcept
+{
+	return std::max(1, num_cores) * f_max_scanners_per_core;
+}
+
+int AutoTuner::MaxDirJobs(int default_dirjobs) noexcept
+{
+	// Traversal is usually I/O-bound, so this doesn't depend on the number of cores.
+	return std::max(default_dirjobs, f_max_dirjobs);
+}
+
+void AutoTuner::Run()
+{
+	set_thread_name("AUTOTUNE");
+
+	Sample prev = TakeSample();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while(!m_cv.wait_for(lock, f_sample_period, [this](){ return m_stop; }))
+	{
+		lock.unlock();
+
+		Sample current = TakeSample();
+		Adjust(prev, current);
+		prev = current;
+
+		lock.lock();
+	}
+}
+
+void AutoTuner::Stop()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_stop = true;
+	lock.unlock();
+	m_cv.notify_all();
+}
+
+AutoTuner::Sample AutoTuner::TakeSample() const
+{
+	Sample retval;
+
+	retval.m_wall_time = std::chrono::steady_clock::now();
+
+	struct rusage ru;
+	if(getrusage(RUSAGE_SELF, &ru) == 0)
+	{
+		using namespace std::chrono;
+		retval.m_cpu_time = seconds(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec)
+				+ microseconds(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec);
+	}
+
+	retval.m_read_ns = m_scanner_throughput.m_read_ns.load(std::memory_order_relaxed);
+	retval.m_scan_ns = m_scanner_throughput.m_scan_ns.load(std::memory_order_relaxed);
+	retval.m_files_scanned = m_scanner_throughput.m_files_scanned.load(std::memory_order_relaxed);
+
+	return retval;
+}
+
+void AutoTuner::Adjust(const Sample &prev, const Sample &current)
+{
+	using namespace std::chrono;
+
+	double wall_seconds = duration_cast<duration<double>>(current.m_wall_time - prev.m_wall_time).count();
+	if(wall_seconds <= 0.0)
+	{
+		return;
+	}
+
+	// Average number of cores we kept busy over the sample period.
+	double cores_busy = duration_cast<duration<double>>(current.m_cpu_time - prev.m_cpu_time).count() / wall_seconds;
+
+	// Fraction of the scanners' time spent waiting on reads.
+	long long read_ns = current.m_read_ns - prev.m_read_ns;
+	long long scan_ns = current.m_scan_ns - prev.m_scan_ns;
+	bool scanners_io_bound = (read_ns + scan_ns > 0) && (static_cast<double>(read_ns) / (read_ns + scan_ns) > f_io_bound_fraction);
+
+	int num_scanners = m_scanner_gate ? m_scanner_gate->active() : 0;
+	int num_dirjobs = m_dirjob_gate ? m_dirjob_gate->active() : 0;
+
+	size_t file_backlog = m_file_queue.size();
+	size_t output_backlog = m_match_queue.size();
+
+	LOG(INFO) << "AutoTuner sample: cores busy=" << cores_busy << ", io_bound=" << scanners_io_bound
+			<< ", file backlog=" << file_backlog << ", output backlog=" << output_backlog
+			<< ", files/sec=" << (current.m_files_scanned - prev.m_files_scanned) / wall_seconds
+			<< ", scanners=" << num_scanners << ", dirjobs=" << num_dirjobs;
+
+	if(output_backlog > f_output_backlog_limit)
+	{
+		// Output can't keep up, more producers won't help.
+		m_num_starved_samples = 0;
+		return;
+	}
+
+	bool have_idle_core = cores_busy < (m_num_cores - 0.5);
+
+	if(file_backlog > f_file_backlog_per_scanner * std::max(1, num_scanners))
+	{
+		// Scanning is the bottleneck.
+		m_num_starved_samples = 0;
+
+		if(m_scanner_gate != nullptr && (scanners_io_bound || have_idle_core) && num_scanners < m_scanner_gate->max())
+		{
+			// I/O-bound scanners benefit from more outstanding reads, CPU-bound ones from idle cores.
+			num_scanners = m_scanner_gate->SetActive(num_scanners + 1);
+			LOG(INFO) << "AutoTuner: growing scanner pool to " << num_scanners;
+		}
+		else if(m_dirjob_gate != nullptr && !have_idle_core && num_dirjobs > 1)
+		{
+			// No idle cores to give the scanners, so take one away from traversal, which is running ahead anyway.
+			num_dirjobs = m_dirjob_gate->SetActive(num_dirjobs - 1);
+			LOG(INFO) << "AutoTuner: shrinking traversal pool to " << num_dirjobs;
+		}
+	}
+	else if(file_backlog == 0)
+	{
+		// The scanners are starved for files, traversal is the bottleneck.
+		if(m_dirjob_gate != nullptr && have_idle_core && num_dirjobs < m_dirjob_gate->max())
+		{
+			num_dirjobs = m_dirjob_gate->SetActive(num_dirjobs + 1);
+			LOG(INFO) << "AutoTuner: growing traversal pool to " << num_dirjobs;
+		}
+
+		if(++m_num_starved_samples >= f_starved_samples_before_shrink)
+		{
+			// Persistently starved.  Idle scanners cost little, but there's no reason to keep more of them around
+			// than there are cores, competing with traversal once files do start showing up.
+			m_num_starved_samples = 0;
+			if(m_scanner_gate != nullptr && num_scanners > m_num_cores)
+			{
+				num_scanners = m_scanner_gate->SetActive(num_scanners - 1);
+				LOG(INFO) << "AutoTuner: shrinking scanner pool to " << num_scanners;
+			}
+		}
+	}
+	else
+	{
+		m_num_starved_samples = 0;
+	}
+}
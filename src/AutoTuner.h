@@ -0,0 +1,114 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#ifndef AUTOTUNER_H_
+#define AUTOTUNER_H_
+
+#include <config.h>
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "libext/FileRecord.h"
+#include "libext/WorkerGate.hpp"
+#include "sync_queue_impl_selector.h"
+#include "MatchList.h"
+#include "FileScanner.h"
+
+/**
+ * Runtime controller which adjusts the number of running scanner and directory traversal threads.
+ *
+ * The scanner and traversal thread pools are started at their maximum sizes, with each pool throttled by a
+ * WorkerGate.  Run() periodically samples the depths of the Globber->FileScanner and FileScanner->OutputTask queues,
+ * the scanners' throughput counters, and the process's CPU utilization, and then grows or shrinks the number of
+ * active threads in each pool depending on whether the run currently looks I/O-bound or CPU-bound:
+ *
+ * - Files backing up in front of the scanners means scanning is the bottleneck.  If the scanners are spending
+ *   most of their time in read(), more of them can be used to hide I/O latency (e.g. on NFS), even beyond the
+ *   number of cores.  If they're CPU-bound, more of them only helps while there are idle cores.
+ * - Scanners starved for files means traversal is the bottleneck, so more traversal threads are allowed to run.
+ * - Matches backing up in front of the output thread means neither pool is the bottleneck, so neither is grown.
+ */
+class AutoTuner
+{
+public:
+	AutoTuner(sync_queue<FileRecord> &file_queue,
+			sync_queue<MatchList> &match_queue,
+			const FileScannerThroughput &scanner_throughput,
+			WorkerGate *scanner_gate,
+			WorkerGate *dirjob_gate);
+	~AutoTuner() = default;
+
+	/**
+	 * The sampling loop.  Runs until Stop() is called.
+	 */
+	void Run();
+
+	/**
+	 * Make Run() return at its next opportunity.
+	 */
+	void Stop();
+
+	/// @name Pool size policy.
+	/// Helpers for main() to determine how many threads to start when a pool will be tuned.
+	///@{
+	[[nodiscard]] static int MaxScannerJobs(int num_cores) noexcept;
+	[[nodiscard]] static int MaxDirJobs(int default_dirjobs) noexcept;
+	///@}
+
+private:
+
+	/// One sample of the quantities the tuning decisions are based on.
+	struct Sample
+	{
+		std::chrono::steady_clock::time_point m_wall_time;
+		std::chrono::nanoseconds m_cpu_time {0};
+		long long m_read_ns {0};
+		long long m_scan_ns {0};
+		long long m_files_scanned {0};
+	};
+
+	[[nodiscard]] Sample TakeSample() const;
+
+	void Adjust(const Sample &prev, const Sample &current);
+
+	sync_queue<FileRecord> &m_file_queue;
+
+	sync_queue<MatchList> &m_match_queue;
+
+	const FileScannerThroughput &m_scanner_throughput;
+
+	/// The gates we're controlling.  Either may be null, in which case that pool is left alone.
+	WorkerGate *m_scanner_gate;
+	WorkerGate *m_dirjob_gate;
+
+	/// Number of cores on the system.
+	int m_num_cores;
+
+	/// Number of consecutive samples the scanners have found the file queue empty.
+	int m_num_starved_samples {0};
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_stop { false };
+};
+
+#endif /* AUTOTUNER_H_ */
@@ -47,7 +47,26 @@ void DirInclusionManager::AddExclusions(const std::set<std::string>& exclusions)
 {
 	for(const auto& name : exclusions)
 	{
-		m_excluded_literal_dirs.insert(name);
+		std::string_view pattern = name;
+
+		// A trailing '/' only says it's a directory, which it is anyway.
+		while(pattern.size() > 1 && pattern.back() == '/')
+		{
+			pattern.remove_suffix(1);
+		}
+
+		if(pattern.find('/') != std::string_view::npos)
+		{
+			m_excluded_dir_paths.emplace_back(pattern);
+		}
+		else if(pattern.find_first_of("*?[\\") != std::string_view::npos)
+		{
+			m_excluded_dir_globs.emplace_back(pattern);
+		}
+		else
+		{
+			m_excluded_literal_dirs.emplace(pattern);
+		}
 	}
 }
 
@@ -61,9 +80,11 @@ void DirInclusionManager::CompileExclusionTables()
 		m_excluded_literal_dirs.insert(t);
 		++i;
 	}
+
+	m_excluded_dir_glob_set.Compile(m_excluded_dir_globs);
 }
 
-bool DirInclusionManager::DirShouldBeExcluded(const std::string &name) const
+bool DirInclusionManager::DirShouldBeExcluded(std::string_view name) const
 {
 	if(m_excluded_literal_dirs.find(name) != m_excluded_literal_dirs.end())
 	{
@@ -71,6 +92,27 @@ bool DirInclusionManager::DirShouldBeExcluded(const std::string &name) const
 		return true;
 	}
 
+	if(!m_excluded_dir_glob_set.empty() && m_excluded_dir_glob_set.AnyMatch(name))
+	{
+		return true;
+	}
+
 	// No exclusion rules matched, descend into the directory.
 	return false;
 }
+
+bool DirInclusionManager::DirPathShouldBeExcluded(std::string_view rel_dir, std::string_view name) const
+{
+	std::vector<std::string_view> path;
+	PathGlob::Split(rel_dir, name, path);
+
+	for(const auto& path_glob : m_excluded_dir_paths)
+	{
+		if(path_glob.Match(path))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
@@ -23,7 +23,11 @@
 #include <config.h>
 
 #include <string>
+#include <string_view>
 #include <set>
+#include <vector>
+
+#include <libext/GlobSet.h>
 
 /**
  * Class for managing the inclusion and exclusion of directories from the search.
@@ -34,6 +38,14 @@ public:
 	DirInclusionManager() = default;
 	~DirInclusionManager() = default;
 
+	/**
+	 * Add directories to exclude.  Each of @p exclusions is one of:
+	 * - A literal directory name, e.g. "build".
+	 * - A glob matched against the directory name, e.g. "*.egg-info".
+	 * - A glob containing a '/', matched against the directory's path relative to the starting path it was found
+	 *   under, e.g. "vendor/lib[0-9]/test".  Wildcards don't match '/', and a "**" component matches any number of
+	 *   directories.  A leading or trailing '/' is ignored.
+	 */
 	void AddExclusions(const std::set<std::string> &exclusions);
 
 	void CompileExclusionTables();
@@ -41,17 +53,36 @@ public:
 	/**
 	 * Returns true if:
 	 * - The @a name param (i.e. <...>/dir) matches one of the literal strings
-	 *   in m_excluded_literal_dirs.
+	 *   in m_excluded_literal_dirs, or
+	 * - It matches one of the name globs.
 	 *
 	 * @param path
 	 * @return
 	 */
-	[[nodiscard]] bool DirShouldBeExcluded(const std::string &name) const;
+	[[nodiscard]] bool DirShouldBeExcluded(std::string_view name) const;
+
+	/// Whether there are any path exclusions, i.e. whether DirPathShouldBeExcluded() needs to be called at all.
+	[[nodiscard]] bool HasPathExclusions() const noexcept { return !m_excluded_dir_paths.empty(); };
+
+	/**
+	 * Returns true if the directory @p name in @p rel_dir, its parent's path relative to the starting path (empty for
+	 * the starting path itself), matches one of the path exclusions.
+	 */
+	[[nodiscard]] bool DirPathShouldBeExcluded(std::string_view rel_dir, std::string_view name) const;
 
 private:
 
 	/// Literal directory names (not containing '/') which will be excluded.
-	std::set<std::string> m_excluded_literal_dirs;
+	std::set<std::string, std::less<>> m_excluded_literal_dirs;
+
+	/// Globs matched against the directory name.
+	std::vector<std::string> m_excluded_dir_globs;
+
+	/// m_excluded_dir_globs, compiled.
+	GlobSet m_excluded_dir_glob_set;
+
+	/// Globs matched against the relative path.
+	std::vector<PathGlob> m_excluded_dir_paths;
 };
 
 #endif /* DIRINCLUSIONMANAGER_H_ */
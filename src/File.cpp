@@ -21,6 +21,7 @@
 
 #include "File.h"
 
+#include <algorithm>
 #include <iostream>
 #include <system_error>
 
@@ -36,52 +37,57 @@
 #define MAP_NORESERVE 0
 #endif
 
-File::File(std::shared_ptr<FileID> file_id, std::shared_ptr<ResizableArray<char>> storage) : m_fileid(std::move(file_id)), m_storage(storage)
+/// How much of a file is read for its first-block filter.  Enough for any sensible first line, and small, since most
+/// of the files which need one, e.g. LICENSE files and binaries, are rejected by it.
+static constexpr size_t f_first_block_size = 0x1000;
+
+File::File(const FileRecord &record, std::shared_ptr<ResizableArray<char>> storage, const first_block_filter_type &first_block_filter)
+	: m_record(record), m_storage(std::move(storage))
 {
-	int file_descriptor { -1 };
+	Init(O_RDONLY | O_NOATIME | O_NOCTTY, first_block_filter);
+}
 
-	try
-	{
-		file_descriptor = m_fileid->GetFileDescriptor();
 
-		/// @todo Does the above ever not throw on error?
-		if(file_descriptor == -1)
-		{
-			// Couldn't open the file, throw exception.
-			LOG(DEBUG) << "bad file descriptor: fd=" << file_descriptor;
-			throw FileException("File constructor: bad file descriptor");
-		}
-	}
-	catch(const FileException &e)
-	{
-		LOG(DEBUG) << e;
-		throw;
-	}
-	catch(const std::system_error &e)
+File::File(const std::string &filename, FileAccessMode fam, FileCreationFlag fcf, std::shared_ptr<ResizableArray<char>> storage)
+	: m_at_dir(std::make_shared<FileID>(FileID::path_known_cwd_tag())), m_record(m_at_dir.get(), filename), m_storage(std::move(storage))
+{
+	Init(static_cast<int>(fam) | fcf);
+}
+
+File::~File()
+{
+	// Clean up.
+	FreeFileData(m_file_data, m_size);
+}
+
+void File::Init(int open_flags, const first_block_filter_type &first_block_filter)
+{
+	int file_descriptor = m_record.Open(open_flags);
+	if(file_descriptor == -1)
 	{
-		// Rethrow.
-		throw;
+		// Couldn't open the file, throw exception.
+		throw FileException("File constructor: open(" + m_record.GetPath() + ") failed");
 	}
-	catch(...)
+
+	struct stat stat_buf;
+	if(fstat(file_descriptor, &stat_buf) != 0)
 	{
-		// Rethrow anything else.
-		throw;
+		int saved_errno = errno;
+		close(file_descriptor);
+		throw FileException("File constructor: fstat(" + m_record.GetPath() + ") failed", saved_errno);
 	}
 
-	ssize_t file_size = m_fileid->GetFileSize();
-	LOG(INFO) << "... file size is: " << file_size;
-	LOG(INFO) << "... file type is: " << m_fileid->GetFileType();
+	m_size = stat_buf.st_size;
+	LOG(INFO) << "... file size is: " << m_size;
 
 	// If filesize is 0, skip.
-	if(file_size == 0)
+	if(m_size == 0)
 	{
-		//close(m_file_descriptor);
-		//m_file_descriptor = -1;
+		close(file_descriptor);
 		return;
 	}
 
 	// Read or mmap the file into memory.
-	// Note that this closes the file descriptor.
 	// Note: per info here:
 	// http://stackoverflow.com/questions/34498825/io-blksize-seems-just-return-io-bufsize
 	// https://github.com/coreutils/coreutils/blob/master/src/ioblksize.h#L23-L57
@@ -89,30 +95,22 @@ File::File(std::shared_ptr<FileID> file_id, std::shared_ptr<ResizableArray<char>
 	// ...it seems that as of ~2014, experiments show the minimum I/O size should be >=128KB.
 	// *stat() seems to return 4096 in all my experiments so far, so we'll clamp it to a min of 128KB and a max of
 	// something not unreasonable, e.g. 1MB.
-	auto io_size = clamp(m_fileid->GetBlockSize(), static_cast<blksize_t>(0x20000), static_cast<blksize_t>(0x100000));
-	m_file_data = GetFileData(file_descriptor, file_size, io_size);
+	auto io_size = clamp(stat_buf.st_blksize, static_cast<blksize_t>(0x20000), static_cast<blksize_t>(0x100000));
+	m_file_data = GetFileData(file_descriptor, m_size, io_size, first_block_filter);
+
+	// We don't need the file descriptor anymore, even if the data was mmap()ed.
+	close(file_descriptor);
 
 	if(m_file_data == MAP_FAILED)
 	{
 		// Mapping failed.
-		ERROR() << "Couldn't map file '" << m_fileid->GetPath() << "'";
+		ERROR() << "Couldn't map file '" << m_record.GetPath() << "'";
 		throw FileException("mmapping file failed", errno);
 	}
 }
 
-
-File::File(const std::string &filename, FileAccessMode fam, FileCreationFlag fcf, std::shared_ptr<ResizableArray<char>> storage)
-	: File(std::make_shared<FileID>(std::make_shared<FileID>(FileID(FileID::path_known_cwd_tag())), filename, fam, fcf), storage)
-{
-}
-
-File::~File()
-{
-	// Clean up.
-	FreeFileData(m_file_data, m_fileid->GetFileSize());
-}
-
-const char* File::GetFileData(int file_descriptor, size_t file_size, size_t preferred_block_size)
+const char* File::GetFileData(int file_descriptor, size_t file_size, size_t preferred_block_size,
+		const first_block_filter_type &first_block_filter)
 {
 	const char *file_data = static_cast<const char *>(MAP_FAILED);
 
@@ -123,42 +121,63 @@ const char* File::GetFileData(int file_descriptor, size_t file_size, size_t pref
 		if(file_data == MAP_FAILED)
 		{
 			// Mapping failed.
-			close(file_descriptor);
 			return file_data;
 		}
 
 		// Hint that we'll be sequentially reading the mmapped file soon.
 		posix_madvise(const_cast<char*>(file_data), file_size, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+
+		if(first_block_filter && !first_block_filter(file_data, std::min(file_size, f_first_block_size)))
+		{
+			m_rejected = true;
+		}
 	}
 	else
 	{
 		// Not using mmap().
 
+		file_data = m_storage->realloc(file_size, preferred_block_size);
+
+		// Read in the whole file, or if there's a first-block filter, just a small first block until it says to read
+		// the rest, which is then read in after it.
+		char *buffer = const_cast<char*>(file_data);
+		size_t num_read = 0;
+		ssize_t retval = 0;
+		auto read_up_to = [&](size_t end) {
+			while(num_read < end && (retval = read(file_descriptor, buffer + num_read, end - num_read)) > 0)
+			{
+				num_read += retval;
+			}
+		};
+		if(first_block_filter)
+		{
+			read_up_to(std::min(file_size, f_first_block_size));
+			if(retval >= 0 && !first_block_filter(file_data, num_read))
+			{
+				m_rejected = true;
+				return file_data;
+			}
+		}
+
 #ifdef HAVE_POSIX_FADVISE // OSX doesn't have it.
 		// Notify the filesystem of our intentions to:
 		// - Access the file sequentially.  This will cause Linux to double the file's readahead window.
 		// - That we'll need the contents in the near future.  Per the Linux manpage, this will cause it to start
 		//   a non-blocking read of the file.
 		// Explicitly ignoring the return value for Coverity's sake.  If the advice is ignored, we should still be functional.
+		// Not until after the first-block filter, so the files it rejects aren't read ahead.
 		(void)posix_fadvise(file_descriptor, 0, 0, POSIX_FADV_SEQUENTIAL /*| POSIX_FADV_WILLNEED*/);
 #endif
 
-		file_data = m_storage->realloc(file_size, preferred_block_size);
-
-		// Read in the whole file.
-		ssize_t retval = 0;
-		while((retval = read(file_descriptor, const_cast<char*>(file_data), file_size)) > 0);
+		read_up_to(file_size);
 		if(retval < 0)
 		{
 			// read error.
-			ERROR() << "read() error on file '" << "<<TODO>>" << "', descriptor " << file_descriptor << ": " << LOG_STRERROR();
+			ERROR() << "read() error on file '" << m_record.GetPath() << "', descriptor " << file_descriptor << ": " << LOG_STRERROR();
 			errno = 0;
 		}
 	}
 
-	// We don't need the file descriptor anymore.
-	///@todo close(file_descriptor);
-
 	return file_data;
 }
 
@@ -24,12 +24,19 @@
 
 #include <future/memory.hpp>
 #include <future/string.hpp>
+#include <functional>
 #include <stdexcept>
 
 #include "libext/FileID.h"
+#include "libext/FileRecord.h"
 #include "ResizableArray.h"
 
 
+/**
+ * Type of the predicate which decides from the first block of a file whether the rest of it is wanted.
+ */
+using first_block_filter_type = std::function<bool (const char *file_data, size_t size)>;
+
 /**
  * A class to represent the contents and some metadata of a read-only file.
  * Abstracts away the method of access to the data, i.e. mmap() vs. read().
@@ -37,34 +44,49 @@
 class File
 {
 public:
-	explicit File(std::shared_ptr<FileID> file_id, std::shared_ptr<ResizableArray<char>> storage = std::make_shared<ResizableArray<char>>());
+	/**
+	 * @param record              The file to read.
+	 * @param storage             Where to read it into.
+	 * @param first_block_filter  If given, only the first 4 KiB of the file are read at first, and the rest only if
+	 *                            @p first_block_filter returns true for them.  If it doesn't, rejected() is true.
+	 */
+	explicit File(const FileRecord &record, std::shared_ptr<ResizableArray<char>> storage = std::make_shared<ResizableArray<char>>(),
+			const first_block_filter_type &first_block_filter = {});
 	File(const std::string &filename, FileAccessMode fam, FileCreationFlag fcf,
 			std::shared_ptr<ResizableArray<char>> storage = std::make_shared<ResizableArray<char>>());
 	~File();
 
-	[[nodiscard]] size_t size() const noexcept { return m_fileid->GetFileSize(); };
+	[[nodiscard]] size_t size() const noexcept { return m_size; };
 
 	[[nodiscard]] const char * data() const noexcept { return m_file_data; };
 
+	/// True if the first-block filter given to the constructor rejected the file.  Its data is then incomplete.
+	[[nodiscard]] bool rejected() const noexcept { return m_rejected; };
+
 	/**
 	 * Returns the name of this File as passed to the constructor.
 	 * @return  The name of this File as passed to the constructor.
 	 */
-	[[nodiscard]] std::string name() const noexcept { return m_fileid->GetPath(); };
+	[[nodiscard]] std::string name() const noexcept { return m_record.GetPath(); };
 
 private:
 
+	/// Open the file, get its size, and read it in.  Throws FileException on failure.
+	void Init(int open_flags, const first_block_filter_type &first_block_filter = {});
+
 	/**
 	 * Return a pointer to a buffer containing the contents of the file described by #file_descriptor.
 	 * May be mmap()'ed or read() into a newed buffer depending on m_use_mmap.
 	 *
-	 * @note file_descriptor will be closed after this function returns.
+	 * @note Doesn't close file_descriptor.
 	 *
 	 * @param file_descriptor  File descriptor (from open()) of the file to read in / mmap.
 	 * @param file_size        Size of the file.
+	 * @param first_block_filter  If given, decides from the first 4 KiB whether to read the rest.
 	 * @return
 	 */
-	const char* GetFileData(int file_descriptor, size_t file_size, size_t preferred_block_size);
+	const char* GetFileData(int file_descriptor, size_t file_size, size_t preferred_block_size,
+			const first_block_filter_type &first_block_filter);
 
 	/**
 	 * Frees the resources allocated by GetFileData().
@@ -74,7 +96,12 @@ private:
 	 */
 	void FreeFileData(const char * file_data, size_t file_size) noexcept;
 
-	std::shared_ptr<FileID> m_fileid;
+	/// The directory of #m_record, if we had to create it ourselves, i.e. if the file isn't from the traversal.
+	std::shared_ptr<FileID> m_at_dir;
+
+	FileRecord m_record;
+
+	size_t m_size { 0 };
 
 	/// The ResizableArray that we'll get file data storage from.
 	std::shared_ptr<ResizableArray<char>> m_storage;
@@ -83,6 +110,8 @@ private:
 
 	bool m_use_mmap { false };
 
+	bool m_rejected { false };
+
 };
 
 #endif /* FILE_H_ */
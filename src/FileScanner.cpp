@@ -33,13 +33,17 @@
 #include <iostream>
 #include <string>
 #include <future/string.hpp>
+#include <future/memory.hpp>
 #include <libext/string.hpp>
 #include <libext/Logger.h>
 #include <thread>
+#include <deque>
 #include <mutex>
+#include <optional>
 #include <cstring> // For memchr().
 #include <cstddef> // For ptrdiff_t
 #include <cctype>
+#include <algorithm>
 #ifndef HAVE_SCHED_SETAFFINITY
 #else
 	#include <sched.h>
@@ -50,6 +54,9 @@
 
 static std::mutex f_assign_affinity_mutex;
 
+/// With NUMA placement, the maximum number of files a thread moves from the input queue to its node's queue at once.
+static constexpr size_t f_node_queue_batch_size = 16;
+
 /// Resolver function for determining the best version of CountLinesSinceLastMatch to call.
 /// Does its work at static init time, so incurs no call-time overhead.
 extern "C"	void * resolve_CountLinesSinceLastMatch(void);
@@ -60,7 +67,7 @@ size_t (*FileScanner::CountLinesSinceLastMatch)(const char * __restrict__ prev_l
 		= reinterpret_cast<decltype(FileScanner::CountLinesSinceLastMatch)>(::resolve_CountLinesSinceLastMatch());
 
 
-std::unique_ptr<FileScanner> FileScanner::Create(sync_queue<std::shared_ptr<FileID>> &in_queue,
+std::unique_ptr<FileScanner> FileScanner::Create(sync_queue<FileRecord> &in_queue,
 			sync_queue<MatchList> &output_queue,
 			std::string regex,
 			bool ignore_case,
@@ -90,7 +97,7 @@ std::unique_ptr<FileScanner> FileScanner::Create(sync_queue<std::shared_ptr<File
 	return retval;
 }
 
-FileScanner::FileScanner(sync_queue<std::shared_ptr<FileID>> &in_queue,
+FileScanner::FileScanner(sync_queue<FileRecord> &in_queue,
 		sync_queue<MatchList> &output_queue,
 		std::string regex,
 		bool ignore_case,
@@ -111,12 +118,24 @@ void FileScanner::Run(int thread_index)
 	// Set the name of the thread.
 	set_thread_name("FILESCAN_" + std::to_string(thread_index));
 
-	if(m_manually_assign_cores)
+	if(m_numa_topology)
+	{
+		// Pin this thread to its NUMA node before allocating anything, so that everything it allocates is local.
+		auto node = thread_index % m_numa_topology->num_nodes();
+		if(!m_numa_topology->BindCurrentThreadToNode(node))
+		{
+			WARN() << "Could not bind scanner thread " << thread_index << " to NUMA node index " << node << ": " << LOG_STRERROR();
+		}
+	}
+	else if(m_manually_assign_cores)
 	{
 		// Spread the scanner threads across cores.
 		AssignToNextCore();
 	}
 
+	// Allocate the per-thread data of the derived class.
+	ThreadLocalInit(thread_index);
+
 	// Create a reusable, resizable buffer for the File() reads.
 	auto file_data_storage = std::make_shared<ResizableArray<char>>();
 
@@ -125,29 +144,132 @@ void FileScanner::Run(int thread_index)
 	long long total_bytes_read {0};
 
 	// Pull new filenames off the input queue until it's closed.
-	std::shared_ptr<FileID> next_file;
+	FileRecord next_file;
 	MatchList ml;
-	while(m_in_queue.pull_front(std::move(next_file)) != queue_op_status::closed)
+	ml.SetContextLines(m_context_before, m_context_after);
+	ml.SetOnlyMatching(m_only_matching);
+	ml.SetCodepointColumns(m_codepoint_columns);
+
+	// This thread's stats for --stats, if they're wanted.
+	RunStats stats;
+	RunStats *stats_ptr = (m_run_stats != nullptr) ? &stats : nullptr;
+	std::optional<StageTimer> stage_timer;
+
+	// For the files whose type isn't deferred.
+	const first_block_filter_type no_first_line_filter;
+
+	// Files on network filesystems which this thread pulled while all the network read slots were taken.  They wait
+	// here until a slot frees up, or until there's nothing else left to do, so that a hung server only holds up the
+	// threads which are actually reading from it.
+	std::deque<FileRecord> deferred_network_files;
+
+	while(true)
 	{
+		if(m_worker_gate != nullptr)
+		{
+			// Park here if the AutoTuner has throttled us.
+			m_worker_gate->WaitUntilActive(thread_index);
+		}
+
+		bool have_network_read_slot = false;
+		if(!deferred_network_files.empty() && m_network_read_slots->try_acquire())
+		{
+			next_file = std::move(deferred_network_files.front());
+			deferred_network_files.pop_front();
+			have_network_read_slot = true;
+		}
+		else if(!PullNextFile(thread_index, next_file))
+		{
+			if(deferred_network_files.empty())
+			{
+				break;
+			}
+
+			// Only the deferred files are left, so wait for a slot.
+			m_network_read_slots->acquire();
+			next_file = std::move(deferred_network_files.front());
+			deferred_network_files.pop_front();
+			have_network_read_slot = true;
+		}
+
 		try
 		{
 			// Try to open and read the file.  This could throw.
-			LOG(INFO) << "Attempting to scan file \'" << next_file->GetPath() << "\', fd=" << next_file->GetFileDescriptor();
+			LOG(INFO) << "Attempting to scan file \'" << next_file.GetPath() << "\'";
 
+			if(stats_ptr != nullptr)
+			{
+				stage_timer.emplace();
+			}
 			steady_clock::time_point start = steady_clock::now();
 
-			File f(next_file, file_data_storage);
+			if(next_file.IsTypeDeferred() && !m_first_line_filter)
+			{
+				SendMatchList(next_file, ml);
+				continue;
+			}
+
+			// Get a slot if it's on a network filesystem.  If they're all taken, set the file aside and go on to the
+			// next one, rather than leave the files behind it waiting too.
+			if(!have_network_read_slot && m_network_read_slots && next_file.IsOnNetworkFilesystem())
+			{
+				if(m_reorder_window != nullptr)
+				{
+					// With ordered output, nothing after this file can be output until it is anyway, and files set
+					// aside here could be the ones the reorder window is waiting on.
+					m_network_read_slots->acquire();
+				}
+				else if(!m_network_read_slots->try_acquire())
+				{
+					LOG(INFO) << "... network read limit reached, deferring.";
+					deferred_network_files.push_back(std::move(next_file));
+					continue;
+				}
+				have_network_read_slot = true;
+			}
+			// The slot is released once the file has been read, or if reading it throws.
+			std::unique_ptr<std::counting_semaphore<>, void(*)(std::counting_semaphore<>*)> network_read_slot {
+				have_network_read_slot ? m_network_read_slots.get() : nullptr,
+				[](std::counting_semaphore<> *slots){ slots->release(); } };
+
+			File f(next_file, file_data_storage, next_file.IsTypeDeferred() ? m_first_line_filter : no_first_line_filter);
+			network_read_slot.reset();
 
 			steady_clock::time_point end = steady_clock::now();
 			accum_elapsed_time += (end - start);
 
+			if(f.rejected())
+			{
+				// Its first line says it's not of a type we're searching.
+				LOG(INFO) << "... first line doesn't match any type, skipping.";
+				if(stats_ptr != nullptr)
+				{
+					stage_timer->Lap(stats.m_read);
+					++stats.m_files_skipped;
+				}
+				SendMatchList(next_file, ml);
+				continue;
+			}
+
 			auto bytes_read = f.size();
 			total_bytes_read += bytes_read;
 			LOG(INFO) << "Num/total bytes read: " << bytes_read << " / " << total_bytes_read;
 
+			m_throughput.m_files_scanned.fetch_add(1, std::memory_order_relaxed);
+			m_throughput.m_bytes_read.fetch_add(bytes_read, std::memory_order_relaxed);
+			m_throughput.m_read_ns.fetch_add(duration_cast<nanoseconds>(end - start).count(), std::memory_order_relaxed);
+
+			if(stats_ptr != nullptr)
+			{
+				stage_timer->Lap(stats.m_read);
+				++stats.m_files_scanned;
+				stats.m_bytes_read += bytes_read;
+			}
+
 			if(f.size() == 0)
 			{
 				LOG(INFO) << "WARNING: Filesize of \'" << f.name() << "\' is 0, skipping.";
+				SendMatchList(next_file, ml);
 				continue;
 			}
 
@@ -155,27 +277,33 @@ void FileScanner::Run(int thread_index)
 			size_t file_size = f.size();
 
 			// Scan the file data for occurrences of the regex, sending matches to the MatchList ml.
+			start = steady_clock::now();
 			ScanFile(thread_index, file_data, file_size, ml);
+			ml.AddTrailingContext(file_data, file_size, m_max_line_length);
+			m_throughput.m_scan_ns.fetch_add(duration_cast<nanoseconds>(steady_clock::now() - start).count(), std::memory_order_relaxed);
 
-			if(!ml.empty())
+			if(stats_ptr != nullptr)
 			{
-				ml.SetFilename(next_file->GetPath());
-				// Force move semantics here.
-				m_output_queue.push_back(std::move(ml));
-				ml.clear();
+				stage_timer->Lap(stats.m_scan);
 			}
+
+			SendMatchList(next_file, ml, stats_ptr);
 		}
 		catch(const FileException &error)
 		{
 			// The File constructor threw an exception.
 			ERROR() << error.what();
 			LOG(DEBUG) << "Caught FileException: " << error.what();
+			ml.clear();
+			SendMatchList(next_file, ml);
 		}
 		catch(const std::system_error& error)
 		{
 			// A system error.  Currently should only be errors from File.
 			ERROR() << error.code() << " - " << error.code().message();
 			LOG(DEBUG) << "Caught std::system_error: " << error.code() << " - " << error.code().message();
+			ml.clear();
+			SendMatchList(next_file, ml);
 		}
 		catch(...)
 		{
@@ -186,6 +314,118 @@ void FileScanner::Run(int thread_index)
 
 	duration<double> elapsed = duration_cast<duration<double>>(accum_elapsed_time);
 	LOG(INFO) << "Total bytes read = " << total_bytes_read << ", elapsed time = " << elapsed.count() << ", Bytes/Sec=" << total_bytes_read/elapsed.count() << std::endl;
+
+	if(m_run_stats != nullptr)
+	{
+		*m_run_stats += stats;
+	}
+}
+
+void FileScanner::SetNetworkReadLimit(int max_concurrent_reads)
+{
+	m_network_read_slots = std::make_unique<std::counting_semaphore<>>(std::max(1, max_concurrent_reads));
+}
+
+void FileScanner::EnableNumaPlacement()
+{
+	auto topology = std::make_unique<NumaTopology>(NumaTopology::Discover());
+
+	if(topology->num_nodes() < 2)
+	{
+		LOG(INFO) << "Only one NUMA node, not enabling NUMA placement.";
+		return;
+	}
+
+	LOG(INFO) << "Enabling NUMA placement across " << topology->num_nodes() << " nodes.";
+	for(size_t i = 0; i < topology->num_nodes(); ++i)
+	{
+		m_node_file_queues.push_back(std::make_unique<sync_queue<FileRecord>>());
+	}
+	m_numa_topology = std::move(topology);
+}
+
+bool FileScanner::PullNextFile(int thread_index, FileRecord &next_file)
+{
+	/// @note With ordered output, files have to be taken in sequence order, or the file the OutputTask is waiting on
+	/// could be stuck in a node queue behind threads waiting on the OutputTask.  So no node queues then.
+	/// Nor for low latency, where we don't want any file waiting in a node queue while another node's threads are idle.
+	if(!m_numa_topology || m_reorder_window != nullptr || m_low_latency)
+	{
+		return m_in_queue.pull_front(std::move(next_file)) != queue_op_status::closed;
+	}
+
+	// Try our node's queue first.
+	auto &node_queue = *m_node_file_queues[thread_index % m_node_file_queues.size()];
+	if(node_queue.try_pull_front(next_file) == queue_op_status::success)
+	{
+		return true;
+	}
+
+	// It's empty, refill it from the shared input queue.  Taking a batch at a time keeps the threads of the different
+	// nodes from bouncing the input queue's lock between them on every file.
+	/// @note Any files we put in the node queue will be pulled by this thread before it blocks on the input queue
+	/// again, so none can be left behind when the input queue is closed.
+	std::deque<FileRecord> batch;
+	if(m_in_queue.pull_front(batch, f_node_queue_batch_size) == queue_op_status::closed)
+	{
+		return false;
+	}
+
+	next_file = std::move(batch.front());
+	batch.pop_front();
+	if(!batch.empty())
+	{
+		node_queue.push_back(batch);
+	}
+
+	return true;
+}
+
+void FileScanner::SendMatchList(const FileRecord &file, MatchList &ml, RunStats *stats)
+{
+	if(m_reorder_window != nullptr)
+	{
+		// Ordered output.  The OutputTask needs to hear about every file, or it would wait forever for the ones with
+		// no matches.
+		auto seq = file.GetSequenceNumber();
+		m_reorder_window->WaitUntilInWindow(seq);
+		ml.SetSequenceNumber(seq);
+	}
+	else if(ml.empty())
+	{
+		return;
+	}
+
+	if(!ml.empty())
+	{
+		ml.SetFilename(file.GetPath());
+	}
+
+	if(m_output_context != nullptr)
+	{
+		// Do the formatting here, in parallel, instead of in the OutputTask.  Then only the formatted output has
+		// to go on, and ml keeps its storage for the next file.
+		if(!ml.empty())
+		{
+			if(stats != nullptr)
+			{
+				StageTimer format_timer;
+				ml.Format(*m_output_context);
+				format_timer.Lap(stats->m_format);
+			}
+			else
+			{
+				ml.Format(*m_output_context);
+			}
+		}
+		m_output_queue.push_back(ml.TakeFormattedOutput());
+	}
+	else
+	{
+		// Force move semantics here.
+		m_output_queue.push_back(std::move(ml));
+		ml.clear();
+	}
 }
 
 void FileScanner::AssignToNextCore()
@@ -26,10 +26,17 @@
 #include <string>
 #include <memory>
 #include <functional>
-
-#include "libext/FileID.h"
+#include <atomic>
+#include <semaphore>
+
+#include "libext/FileRecord.h"
+#include "File.h"
+#include "libext/WorkerGate.hpp"
+#include "libext/NumaTopology.h"
+#include "libext/ReorderWindow.hpp"
 #include "sync_queue_impl_selector.h"
 #include "MatchList.h"
+#include "RunStats.h"
 
 
 extern "C" void* resolve_CountLinesSinceLastMatch(void);
@@ -63,6 +70,23 @@ struct FileScannerException : public std::runtime_error
 };
 
 
+/**
+ * Running totals of the work done by all FileScanner threads.  Updated once per file by each thread, and sampled by
+ * the AutoTuner while the scan is in progress.
+ */
+struct FileScannerThroughput
+{
+	std::atomic<long long> m_files_scanned {0};
+	std::atomic<long long> m_bytes_read {0};
+
+	/// Wall-clock nanoseconds spent opening and reading files.
+	std::atomic<long long> m_read_ns {0};
+
+	/// Wall-clock nanoseconds spent in ScanFile().
+	std::atomic<long long> m_scan_ns {0};
+};
+
+
 /**
  * Base class for the classes which do the actual regex scanning of the file contents.
  */
@@ -82,7 +106,7 @@ public:
 	 * @param engine
 	 * @return
 	 */
-	static std::unique_ptr<FileScanner> Create(sync_queue<std::shared_ptr<FileID>> &in_queue,
+	static std::unique_ptr<FileScanner> Create(sync_queue<FileRecord> &in_queue,
 			sync_queue<MatchList> &output_queue,
 			std::string regex,
 			bool ignore_case,
@@ -91,7 +115,7 @@ public:
 			RegexEngine engine = RegexEngine::DEFAULT);
 
 public:
-	FileScanner(sync_queue<std::shared_ptr<FileID>> &in_queue,
+	FileScanner(sync_queue<FileRecord> &in_queue,
 			sync_queue<MatchList> &output_queue,
 			std::string regex,
 			bool ignore_case,
@@ -99,10 +123,114 @@ public:
 			bool pattern_is_literal);
 	virtual ~FileScanner();
 
+	/**
+	 * Called once from the main thread, before any Run() threads are started, with the number of Run() threads
+	 * which will be started.  Derived classes size their per-thread data here.
+	 *
+	 * @param thread_count
+	 */
 	virtual void ThreadLocalSetup(int thread_count) { (void)thread_count; };
 
+	/**
+	 * Called by each Run() thread before it starts pulling files, after it's been placed on its CPU(s).  Derived
+	 * classes allocate their per-thread data here, so that with NUMA placement it ends up on the thread's local node.
+	 *
+	 * @param thread_index
+	 */
+	virtual void ThreadLocalInit(int thread_index) { (void)thread_index; };
+
+	/**
+	 * Enable NUMA-aware placement of the Run() threads.  Each thread is pinned to the CPUs of one NUMA node
+	 * (round-robin by thread index), allocates its buffers after being pinned so that they're node-local, and pulls
+	 * files from a per-node queue which is refilled in batches from the input queue.  Does nothing if the system has
+	 * only one node.  Must be called before any Run() threads are started.
+	 */
+	void EnableNumaPlacement();
+
 	void Run(int thread_index);
 
+	/**
+	 * Throttle the Run() threads with @p gate.  Thread @c thread_index will only pull a new file off the input queue
+	 * while @c gate->IsActive(thread_index).  Must be called before any Run() threads are started.
+	 *
+	 * @param gate  Not owned.
+	 */
+	void SetWorkerGate(WorkerGate *gate) noexcept { m_worker_gate = gate; };
+
+	/**
+	 * Enable ordered output.  The Run() threads will send a MatchList for every file, including those with no
+	 * matches, tagged with the file's sequence number, and will wait for @p window before sending any which the
+	 * OutputTask couldn't yet buffer.  Must be called before any Run() threads are started.
+	 *
+	 * @param window  Not owned.
+	 */
+	void SetReorderWindow(ReorderWindow *window) noexcept { m_reorder_window = window; };
+
+	/**
+	 * Have the Run() threads format each MatchList for output as directed by @p output_context before sending it on.
+	 * Must be called before any Run() threads are started.
+	 *
+	 * @param output_context  Not owned.
+	 */
+	void SetOutputContext(const OutputContext *output_context) noexcept { m_output_context = output_context; };
+
+	/**
+	 * Limit the text kept for each matched line to @p max_line_length bytes around the match.  0 means no limit.
+	 * Must be called before any Run() threads are started.
+	 */
+	void SetMaxLineLength(size_t max_line_length) noexcept { m_max_line_length = max_line_length; };
+
+	/**
+	 * Print @p before lines of context before each match, and @p after lines after it.  See MatchList::SetContextLines().
+	 * Must be called before any Run() threads are started.
+	 */
+	void SetContextLines(size_t before, size_t after) noexcept { m_context_before = before; m_context_after = after; };
+
+	/**
+	 * Keep only the matched text instead of the whole line.  See MatchList::SetOnlyMatching().
+	 * Must be called before any Run() threads are started.
+	 */
+	void SetOnlyMatching(bool only_matching) noexcept { m_only_matching = only_matching; };
+
+	/**
+	 * Count match columns in UTF-8 code points instead of bytes.  See MatchList::SetCodepointColumns().
+	 * Must be called before any Run() threads are started.
+	 */
+	void SetCodepointColumns(bool codepoint_columns) noexcept { m_codepoint_columns = codepoint_columns; };
+
+	/**
+	 * Favor time-to-first-result over throughput.  With NUMA placement, files are then pulled one at a time straight
+	 * from the input queue, instead of in batches into the per-node queues, where the first files found could sit
+	 * behind others.  Must be called before any Run() threads are started.
+	 */
+	void SetLowLatency(bool low_latency) noexcept { m_low_latency = low_latency; };
+
+	/**
+	 * Collect the read, scan, and format stats for the --stats report, and add them to @p run_stats as each Run()
+	 * thread finishes.  Must be called before any Run() threads are started.
+	 *
+	 * @param run_stats  Not owned.
+	 */
+	void SetRunStats(RunStats *run_stats) noexcept { m_run_stats = run_stats; };
+
+	/**
+	 * Decide whether to search the files whose type the traversal deferred (see FileRecord::IsTypeDeferred()) with
+	 * @p first_line_filter, which is given the first 4 KiB of each, as read for the search.  Files it rejects aren't
+	 * read any further.  Without one, they're skipped.  Must be called before any Run() threads are started.
+	 */
+	void SetFirstLineFilter(const first_block_filter_type &first_line_filter) { m_first_line_filter = first_line_filter; };
+
+	/**
+	 * Read at most @p max_concurrent_reads of the files on network filesystems (see
+	 * FileRecord::IsOnNetworkFilesystem()) at once, so that a slow server or FUSE daemon can't tie up every scanner.
+	 * A scanner which finds all the slots taken sets the file aside and goes on with the others, except with ordered
+	 * output, where nothing after the file could be output before it anyway.  Must be called before any Run() threads
+	 * are started.
+	 */
+	void SetNetworkReadLimit(int max_concurrent_reads);
+
+	[[nodiscard]] const FileScannerThroughput& GetThroughput() const noexcept { return m_throughput; };
+
 protected:
 
 	/// @name Member-Function Pseudo-Multiversioning
@@ -229,6 +357,21 @@ protected:
 	/// Flag set by regex analysis if matching should use m_literal_search_string as the literal prefix of a larger regular expression.
 	bool m_use_lit_prefix {false};
 
+	/// Maximum number of bytes of each matched line to keep, 0 for no limit.
+	size_t m_max_line_length {0};
+
+	/// @name Lines of context to print before and after each match.
+	///@{
+	size_t m_context_before {0};
+	size_t m_context_after {0};
+	///@}
+
+	/// true if only the matched text should be kept.
+	bool m_only_matching {false};
+
+	/// true if match columns should be in code points.
+	bool m_codepoint_columns {false};
+
 private:
 
 	/**
@@ -240,6 +383,25 @@ private:
 	 */
 	void AssignToNextCore();
 
+	/**
+	 * Get the next file for thread @p thread_index to scan.  Blocks until one is available.
+	 *
+	 * @param thread_index
+	 * @param next_file
+	 * @return  false if there are no more files to scan.
+	 */
+	bool PullNextFile(int thread_index, FileRecord &next_file);
+
+	/**
+	 * Send @p ml, the results of scanning @p file, to the output queue, and clear it for reuse.  Empty MatchLists are
+	 * only sent for ordered output.
+	 *
+	 * @param file
+	 * @param ml
+	 * @param stats  If non-null, the time spent formatting @p ml is added to its format stage.
+	 */
+	void SendMatchList(const FileRecord &file, MatchList &ml, RunStats *stats = nullptr);
+
 	/**
 	 * Scan @a file_data for matches of the regex.  Add hits to @a ml.
 	 *
@@ -249,10 +411,39 @@ private:
 	 */
 	virtual void ScanFile(int thread_index, const char * __restrict__ file_data, size_t file_size, MatchList &ml) = 0;
 
-	sync_queue<std::shared_ptr<FileID>>& m_in_queue;
+	sync_queue<FileRecord>& m_in_queue;
 
 	sync_queue<MatchList> &m_output_queue;
 
+	/// Optional gate throttling the number of running Run() threads.
+	WorkerGate *m_worker_gate { nullptr };
+
+	/// If non-null, output is ordered, and this bounds how far ahead of the OutputTask we can get.
+	ReorderWindow *m_reorder_window { nullptr };
+
+	/// If non-null, how to format the MatchLists.
+	const OutputContext *m_output_context { nullptr };
+
+	/// Whether to favor time-to-first-result over throughput.
+	bool m_low_latency { false };
+
+	/// Decides on the files whose type was deferred.
+	first_block_filter_type m_first_line_filter;
+
+	/// If non-null, the slots for reading files on network filesystems.
+	std::unique_ptr<std::counting_semaphore<>> m_network_read_slots;
+
+	/// If non-null, where to add up the stats for --stats.
+	RunStats *m_run_stats { nullptr };
+
+	FileScannerThroughput m_throughput;
+
+	/// The NUMA topology, if NUMA placement has been enabled.
+	std::unique_ptr<NumaTopology> m_numa_topology;
+
+	/// With NUMA placement, one queue of files per node, shared by the threads pinned to that node.
+	std::vector<std::unique_ptr<sync_queue<FileRecord>>> m_node_file_queues;
+
 	int m_next_core;
 
 	bool m_use_mmap;
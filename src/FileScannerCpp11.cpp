@@ -21,7 +21,7 @@
 
 #include "FileScannerCpp11.h"
 
-FileScannerCpp11::FileScannerCpp11(sync_queue<std::shared_ptr<FileID>> &in_queue,
+FileScannerCpp11::FileScannerCpp11(sync_queue<FileRecord> &in_queue,
 		sync_queue<MatchList> &output_queue,
 		std::string regex,
 		bool ignore_case,
@@ -59,25 +59,7 @@ void FileScannerCpp11::ScanFile(int thread_index [[maybe_unused]], const char *
 		//std::cout << "Match in file " << next_string << std::endl;
 
 		long long lineno = 1+std::count(file_data, file_data+rit->position(), '\n');
-		auto line_ending = "\n";
-		auto line_start = std::find_end(file_data, file_data+rit->position(),
-				line_ending, line_ending+1);
-		if(line_start == file_data+rit->position())
-		{
-			// The line has no starting '\n', so it must be the first line.
-			line_start = file_data;
-		}
-		else
-		{
-			// The line had a starting '\n', clip it off.
-			++line_start;
-		}
-		auto line_end = std::find(file_data+rit->position(), file_data+file_size, '\n');
-		auto pre_match = std::string(line_start, file_data+rit->position());
-		auto match = std::string(rit->begin()->str());
-		auto post_match = std::string(file_data+rit->position()+rit->length(), line_end);
-		Match m = { pre_match, match, post_match };
-		ml.AddMatch(lineno, m);
+		ml.AddMatch(file_data, file_size, rit->position(), rit->position()+rit->length(), lineno, m_max_line_length);
 
 		++rit;
 	}
@@ -68,7 +68,7 @@ static int callout_handler(pcre_callout_block *cob)
 }
 #endif
 
-FileScannerPCRE::FileScannerPCRE(sync_queue<std::shared_ptr<FileID>> &in_queue,
+FileScannerPCRE::FileScannerPCRE(sync_queue<FileRecord> &in_queue,
 		sync_queue<MatchList> &output_queue,
 		std::string regex,
 		bool ignore_case,
@@ -146,7 +146,6 @@ void FileScannerPCRE::ScanFile(int thread_index, const char* __restrict__ file_d
 	// Match output vector.  We won't support submatches, so we only need two entries, plus a third for pcre's own use.
 	int ovector[3] = {-1, 0, 0};
 	size_t line_no = 1;
-	size_t prev_lineno = 0;
 	const char *prev_lineno_search_end = file_data;
 	// Up-cast file_size, which is a size_t (unsigned) to a ptrdiff_t (signed) which should be able to handle the
 	// same positive range, and not cause issues when compared with the ints of ovector[].
@@ -256,15 +255,7 @@ void FileScannerPCRE::ScanFile(int thread_index, const char* __restrict__ file_d
 		// There was a match.  Package it up in the MatchList which was passed in.
 		line_no += CountLinesSinceLastMatch(prev_lineno_search_end, file_data+ovector[0]);
 		prev_lineno_search_end = file_data+ovector[0];
-		if(line_no == prev_lineno)
-		{
-			// Skip multiple matches on one line.
-			continue;
-		}
-		prev_lineno = line_no;
-		Match m(file_data, file_size, ovector[0], ovector[1], line_no);
-
-		ml.AddMatch(std::move(m));
+		ml.AddMatch(file_data, file_size, ovector[0], ovector[1], line_no, m_max_line_length);
 	}
 #endif // HAVE_LIBPCRE
 }
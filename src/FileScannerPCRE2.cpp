@@ -93,7 +93,7 @@ static size_t pattern_num_callouts(const pcre2_code *code)
 
 #endif  // HAVE_LIBPCRE2
 
-FileScannerPCRE2::FileScannerPCRE2(sync_queue<std::shared_ptr<FileID>> &in_queue,
+FileScannerPCRE2::FileScannerPCRE2(sync_queue<FileRecord> &in_queue,
 		sync_queue<MatchList> &output_queue,
 		std::string regex,
 		bool ignore_case,
@@ -287,16 +287,27 @@ void FileScannerPCRE2::AnalyzeRegex(const std::string &regex_passed_in) noexcept
 
 void FileScannerPCRE2::ThreadLocalSetup(int thread_count)
 {
-	for(int i = 0; i<thread_count; ++i)
-	{
 #if HAVE_LIBPCRE2
-		/// Create a std::unique_ptr<> with a custom deleter (see above) to manage the lifetime of the match data.
-		m_match_data.push_back(std::unique_ptr<pcre2_match_data>(pcre2_match_data_create_from_pattern(m_pcre2_regex, NULL)));
-		m_match_context.push_back(std::unique_ptr<pcre2_match_context>(pcre2_match_context_create(NULL)));
-		// Hook in our callout function.
-		pcre2_set_callout(m_match_context[i].get(), callout_handler, this);
+	// Only make room for the per-thread data here.  Each thread creates its own in ThreadLocalInit(), so that
+	// it's allocated from memory local to that thread.
+	m_match_data.resize(thread_count);
+	m_match_context.resize(thread_count);
+#else
+	(void)thread_count;
+#endif  // HAVE_LIBPCRE2
+}
+
+void FileScannerPCRE2::ThreadLocalInit(int thread_index)
+{
+#if HAVE_LIBPCRE2
+	/// Create a std::unique_ptr<> with a custom deleter (see above) to manage the lifetime of the match data.
+	m_match_data[thread_index].reset(pcre2_match_data_create_from_pattern(m_pcre2_regex, NULL));
+	m_match_context[thread_index].reset(pcre2_match_context_create(NULL));
+	// Hook in our callout function.
+	pcre2_set_callout(m_match_context[thread_index].get(), callout_handler, this);
+#else
+	(void)thread_index;
 #endif  // HAVE_LIBPCRE2
-	}
 }
 
 void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_data, size_t file_size, MatchList& ml)
@@ -308,7 +319,6 @@ void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_
 	PCRE2_SIZE *ovector;
 
 	size_t line_no {1};
-	size_t prev_lineno {0};
 	const char *prev_lineno_search_end {file_data};
 	size_t start_offset { 0 };
 
@@ -489,15 +499,7 @@ void FileScannerPCRE2::ScanFile(int thread_index, const char* __restrict__ file_
 			// There was a match.  Package it up in the MatchList which was passed in.
 			line_no += CountLinesSinceLastMatch(prev_lineno_search_end, file_data+ovector[0]);
 			prev_lineno_search_end = file_data+ovector[0];
-			if(line_no == prev_lineno)
-			{
-				// Skip multiple matches on one line.
-				continue;
-			}
-			prev_lineno = line_no;
-			Match m(file_data, file_size, ovector[0], ovector[1], line_no);
-
-			ml.AddMatch(std::move(m));
+			ml.AddMatch(file_data, file_size, ovector[0], ovector[1], line_no, m_max_line_length);
 		}
 		catch(...)
 		{
@@ -59,7 +59,7 @@ namespace std
 class FileScannerPCRE2: public FileScanner
 {
 public:
-	FileScannerPCRE2(sync_queue<std::shared_ptr<FileID>> &in_queue,
+	FileScannerPCRE2(sync_queue<FileRecord> &in_queue,
 			sync_queue<MatchList> &output_queue,
 			std::string regex,
 			bool ignore_case,
@@ -75,6 +75,8 @@ public:
 
 	void ThreadLocalSetup(int thread_count) final;
 
+	void ThreadLocalInit(int thread_index) final;
+
 private:
 
 	/**
@@ -27,6 +27,7 @@
 
 #include "TypeManager.h"
 #include "DirInclusionManager.h"
+#include "RunStats.h"
 
 #include <libext/Logger.h>
 
@@ -38,25 +39,60 @@ Globber::Globber(std::vector<std::string> start_paths,
 		DirInclusionManager &dir_inc_manager,
 		bool recurse_subdirs,
 		bool follow_symlinks,
+		bool sort_files,
 		int dirjobs,
-		sync_queue<std::shared_ptr<FileID>>& out_queue)
+		sync_queue<FileRecord>& out_queue,
+		DirTable &dir_table,
+		WorkerGate *dirjob_gate)
 		: m_start_paths(start_paths),
 		  m_type_manager(type_manager),
 		  m_dir_inc_manager(dir_inc_manager),
 		  m_recurse_subdirs(recurse_subdirs),
 		  m_follow_symlinks(follow_symlinks),
+		  m_sort_files(sort_files),
 		  m_dirjobs(dirjobs),
-		  m_out_queue(out_queue)
+		  m_out_queue(out_queue),
+		  m_dir_table(dir_table),
+		  m_dirjob_gate(dirjob_gate)
 {
 
 }
 
 void Globber::Run()
 {
-	auto file_basename_filter = [this](const std::string &basename) noexcept { return m_type_manager.FileShouldBeScanned(basename); };
-	auto dir_basename_filter = [this](const std::string &basename) noexcept { return m_dir_inc_manager.DirShouldBeExcluded(basename); };
+	auto file_basename_filter = [this](std::string_view basename) noexcept { return m_type_manager.FileShouldBeScanned(basename); };
+	auto dir_basename_filter = [this](std::string_view basename) noexcept { return m_dir_inc_manager.DirShouldBeExcluded(basename); };
 
-	DirTree dt(m_out_queue, file_basename_filter, dir_basename_filter, m_recurse_subdirs, m_follow_symlinks);
+	DirTree dt(m_out_queue, m_dir_table, file_basename_filter, dir_basename_filter, m_recurse_subdirs, m_follow_symlinks, m_sort_files, m_dirjob_gate);
+	dt.SetLowLatency(m_low_latency);
+	dt.SetUseIgnoreFiles(m_use_ignore_files);
+	dt.SetMaxDepth(m_max_depth);
+	dt.SetOneFileSystem(m_one_file_system);
+	dt.SetFilesystemPolicy(m_fs_policy);
+	if(m_type_manager.HasFirstLineRegexes())
+	{
+		dt.SetDeferredFileFilter([this](std::string_view basename) noexcept {
+			return m_type_manager.FileTypeDependsOnFirstLine(basename); });
+	}
+	if(m_dir_inc_manager.HasPathExclusions())
+	{
+		dt.SetDirPathFilter([this](std::string_view rel_dir, std::string_view basename) {
+			return m_dir_inc_manager.DirPathShouldBeExcluded(rel_dir, basename); });
+	}
+
+	auto start = std::chrono::steady_clock::now();
 
 	dt.Scandir(m_start_paths, m_dirjobs);
+
+	if(m_run_stats != nullptr)
+	{
+		const DirTraversalStats &dts = dt.GetStats();
+		RunStats stats;
+		stats.m_files_considered = dts.m_num_files_found;
+		stats.m_files_skipped = dts.m_num_files_rejected;
+		stats.m_dirs_skipped = dts.m_num_dirs_rejected;
+		stats.m_traversal.m_wall = std::chrono::steady_clock::now() - start;
+		stats.m_traversal.m_cpu = dts.m_cpu_time;
+		*m_run_stats += stats;
+	}
 }
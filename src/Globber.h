@@ -24,13 +24,17 @@
 
 #include <vector>
 #include <string>
+#include <limits>
 #include "libext/FileID.h"
+#include "libext/FileRecord.h"
+#include "libext/WorkerGate.hpp"
 #include "sync_queue_impl_selector.h"
 
 
 // Forward decls.
 class TypeManager;
 class DirInclusionManager;
+class RunStats;
 
 /**
  * This class does the directory tree traversal.
@@ -43,10 +47,31 @@ public:
 			DirInclusionManager &dir_inc_manager,
 			bool recurse_subdirs,
 			bool follow_symlinks,
+			bool sort_files,
 			int dirjobs,
-			sync_queue<std::shared_ptr<FileID>> &out_queue);
+			sync_queue<FileRecord> &out_queue,
+			DirTable &dir_table,
+			WorkerGate *dirjob_gate = nullptr);
 	~Globber() = default;
 
+	/// Send each file on as soon as it's found.  See DirTree::SetLowLatency().  Must be called before Run().
+	void SetLowLatency(bool low_latency) noexcept { m_low_latency = low_latency; };
+
+	/// Obey ignore files.  See DirTree::SetUseIgnoreFiles().  Must be called before Run().
+	void SetUseIgnoreFiles(bool use_ignore_files) noexcept { m_use_ignore_files = use_ignore_files; };
+
+	/// Limit the depth of the traversal.  See DirTree::SetMaxDepth().  Must be called before Run().
+	void SetMaxDepth(size_t max_depth) noexcept { m_max_depth = max_depth; };
+
+	/// Stay on the starting paths' filesystems.  See DirTree::SetOneFileSystem().  Must be called before Run().
+	void SetOneFileSystem(bool one_file_system) noexcept { m_one_file_system = one_file_system; };
+
+	/// Treat mounted filesystems by kind.  See DirTree::SetFilesystemPolicy().  Must be called before Run().
+	void SetFilesystemPolicy(bool fs_policy) noexcept { m_fs_policy = fs_policy; };
+
+	/// Add the traversal's stats to @p run_stats once it's done.  Not owned.  Must be called before Run().
+	void SetRunStats(RunStats *run_stats) noexcept { m_run_stats = run_stats; };
+
 	void Run();
 
 private:
@@ -64,9 +89,33 @@ private:
 
 	bool m_follow_symlinks;
 
+	/// Whether to traverse in sorted order.  See DirTree::Scandir().
+	bool m_sort_files;
+
+	/// Whether to favor time-to-first-result over throughput.
+	bool m_low_latency { false };
+
+	/// Whether to skip what ignore files exclude.
+	bool m_use_ignore_files { false };
+
+	size_t m_max_depth { std::numeric_limits<size_t>::max() };
+
+	bool m_one_file_system { false };
+
+	bool m_fs_policy { false };
+
 	int m_dirjobs;
 
-	sync_queue<std::shared_ptr<FileID>>& m_out_queue;
+	sync_queue<FileRecord>& m_out_queue;
+
+	/// Where the directories of the files in #m_out_queue are kept alive.
+	DirTable &m_dir_table;
+
+	/// If non-null, the gate the AutoTuner uses to throttle the directory traversal threads.
+	WorkerGate *m_dirjob_gate;
+
+	/// If non-null, where the traversal's stats go.
+	RunStats *m_run_stats { nullptr };
 };
 
 
@@ -23,16 +23,18 @@
 
 #include <algorithm>
 
-Match::Match(const char *start_of_array, size_t array_size, size_t match_start_offset, size_t match_end_offset, size_t line_number)
+#include <libext/bytesearch.hpp>
+
+Match::Match(const char *start_of_array, size_t array_size, size_t match_start_offset, size_t match_end_offset, size_t line_number,
+		std::string &line_arena, size_t max_line_length, bool only_matching)
 {
-	auto line_ending = "\n";
-	// Find the start of the line.
-	std::reverse_iterator<const char*> rstart(start_of_array+match_start_offset);
-	std::reverse_iterator<const char*> rend(start_of_array);
+	const char *match_start = start_of_array + match_start_offset;
+	const char *match_end = start_of_array + match_end_offset;
+	const char *array_end = start_of_array + array_size;
 
-	auto line_start_rit = std::find(rstart, rend, line_ending[0]);
-	const char *line_start;
-	if(line_start_rit == rend)
+	// Find the start of the line.
+	const char *line_start = find_byte_backward(start_of_array, match_start, '\n');
+	if(line_start == nullptr)
 	{
 		// The line has no starting '\n', so it must be the first line.
 		line_start = start_of_array;
@@ -40,16 +42,70 @@ Match::Match(const char *start_of_array, size_t array_size, size_t match_start_o
 	else
 	{
 		// The line had a starting '\n', clip it off.
-		line_start = line_start_rit.base();
+		++line_start;
+	}
+
+	// Find the end of the matched line, and what part of the line we'll keep.
+	const char *copy_start = line_start;
+	const char *line_end;
+	if(only_matching)
+	{
+		// Keep just the match, or as much of it as is on its first line.  The rest of the line is never looked at.
+		copy_start = match_start;
+		line_end = find_byte_forward(match_start, match_end, '\n');
+		if(max_line_length != 0 && static_cast<size_t>(line_end - match_start) > max_line_length)
+		{
+			line_end = match_start + max_line_length;
+		}
+	}
+	else if(max_line_length == 0)
+	{
+		line_end = find_byte_forward(match_start, array_end, '\n');
+	}
+	else
+	{
+		// Keep at most max_line_length bytes: as much of the match as fits, with up to half the remaining space
+		// for context before it, and the rest for context after it.  There's no need to look for the end of the
+		// line any further than that.
+		size_t match_len = std::min<size_t>(match_end - match_start, max_line_length);
+		size_t pre_len = std::min<size_t>(match_start - line_start, (max_line_length - match_len) / 2);
+		copy_start = match_start - pre_len;
+		size_t max_len_from_match = max_line_length - pre_len;
+		const char *search_end = (static_cast<size_t>(array_end - match_start) > max_len_from_match)
+				? match_start + max_len_from_match : array_end;
+		line_end = find_byte_forward(match_start, search_end, '\n');
 	}
 
-	// Find the end of the matched line.
-	auto line_end = std::find(start_of_array+match_start_offset, start_of_array+array_size, line_ending[0]);
+	// A match can span lines.  Only the first line is kept, so clip the match to it.
+	match_end = std::min(match_end, line_end);
 
-	// Form the match substrings.
-	m_pre_match = std::string(line_start, start_of_array+match_start_offset);
-	m_match = std::string(start_of_array+match_start_offset, start_of_array+match_end_offset);
-	m_post_match = std::string(start_of_array+match_start_offset+(match_end_offset-match_start_offset), line_end);
+	// Copy the line into the arena, and record where the match is in it.
+	m_line_offset = line_arena.size();
+	m_line_file_offset = copy_start - start_of_array;
+	m_line_length = line_end - copy_start;
+	line_arena.append(copy_start, m_line_length);
+	m_match_start = match_start - copy_start;
+	m_match_end = match_end - copy_start;
+	m_match_column = match_start - line_start;
 	m_line_number = line_number;
 }
 
+Match Match::ContextLine(const char *start_of_array, const char *line_start, const char *line_end, size_t line_number,
+		std::string &line_arena, size_t max_line_length)
+{
+	Match retval;
+
+	if(max_line_length != 0 && static_cast<size_t>(line_end - line_start) > max_line_length)
+	{
+		line_end = line_start + max_line_length;
+	}
+
+	retval.m_line_offset = line_arena.size();
+	retval.m_line_file_offset = line_start - start_of_array;
+	retval.m_line_length = line_end - line_start;
+	line_arena.append(line_start, retval.m_line_length);
+	retval.m_line_number = line_number;
+	retval.m_is_context_line = true;
+
+	return retval;
+}
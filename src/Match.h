@@ -23,59 +23,101 @@
 #include <config.h>
 
 #include <string>
+#include <string_view>
 #include <type_traits>
 
 /**
  * Class representing a single match in a single file found by FileScanner*::ScanFile().
- * Mostly struct-like behavior; e.g. all data members are public, no member functions other than the constructors.
- * For performance reasons, this class is only move constructible and assignable, not copy constructible or assignable.
- * This allows MatchList to also then be move constructible.
+ * Mostly struct-like behavior; e.g. all data members are public.
+ *
+ * The text of the matched line isn't stored in the Match itself.  It's copied once into a byte arena owned by the
+ * MatchList, which is reused from file to file, and the Match only records where in the arena the line is and where
+ * in the line the match is.  The pre-match, match, and post-match parts are views into the arena, valid as long as
+ * the arena isn't modified.  This keeps Match trivially copyable, and means a hit costs no allocations of its own.
+ *
+ * A line can have more than one match on it.  The first one is what pre_match(), match(), post_match(), and the column
+ * describe.  All of them, the first included, are kept as Spans in a second arena owned by the MatchList, and the Match
+ * records which run of that arena is its own.
  */
 class Match
 {
 public:
-	Match(const char *start_of_array, size_t array_size, size_t match_start_offset, size_t match_end_offset, size_t line_number);
+	/// The start and one past the end of one match in the line, relative to the start of what was kept of the line.
+	struct Span
+	{
+		size_t m_start;
+		size_t m_end;
+	};
+
+	/**
+	 * Find the line containing the match [@p match_start_offset, @p match_end_offset) in the @p array_size bytes at
+	 * @p start_of_array, and append it to @p line_arena.
+	 *
+	 * @param max_line_length  If non-zero, only up to this many bytes of the line, around the match, are kept.
+	 * @param only_matching    If true, only the match itself is kept, as if it were the whole line.
+	 */
+	Match(const char *start_of_array, size_t array_size, size_t match_start_offset, size_t match_end_offset, size_t line_number,
+			std::string &line_arena, size_t max_line_length = 0, bool only_matching = false);
 	Match() = default;
 
-	/// Delete the copy constructor and the move assignment operator.  With the std::strings in here, this is a relatively expensive
-	/// class to copy, so we only allow move-constructing.
-	Match(const Match &other) = delete;
-	Match& operator=(const Match&) = delete;
+	/**
+	 * Make a Match for the context line [@p line_start, @p line_end) in the array at @p start_of_array, which is line
+	 * @p line_number, appending it to @p line_arena.  A context line has no match in it; all of it is post_match().
+	 */
+	static Match ContextLine(const char *start_of_array, const char *line_start, const char *line_end, size_t line_number,
+			std::string &line_arena, size_t max_line_length = 0);
+
+	/// @name Views of the parts of the matched line.
+	/// @param line_arena  The arena which was passed to the constructor.
+	/// @{
+	[[nodiscard]] std::string_view pre_match(const std::string &line_arena) const noexcept
+	{
+		return std::string_view(line_arena.data() + m_line_offset, m_match_start);
+	};
+	[[nodiscard]] std::string_view match(const std::string &line_arena) const noexcept
+	{
+		return std::string_view(line_arena.data() + m_line_offset + m_match_start, m_match_end - m_match_start);
+	};
+	[[nodiscard]] std::string_view post_match(const std::string &line_arena) const noexcept
+	{
+		return std::string_view(line_arena.data() + m_line_offset + m_match_end, m_line_length - m_match_end);
+	};
+	/// @}
 
-	/// Since we deleted the copy constructor, we have to explicitly declare that we want the default move ctor and assignment op.
-	Match(Match &&other) noexcept = default;
-	Match& operator=(Match &&) /* noexcept @todo See static_assert below. */ = default;
+	/// @note Data members not private, this is more of a struct than a class.
+	size_t m_line_number { 0 };
 
-	/// Also use the default destructor.
-	~Match() noexcept = default;
+	/// Offset of the start of the matched line in the line arena.
+	size_t m_line_offset { 0 };
 
+	/// Offset of the start of what was kept of the line in the file.
+	size_t m_line_file_offset { 0 };
 
-	/// @note Data members not private, this is more of a struct than a class.
-	size_t m_line_number { 0 };
-	std::string m_pre_match;
-	std::string m_match;
-	std::string m_post_match;
-};
+	/// Length of the matched line, not including the '\n'.  If the line was truncated, the length of what was kept.
+	size_t m_line_length { 0 };
 
-#ifndef __COVERITY__ // Coverity can't handle these static_asserts.
+	/// Offsets of the start and one past the end of the match, relative to the start of what was kept of the line.
+	size_t m_match_start { 0 };
+	size_t m_match_end { 0 };
 
-// Require Match to be nothrow move constructible so that a vector of them can use move on reallocation.
-static_assert(std::is_nothrow_move_constructible<Match>::value == true, "Match must be nothrow move constructible");
+	/// Offset of the start of the match from the start of the full line, i.e. its 0-based column.  In bytes, unless
+	/// the MatchList was told to count columns in UTF-8 code points.
+	size_t m_match_column { 0 };
 
-// Require Match to be nothrow move assignable for similar reasons.
-// @note I can't get Match to be nothrow move assignable because std::string isn't in gcc up to at least 5.1, per this bug: https://gcc.gnu.org/bugzilla/show_bug.cgi?id=58265#c7.
-// This issue, combined with std::vector<>::push_back()'s specification, is what motivates the deletion of the copy ctor/assignment
-// operator in this class in the first place.
-// Per http://stackoverflow.com/a/18858875, the only way to get the "void push_back( T&& value );" overload of push_back() is to
-// either have a noexcept move ctor, or a non-noexcept move ctor and no copy ctor (actually, class can't be CopyInsertable).
-//static_assert(std::is_nothrow_move_assignable<Match>::value == true, "Match must be nothrow move assignable");
+	/// Index of the first of this line's Spans in the MatchList's span arena, and how many there are.  Context lines
+	/// have none.
+	size_t m_first_span { 0 };
+	size_t m_num_spans { 0 };
 
-// Require Match to not be copy constructible, so that uses don't end up accidentally copying it instead of moving.
-static_assert(std::is_copy_constructible<Match>::value == false, "Match must not be copy constructible");
+	/// True if this is a line of context around a match, not a matched line.
+	bool m_is_context_line { false };
 
-// Require Match to not be copy assignable, so that uses don't end up accidentally copying it instead of moving.
-static_assert(std::is_copy_assignable<Match>::value == false, "Match must not be copy assignable");
+	/// True if this line doesn't directly follow the one before it in the MatchList, so that a group separator has
+	/// to be printed before it.
+	bool m_starts_new_group { false };
+};
 
-#endif // __COVERITY__
+// Require Match to be trivially copyable, so that a std::vector of them can be grown with memcpy() and cleared for free.
+static_assert(std::is_trivially_copyable<Match>::value == true, "Match must be trivially copyable");
 
 #endif /* MATCH_H_ */
@@ -21,9 +21,45 @@
 
 #include "MatchList.h"
 
-#include <iostream>
-#include <sstream>
+#include <string_view>
+#include <algorithm>
+#include <limits>
+#include <charconv>
 #include "future/string.hpp"
+#include <libext/bytesearch.hpp>
+#include <libext/serialize.hpp>
+
+/// Largest line arena clear() will keep the storage of for reuse.
+static constexpr size_t f_max_retained_arena_size = 1024*1024;
+
+/// Printed between non-adjacent groups of context and matched lines.
+static constexpr char f_group_separator[] = "--\n";
+
+/// Room for the decimal representation of any size_t.
+static constexpr size_t f_max_decimal_digits = 20;
+static_assert(f_max_decimal_digits >= std::numeric_limits<size_t>::digits10 + 1, "f_max_decimal_digits is too small");
+
+/**
+ * Append @p line, plus its '\n', to @p out as JSON data.  ripgrep includes the line terminator in its "lines".
+ */
+static void append_json_line(std::string &out, std::string_view line)
+{
+	if(is_valid_utf8(line))
+	{
+		out += "{\"text\":";
+		append_json_string(out, line);
+		// Put the "\n" inside the closing quote.
+		out.back() = '\\';
+		out += "n\"}";
+	}
+	else
+	{
+		// Rare enough not to bother avoiding the copy.
+		std::string line_with_eol(line);
+		line_with_eol += '\n';
+		append_json_data(out, line_with_eol);
+	}
+}
 
 
 void MatchList::SetFilename(std::string filename)
@@ -31,22 +67,188 @@ void MatchList::SetFilename(std::string filename)
 	m_filename = std::move(filename);
 }
 
-void MatchList::AddMatch(Match &&match)
+void MatchList::AddMatch(const char *start_of_array, size_t array_size, size_t match_start_offset, size_t match_end_offset, size_t line_number,
+		size_t max_line_length)
+{
+	if(m_only_matching && match_start_offset == match_end_offset)
+	{
+		// As with grep, there's nothing to print for an empty match.
+		return;
+	}
+
+	++m_num_matches;
+
+	const bool is_new_line = m_match_list.empty() || m_match_list.back().m_is_context_line
+			|| m_match_list.back().m_line_number != line_number;
+	if(!is_new_line && !m_only_matching)
+	{
+		// Another match on the line we just added.  There's no need to find the line or copy it again.
+		AddSpan(match_start_offset, match_end_offset);
+		return;
+	}
+
+	bool with_context = (m_context_before != 0 || m_context_after != 0) && !m_only_matching && (line_number > m_last_line_number);
+
+	if(with_context)
+	{
+		AddAfterContext(start_of_array, array_size, line_number, max_line_length);
+		AddBeforeContext(start_of_array, match_start_offset, line_number, max_line_length);
+	}
+
+	m_match_list.emplace_back(start_of_array, array_size, match_start_offset, match_end_offset, line_number, m_line_arena,
+			max_line_length, m_only_matching);
+	Match &m = m_match_list.back();
+	m.m_first_span = m_spans.size();
+	m.m_num_spans = 1;
+	m_spans.push_back({m.m_match_start, m.m_match_end});
+	if(is_new_line)
+	{
+		++m_num_matched_lines;
+	}
+
+	if(m_codepoint_columns)
+	{
+		// The Match has already found the start of the line, so only the part of the line before the match is counted.
+		const char *match_start = start_of_array + match_start_offset;
+		m.m_match_column = count_utf8_codepoints(match_start - m.m_match_column, match_start);
+	}
+
+	if(with_context)
+	{
+		// Find the end of the matched line.  Unless it was truncated, the Match already did.
+		size_t line_end_offset = match_start_offset - m.m_match_start + m.m_line_length;
+		if(line_end_offset < array_size && start_of_array[line_end_offset] != '\n')
+		{
+			line_end_offset = find_byte_forward(start_of_array + line_end_offset, start_of_array + array_size, '\n') - start_of_array;
+		}
+		LineAdded(line_number, line_end_offset);
+		m_after_context_remaining = m_context_after;
+	}
+}
+
+void MatchList::AddSpan(size_t match_start_offset, size_t match_end_offset)
+{
+	Match &m = m_match_list.back();
+
+	// The matches come in order, so this one can't start before what was kept of the line.
+	size_t start = match_start_offset - m.m_line_file_offset;
+	size_t end = std::min(match_end_offset - m.m_line_file_offset, m.m_line_length);
+	if(start >= end)
+	{
+		// Empty, or past the end of a truncated line.  There's nothing to highlight.
+		return;
+	}
+
+	m_spans.push_back({start, end});
+	++m.m_num_spans;
+}
+
+void MatchList::AddTrailingContext(const char *start_of_array, size_t array_size, size_t max_line_length)
+{
+	if(m_num_matched_lines != 0)
+	{
+		AddAfterContext(start_of_array, array_size, std::numeric_limits<size_t>::max(), max_line_length);
+	}
+}
+
+void MatchList::AddAfterContext(const char *start_of_array, size_t array_size, size_t line_number, size_t max_line_length)
+{
+	const char *array_end = start_of_array + array_size;
+
+	// Each line of after-context starts just past the end of the line before it, stopping at the end of the file.
+	while(m_after_context_remaining > 0 && m_last_line_number+1 < line_number && m_last_line_end_offset+1 < array_size)
+	{
+		const char *line_start = start_of_array + m_last_line_end_offset + 1;
+		const char *line_end = find_byte_forward(line_start, array_end, '\n');
+		m_match_list.push_back(Match::ContextLine(start_of_array, line_start, line_end, m_last_line_number+1, m_line_arena, max_line_length));
+		LineAdded(m_last_line_number+1, line_end - start_of_array);
+		--m_after_context_remaining;
+	}
+}
+
+void MatchList::AddBeforeContext(const char *start_of_array, size_t match_start_offset, size_t line_number, size_t max_line_length)
+{
+	// Don't go back over lines we've already added.
+	size_t num_lines = std::min(m_context_before, line_number - 1 - m_last_line_number);
+	if(num_lines == 0)
+	{
+		return;
+	}
+
+	// Walk back to the start of the first line of the context, i.e. past num_lines+1 '\n's, the first of which ends
+	// the line before the matched one.  If we run out, the context starts with the first line of the file.
+	const char *line_start = start_of_array;
+	const char *search_end = start_of_array + match_start_offset;
+	for(size_t i = 0; i <= num_lines; ++i)
+	{
+		const char *prev_eol = find_byte_backward(start_of_array, search_end, '\n');
+		if(prev_eol == nullptr)
+		{
+			line_start = start_of_array;
+			break;
+		}
+		line_start = prev_eol + 1;
+		search_end = prev_eol;
+	}
+
+	// Then add them going forward.
+	for(size_t line_no = line_number - num_lines; line_no < line_number; ++line_no)
+	{
+		const char *line_end = find_byte_forward(line_start, start_of_array + match_start_offset, '\n');
+		m_match_list.push_back(Match::ContextLine(start_of_array, line_start, line_end, line_no, m_line_arena, max_line_length));
+		LineAdded(line_no, line_end - start_of_array);
+		line_start = line_end + 1;
+	}
+}
+
+void MatchList::LineAdded(size_t line_number, size_t line_end_offset) noexcept
+{
+	m_match_list.back().m_starts_new_group = (m_last_line_number != 0) && (line_number > m_last_line_number+1);
+	m_last_line_number = line_number;
+	m_last_line_end_offset = line_end_offset;
+}
+
+MatchList MatchList::TakeFormattedOutput()
 {
-	m_match_list.push_back(std::move(match));
+	MatchList retval;
+
+	retval.m_formatted = std::move(m_formatted);
+	retval.m_num_matched_lines = m_num_matched_lines;
+	retval.m_num_matches = m_num_matches;
+	retval.m_sequence_number = m_sequence_number;
+
+	clear();
+
+	return retval;
 }
 
 void MatchList::clear() noexcept
 {
 	m_filename.clear();
 	m_match_list.clear();
+	m_spans.clear();
+	m_formatted.clear();
+	m_num_matched_lines = 0;
+	m_num_matches = 0;
+	m_sequence_number = 0;
+	m_last_line_number = 0;
+	m_last_line_end_offset = 0;
+	m_after_context_remaining = 0;
+
+	if(m_line_arena.capacity() > f_max_retained_arena_size)
+	{
+		// Don't hang on to the memory for one huge file forever.
+		std::string().swap(m_line_arena);
+	}
+	else
+	{
+		m_line_arena.clear();
+	}
 }
 
-void MatchList::Print(std::ostream &sstrm, OutputContext &output_context) const
+void MatchList::Format(const OutputContext &output_context)
 {
 	std::string_view no_dotslash_fn;
-	static constexpr std::string empty_color_string {""};
-	bool color = output_context.is_color_enabled();
 
 	// If the file path starts with a "./", chop it off.
 	// This is to match the behavior of ack.
@@ -59,76 +261,178 @@ void MatchList::Print(std::ostream &sstrm, OutputContext &output_context) const
 		no_dotslash_fn = std::string_view(m_filename.begin(), m_filename.end());
 	}
 
-	const std::string *color_filename { &empty_color_string };
-	const std::string *color_match { &empty_color_string };
-	const std::string *color_lineno { &empty_color_string };
-	const std::string *color_default { &empty_color_string };
-
-	if(color)
-	{
-		color_filename = &output_context.m_color_filename;
-		color_match = &output_context.m_color_match;
-		color_lineno = &output_context.m_color_lineno;
-		color_default = &output_context.m_color_default;
-	}
-
-	std::string composition_buffer;
-	composition_buffer.reserve(256);
-        
-        const char file_separator(output_context.use_nullsep()
-                                  ? '\0': (output_context.prefix_file() ? ':' : '\n'));
-
-        if(!output_context.prefix_file())
-          {
-            // Print file header.
-            if(color) composition_buffer += *color_filename;
-            composition_buffer += no_dotslash_fn;
-            if(color) composition_buffer += *color_default;
-            composition_buffer += file_separator;
-            sstrm << composition_buffer;
-          }
-        
-        // Print the individual matches.
-        for(const Match& it : m_match_list)
-          {
-            // Print file prefix.
-            if(output_context.prefix_file())
-              {
-                composition_buffer.clear();
-                if(color) composition_buffer += *color_filename;
-                composition_buffer += no_dotslash_fn;
-                if(color) composition_buffer += *color_default;
-                composition_buffer += file_separator;
-                sstrm << composition_buffer;
-              }
-            // Print line and column numbers.
-            if(output_context.is_line_print_enabled())
-              {
-                composition_buffer.clear();
-                if(color) composition_buffer += *color_lineno;
-                composition_buffer += std::to_string(it.m_line_number);
-                if(color) composition_buffer += *color_default;
-                composition_buffer += ':';
-                sstrm << composition_buffer;
-                if(output_context.is_column_print_enabled())
-                  {
-                    sstrm << it.m_pre_match.length()+1 << ':';
-                  }
-              }
-            // Print match
-            composition_buffer.clear();
-            composition_buffer += it.m_pre_match;
-            if(color) composition_buffer += *color_match;
-            composition_buffer += it.m_match;
-            if(color) composition_buffer += *color_default;
-            composition_buffer += it.m_post_match;
-            composition_buffer += '\n';
-            sstrm << composition_buffer;
-          }
+	switch(output_context.output_format())
+	{
+	case OutputFormat::JSON:
+		FormatJson(no_dotslash_fn);
+		break;
+	case OutputFormat::BINARY:
+		FormatBinary(no_dotslash_fn);
+		break;
+	default:
+		FormatText(no_dotslash_fn, output_context);
+		break;
+	}
+}
+
+void MatchList::FormatText(std::string_view filename, const OutputContext &output_context)
+{
+	const OutputContext::LineTemplate &tmpl = output_context.line_template();
+	const bool print_line_number = output_context.is_line_print_enabled();
+	const bool print_column = print_line_number && output_context.is_column_print_enabled();
+
+	// Compose the start of each line, everything before the line number, once for the whole file.  Index 1 is for
+	// context lines.
+	std::string line_start[2];
+	std::string_view lineno_end[2];
+	for(int is_context = 0; is_context < 2; ++is_context)
+	{
+		if(output_context.prefix_file())
+		{
+			line_start[is_context] += tmpl.m_filename_start;
+			line_start[is_context] += filename;
+			line_start[is_context] += tmpl.m_filename_end[is_context];
+		}
+		if(print_line_number)
+		{
+			line_start[is_context] += tmpl.m_lineno_start;
+			lineno_end[is_context] = tmpl.m_lineno_end[is_context];
+		}
+	}
+
+	// Reserve as much as we could possibly need up front, so that every append below is just a copy.
+	size_t max_line_overhead = std::max(line_start[0].size() + lineno_end[0].size(), line_start[1].size() + lineno_end[1].size())
+			+ 2*f_max_decimal_digits + 1 /* ':' */ + 1 /* '\n' */ + sizeof(f_group_separator)-1;
+	m_formatted.clear();
+	m_formatted.reserve(tmpl.m_filename_start.size() + filename.size() + tmpl.m_header_end.size()
+			+ m_match_list.size() * max_line_overhead
+			+ m_spans.size() * (tmpl.m_match_start[0].size() + tmpl.m_match_end[0].size())
+			+ m_line_arena.size());
+
+	if(!output_context.prefix_file())
+	{
+		// File header.
+		m_formatted += tmpl.m_filename_start;
+		m_formatted += filename;
+		m_formatted += tmpl.m_header_end;
+	}
+
+	// The individual matches, and any context lines.
+	char number[f_max_decimal_digits];
+	for(const Match& it : m_match_list)
+	{
+		const int is_context = it.m_is_context_line;
+
+		if(it.m_starts_new_group)
+		{
+			m_formatted.append(f_group_separator, sizeof(f_group_separator)-1);
+		}
+
+		m_formatted += line_start[is_context];
+		if(print_line_number)
+		{
+			m_formatted.append(number, std::to_chars(number, number + sizeof(number), it.m_line_number).ptr - number);
+			m_formatted += lineno_end[is_context];
+			if(print_column && !is_context)
+			{
+				m_formatted.append(number, std::to_chars(number, number + sizeof(number), it.m_match_column+1).ptr - number);
+				m_formatted += ':';
+			}
+		}
+
+		// The line, with each of its matches highlighted.  A context line has none.
+		std::string_view line(m_line_arena.data() + it.m_line_offset, it.m_line_length);
+		size_t pos = 0;
+		for(const Match::Span &span : GetSpans(it))
+		{
+			m_formatted += line.substr(pos, span.m_start - pos);
+			m_formatted += tmpl.m_match_start[0];
+			m_formatted += line.substr(span.m_start, span.m_end - span.m_start);
+			m_formatted += tmpl.m_match_end[0];
+			pos = span.m_end;
+		}
+		m_formatted += line.substr(pos);
+		m_formatted += '\n';
+	}
+}
+
+void MatchList::FormatJson(std::string_view filename)
+{
+	m_formatted.clear();
+
+	// The path object is the same in every message.
+	std::string path;
+	append_json_data(path, filename);
+
+	m_formatted += "{\"type\":\"begin\",\"data\":{\"path\":";
+	m_formatted += path;
+	m_formatted += "}}\n";
+
+	for(const Match& it : m_match_list)
+	{
+		m_formatted += it.m_is_context_line ? "{\"type\":\"context\",\"data\":{\"path\":" : "{\"type\":\"match\",\"data\":{\"path\":";
+		m_formatted += path;
+		m_formatted += ",\"lines\":";
+		append_json_line(m_formatted, std::string_view(m_line_arena.data() + it.m_line_offset, it.m_line_length));
+		m_formatted += ",\"line_number\":";
+		append_decimal(m_formatted, it.m_line_number);
+		m_formatted += ",\"absolute_offset\":";
+		append_decimal(m_formatted, it.m_line_file_offset);
+		m_formatted += ",\"submatches\":[";
+		bool first = true;
+		for(const Match::Span &span : GetSpans(it))
+		{
+			m_formatted += first ? "{\"match\":" : ",{\"match\":";
+			first = false;
+			append_json_data(m_formatted, std::string_view(m_line_arena.data() + it.m_line_offset + span.m_start, span.m_end - span.m_start));
+			m_formatted += ",\"start\":";
+			append_decimal(m_formatted, span.m_start);
+			m_formatted += ",\"end\":";
+			append_decimal(m_formatted, span.m_end);
+			m_formatted += '}';
+		}
+		m_formatted += "]}}\n";
+	}
+
+	m_formatted += "{\"type\":\"end\",\"data\":{\"path\":";
+	m_formatted += path;
+	m_formatted += ",\"binary_offset\":null,\"stats\":{\"matched_lines\":";
+	append_decimal(m_formatted, m_num_matched_lines);
+	m_formatted += ",\"matches\":";
+	append_decimal(m_formatted, m_num_matches);
+	m_formatted += "}}}\n";
+}
+
+void MatchList::FormatBinary(std::string_view filename)
+{
+	m_formatted.clear();
+
+	m_formatted += 'B';
+	append_le<uint32_t>(m_formatted, filename.size());
+	m_formatted += filename;
+
+	for(const Match& it : m_match_list)
+	{
+		m_formatted += it.m_is_context_line ? 'C' : 'M';
+		append_le<uint32_t>(m_formatted, 8 + 8 + 4 + 8*it.m_num_spans + it.m_line_length);
+		append_le<uint64_t>(m_formatted, it.m_line_number);
+		append_le<uint64_t>(m_formatted, it.m_line_file_offset);
+		append_le<uint32_t>(m_formatted, it.m_num_spans);
+		for(const Match::Span &span : GetSpans(it))
+		{
+			append_le<uint32_t>(m_formatted, span.m_start);
+			append_le<uint32_t>(m_formatted, span.m_end);
+		}
+		m_formatted.append(m_line_arena.data() + it.m_line_offset, it.m_line_length);
+	}
+
+	m_formatted += 'E';
+	append_le<uint32_t>(m_formatted, 8);
+	append_le<uint64_t>(m_formatted, m_num_matched_lines);
 }
 
 std::vector<Match>::size_type MatchList::GetNumberOfMatchedLines() const noexcept
 {
-	// One Match in the MatchList equals one matched line.
-	return m_match_list.size();
+	// Counted as they're added, since in only-matching mode a line can have more than one Match.
+	return m_num_matched_lines;
 }
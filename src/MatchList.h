@@ -22,9 +22,10 @@
 
 #include <config.h>
 
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <iosfwd>
 
 #include "Match.h"
 #include "OutputContext.h"
@@ -34,13 +35,18 @@
  * For performance reasons, this class is only move constructible and assignable, not copy constructible or assignable.
  * We'll be passing many instances of this class "by value" through the sync_queue<>s, and we want to make sure that it's
  * using the move constructors and assignment operators to do so.
+ *
+ * The text of the matched lines is kept in a single byte arena (see Match).  A FileScanner thread reuses one MatchList
+ * for every file it scans, and clear() keeps the arena's and the Match vector's storage, so in the steady state adding
+ * a Match doesn't allocate.  Once the matches are formatted, only the formatted output is sent on; see
+ * TakeFormattedOutput().
  */
 class MatchList
 {
 public:
 	MatchList() = default;
 
-	/// Delete the copy constructor and the move assignment operator.  With the std::vector<Match> in here, this is an expensive
+	/// Delete the copy constructor and the move assignment operator.  With the arena in here, this is an expensive
 	/// class to copy, so we only allow move-constructing.
 	MatchList(const MatchList &lvalue) = delete;
 	MatchList& operator=(const MatchList &other) = delete;
@@ -56,21 +62,83 @@ public:
 	/// Passing #filename by value because we're storing it.
 	void SetFilename(std::string filename);
 
-	/// Add a match to this MatchList.  Note that this is done by moving, not copying, the given %match.
-	void AddMatch(Match &&match);
+	/**
+	 * Add the match [@p match_start_offset, @p match_end_offset) in the @p array_size bytes at @p start_of_array,
+	 * which is on line @p line_number, to this MatchList.  The line, truncated to @p max_line_length bytes if
+	 * that's non-zero, is copied into the arena.
+	 *
+	 * Matches have to be added in the order they're found.  A match on the same line as the one before it is only
+	 * added as another Span of that line, except in only-matching mode, where each match gets its own Match.
+	 */
+	void AddMatch(const char *start_of_array, size_t array_size, size_t match_start_offset, size_t match_end_offset, size_t line_number,
+			size_t max_line_length = 0);
+
+	/**
+	 * Also keep up to @p before lines of context before each match, and up to @p after lines after it.  Context
+	 * windows which overlap or touch are merged, and a "--" separator is printed between those which don't.  Unlike
+	 * the other state, this setting survives clear().
+	 *
+	 * With context enabled, AddMatch() picks up the context lines from the file data it's given, walking out from the
+	 * match only as far as the context extends and never back over lines it has already added, so no part of the
+	 * file is searched for line boundaries more than once.  The after-context of a match isn't added until the next
+	 * match, or the call to AddTrailingContext() once the file has been scanned, since only then is it known where
+	 * that context ends.
+	 */
+	void SetContextLines(size_t before, size_t after) noexcept { m_context_before = before; m_context_after = after; };
+
+	/**
+	 * Keep only the text of each match, instead of its whole line.  Like the context setting, this survives clear().
+	 * Context lines aren't supported in this mode.
+	 */
+	void SetOnlyMatching(bool only_matching) noexcept { m_only_matching = only_matching; };
+
+	/// Count match columns in UTF-8 code points instead of bytes.  Like the context setting, this survives clear().
+	void SetCodepointColumns(bool codepoint_columns) noexcept { m_codepoint_columns = codepoint_columns; };
 
-	void Print(std::ostream &sstrm, OutputContext &output_context) const;
+	/**
+	 * Add whatever after-context the last match still has.  Call once the whole of the @p array_size bytes at
+	 * @p start_of_array, which have to be the same ones which were passed to AddMatch(), have been scanned.
+	 */
+	void AddTrailingContext(const char *start_of_array, size_t array_size, size_t max_line_length = 0);
+
+	/**
+	 * Render this MatchList into the bytes to be written to the output, as directed by @p output_context.  The result
+	 * is available from GetFormattedOutput().  This is done by the FileScanner threads, so that the single OutputTask
+	 * thread only has to write the bytes out.
+	 *
+	 * @param output_context
+	 */
+	void Format(const OutputContext &output_context);
+
+	/// The output rendered by the last call to Format().  Empty if Format() hasn't been called.
+	[[nodiscard]] const std::string& GetFormattedOutput() const noexcept { return m_formatted; };
+
+	/**
+	 * Move the formatted output, match counts, and sequence number into a new MatchList, which is returned, and clear()
+	 * this one.  The returned MatchList has no Matches of its own; this one keeps its arena and Match storage for reuse.
+	 */
+	[[nodiscard]] MatchList TakeFormattedOutput();
 
 	/// Returns a bool indicating whether the MatchList is empty.
 	/// @note You might expect that this needs to indicate 'empty' after a move-from has occurred.
 	/// That's not the case.  A moved-from object only has to be destructible, and the move and copy operations
 	/// have to still work the same as they did before the move operation.
-	[[nodiscard]] bool empty() const noexcept { return m_match_list.empty(); };
+	[[nodiscard]] bool empty() const noexcept { return m_num_matched_lines == 0; };
 
 	void clear() noexcept;
 
+	/// @name Sequence number.
+	/// For ordered output, the sequence number of the file this MatchList is for.  See FileID::GetSequenceNumber().
+	///@{
+	void SetSequenceNumber(size_t seq) noexcept { m_sequence_number = seq; };
+	[[nodiscard]] size_t GetSequenceNumber() const noexcept { return m_sequence_number; };
+	///@}
+
 	[[nodiscard]] std::vector<Match>::size_type GetNumberOfMatchedLines() const noexcept;
 
+	/// The number of matches, which can be more than the number of matched lines.
+	[[nodiscard]] size_t GetNumberOfMatches() const noexcept { return m_num_matches; };
+
 private:
 
 	/// The filename where the Matches in this MatchList were found.
@@ -78,6 +146,97 @@ private:
 
 	/// The Matches found in this file.
 	std::vector<Match> m_match_list;
+
+	/// The text of the lines the Matches are on.
+	std::string m_line_arena;
+
+	/// The Spans of all the matches in the lines, in order.  See Match::m_first_span.
+	std::vector<Match::Span> m_spans;
+
+	/// Number of matched lines added.  Tracked separately from m_match_list so that it survives TakeFormattedOutput().
+	std::vector<Match>::size_type m_num_matched_lines {0};
+
+	/// Number of matches added, including those which didn't start a new line.
+	size_t m_num_matches {0};
+
+	/// The formatted output.
+	std::string m_formatted;
+
+	/// The sequence number of the file.
+	size_t m_sequence_number {0};
+
+	/**
+	 * Add the after-context of the last line added, if it has any left, up to but not including line @p line_number.
+	 */
+	void AddAfterContext(const char *start_of_array, size_t array_size, size_t line_number, size_t max_line_length);
+
+	/**
+	 * Add the before-context of the match at @p match_start_offset, which is on line @p line_number.
+	 */
+	void AddBeforeContext(const char *start_of_array, size_t match_start_offset, size_t line_number, size_t max_line_length);
+
+	/// @name The output formats.  These each render into m_formatted.
+	/// @param filename  The filename to print.
+	///@{
+
+	/// The ack/ag-style human-readable format.
+	void FormatText(std::string_view filename, const OutputContext &output_context);
+
+	/**
+	 * JSON Lines, compatible with ripgrep's --json: a "begin" message, a "match" or "context" message per line, and an
+	 * "end" message with the file's stats.  The "summary" message is written by the OutputTask.
+	 */
+	void FormatJson(std::string_view filename);
+
+	/**
+	 * The binary format.  This is a sequence of records, each consisting of a one-byte type, a 32-bit length of the
+	 * payload which follows, and the payload.  All integers are unsigned and little-endian.  The record types are:
+	 * - 'B', begin: the filename.
+	 * - 'M', match, and 'C', context: the 64-bit line number, the 64-bit byte offset of the line in the file, the 32-bit
+	 *   number of submatches, that many pairs of 32-bit offsets of the start and end of the submatch in the line, and
+	 *   the line itself, without the '\n'.
+	 * - 'E', end: the 64-bit number of matched lines in the file.
+	 * - 'S', summary, written by the OutputTask once everything else has been: the 64-bit total number of matched lines
+	 *   and the 64-bit number of files with matches.
+	 */
+	void FormatBinary(std::string_view filename);
+	///@}
+
+	/**
+	 * Add the match [@p match_start_offset, @p match_end_offset) as another Span of the last line added.  Any part of
+	 * it which is past the end of what was kept of that line is dropped.
+	 */
+	void AddSpan(size_t match_start_offset, size_t match_end_offset);
+
+	/// The Spans of the matches in @p m.
+	[[nodiscard]] std::span<const Match::Span> GetSpans(const Match &m) const noexcept
+	{
+		return std::span<const Match::Span>(m_spans.data() + m.m_first_span, m.m_num_spans);
+	};
+
+	/// Record that line @p line_number, which ends at @p line_end_offset, was just added.
+	void LineAdded(size_t line_number, size_t line_end_offset) noexcept;
+
+	/// @name Settings which survive clear().
+	///@{
+	size_t m_context_before {0};
+	size_t m_context_after {0};
+	bool m_only_matching {false};
+	bool m_codepoint_columns {false};
+	///@}
+
+	/// @name Context state for the file being scanned.
+	///@{
+
+	/// Line number of the last line added, or 0 if none has been.
+	size_t m_last_line_number {0};
+
+	/// Offset in the file of the end of the last line added, i.e. of its '\n' (or of the end of the file).
+	size_t m_last_line_end_offset {0};
+
+	/// How many more lines of after-context the last match gets.
+	size_t m_after_context_remaining {0};
+	///@}
 };
 
 // Require MatchList to be nothrow move constructible so that a container of them can use move on reallocation.
@@ -22,10 +22,10 @@
 #include "OutputContext.h"
 
 OutputContext::OutputContext(bool enable_color, bool prefix_file, bool print_line_number,
-                             bool print_column, bool nullsep)
+                             bool print_column, bool nullsep, OutputFormat format)
   : m_enable_color(enable_color), m_prefix_file(prefix_file),
     m_print_line_number(print_line_number),
-    m_print_column(print_column), m_nullsep(nullsep)
+    m_print_column(print_column), m_nullsep(nullsep), m_output_format(format)
 {
 	if(m_enable_color)
 	{
@@ -35,6 +35,21 @@ OutputContext::OutputContext(bool enable_color, bool prefix_file, bool print_lin
 		m_color_lineno = m_default_color_lineno;
 		m_color_default = m_default_color_default;
 	}
+
+	// Precompose the fixed parts of the output lines.
+	m_line_template.m_filename_start = m_color_filename;
+	m_line_template.m_header_end = m_color_default + (m_nullsep ? '\0' : '\n');
+	for(int is_context = 0; is_context < 2; ++is_context)
+	{
+		// Like grep, separate the parts of a context line with '-' instead of ':'.
+		const char separator = is_context ? '-' : ':';
+
+		m_line_template.m_filename_end[is_context] = m_color_default + (m_nullsep ? '\0' : separator);
+		m_line_template.m_lineno_end[is_context] = m_color_default + separator;
+		m_line_template.m_match_start[is_context] = is_context ? "" : m_color_match;
+		m_line_template.m_match_end[is_context] = is_context ? "" : m_color_default;
+	}
+	m_line_template.m_lineno_start = m_color_lineno;
 }
 
 OutputContext::~OutputContext()
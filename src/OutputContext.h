@@ -24,13 +24,22 @@
 
 #include <string>
 
+/// The formats ucg can print its results in.
+enum class OutputFormat
+{
+	TEXT,	//!< The ack/ag-style human-readable format.
+	JSON,	//!< JSON Lines, one message per line, in the same form as ripgrep's --json.
+	BINARY	//!< Length-prefixed binary records, for IPC.  See MatchList::FormatBinary().
+};
+
 /**
  * A class for encapsulating the output "context", e.g. what colors to use, whether to print the column number, etc.
  */
 class OutputContext
 {
 public:
-      OutputContext(bool enable_color, bool prefix_file, bool print_line_number, bool print_column, bool nullsep);
+      OutputContext(bool enable_color, bool prefix_file, bool print_line_number, bool print_column, bool nullsep,
+                    OutputFormat format = OutputFormat::TEXT);
 	~OutputContext();
 
 	[[nodiscard]] inline bool is_color_enabled() const noexcept { return m_enable_color; };
@@ -38,6 +47,7 @@ public:
 	[[nodiscard]] inline bool is_line_print_enabled() const noexcept { return m_print_line_number; };
 	[[nodiscard]] inline bool is_column_print_enabled() const noexcept { return m_print_column; };
 	[[nodiscard]] inline bool use_nullsep() const noexcept { return m_nullsep; };
+	[[nodiscard]] inline OutputFormat output_format() const noexcept { return m_output_format; };
 
 	/// @name Active colors.
 	/// @{
@@ -47,6 +57,34 @@ public:
 	std::string m_color_default;
 	/// @}
 
+	/**
+	 * The fixed parts of a line of text output, i.e. the separators and the color sequences around each field,
+	 * precomposed once from the settings above.  With these, formatting a line is the same sequence of copies whatever
+	 * the settings are; e.g. with color off, the color parts are just empty.  The arrays are indexed by whether the
+	 * line is a context line.
+	 */
+	struct LineTemplate
+	{
+		/// Goes before the filename, both in the file header and in a file prefix.
+		std::string m_filename_start;
+
+		/// Goes after the filename in the file header.
+		std::string m_header_end;
+
+		/// Goes after the filename in a file prefix.
+		std::string m_filename_end[2];
+
+		/// Goes before and after the line number.
+		std::string m_lineno_start;
+		std::string m_lineno_end[2];
+
+		/// Go before and after the match.  Empty for context lines, which don't have one.
+		std::string m_match_start[2];
+		std::string m_match_end[2];
+	};
+
+	[[nodiscard]] const LineTemplate& line_template() const noexcept { return m_line_template; };
+
 private:
 
 	/// Whether to output color or not.  Determined by logic in OutputTask's constructor.
@@ -64,6 +102,11 @@ private:
 	/// Whether to write a null after a filename instead of ':'.
 	bool m_nullsep;
 
+	/// The format to print the results in.
+	OutputFormat m_output_format;
+
+	LineTemplate m_line_template;
+
 	/// @name Default output colors.
 	/// @{
 	// ANSI SGR parameter setting sequences for setting the color and boldness of the output text.
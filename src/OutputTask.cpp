@@ -23,22 +23,109 @@
 
 // Std C++.
 #include <cstdio>
-#include <iostream>
+#include <cerrno>
+#include <vector>
+#include <optional>
+#include <algorithm>
 
 #include <unistd.h>
+#include <sys/stat.h>
+#include <climits> // For IOV_MAX.
 
 // Ours.
 #include <libext/Logger.h>
+#include <libext/serialize.hpp>
+
+/// Maximum number of MatchLists we'll pull off the input queue at once.
+static constexpr size_t f_max_write_batch = 256;
+
+/// When stdout isn't a terminal, how many bytes of output we'll buffer before writing them out.
+static constexpr size_t f_output_buffer_size = 256*1024;
+
+/// The longest we'll hold buffered output while waiting for more.
+static constexpr std::chrono::milliseconds f_max_flush_delay {100};
+
+/// Separator written between the groups of matches of different files when they're not prefixed with the filename.
+static constexpr char f_blank_line[] = "\n";
+
+/// Separates the results of different files when there's context but no file headers, as grep does.
+static constexpr char f_group_separator[] = "--\n";
+
+#ifndef IOV_MAX
+#define IOV_MAX 16 // POSIX's minimum.
+#endif
+
+/**
+ * writev() all of @p iovecs to @p fd, continuing after partial writes and signal interruptions.
+ * Modifies @p iovecs.
+ *
+ * @return  true on success, false on error with errno set.
+ */
+static bool writev_all(int fd, std::vector<struct iovec> &iovecs) noexcept
+{
+	struct iovec *iov = iovecs.data();
+	size_t iovcnt = iovecs.size();
+
+	while(iovcnt > 0)
+	{
+		ssize_t written = writev(fd, iov, static_cast<int>(std::min<size_t>(iovcnt, IOV_MAX)));
+		if(written < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return false;
+		}
+
+		// Skip past what was written.
+		size_t remaining = static_cast<size_t>(written);
+		while(iovcnt > 0 && remaining >= iov->iov_len)
+		{
+			remaining -= iov->iov_len;
+			++iov;
+			--iovcnt;
+		}
+		if(iovcnt > 0)
+		{
+			// Partial write of this one.
+			iov->iov_base = static_cast<char*>(iov->iov_base) + remaining;
+			iov->iov_len -= remaining;
+		}
+	}
+
+	return true;
+}
 
 
 OutputTask::OutputTask(bool flag_color, bool flag_prefix_file, bool flag_line_number,
-                       bool flag_column, bool flag_nullsep, sync_queue<MatchList> &input_queue)
+                       bool flag_column, bool flag_nullsep, sync_queue<MatchList> &input_queue,
+                       OutputFormat output_format)
   : m_input_queue(input_queue), m_enable_color(flag_color),
     m_prefix_file(flag_prefix_file), m_print_line_number(flag_line_number), 
-    m_print_column(flag_column), m_nullsep(flag_nullsep)
+    m_print_column(flag_column), m_nullsep(flag_nullsep), m_output_format(output_format),
+    m_start_time(std::chrono::steady_clock::now())
 {
   m_output_context.reset(new OutputContext(m_enable_color, m_prefix_file, m_print_line_number,
-                                           m_print_column, m_nullsep));
+                                           m_print_column, m_nullsep, m_output_format));
+
+	// Work out how to buffer the output.  Someone watching a terminal wants to see results as soon as we have them,
+	// but a program reading a pipe or a file just wants them efficiently, i.e. in as few writes as possible.
+	if(isatty(STDOUT_FILENO))
+	{
+		LOG(INFO) << "stdout is a terminal, writing each batch of results immediately.";
+		m_flush_threshold = 0;
+	}
+	else
+	{
+		struct stat st;
+		if(fstat(STDOUT_FILENO, &st) == 0)
+		{
+			LOG(INFO) << "stdout is a " << (S_ISFIFO(st.st_mode) ? "pipe" : S_ISREG(st.st_mode) ? "regular file" : "non-terminal")
+					<< ", buffering up to " << f_output_buffer_size << " bytes.";
+		}
+		m_flush_threshold = f_output_buffer_size;
+	}
 }
 
 OutputTask::~OutputTask()
@@ -49,26 +136,239 @@ void OutputTask::Run()
 {
 	set_thread_name("OutputTask");
 
-	MatchList ml;
-	bool first_matchlist_printed = false;
-	std::stringstream sstrm;
+	if(m_reorder_window != nullptr)
+	{
+		RunOrdered();
+	}
+	else
+	{
+		// Take everything that's ready, up to a limit, and write it all out at once.
+		std::vector<MatchList> batch;
+		batch.reserve(f_max_write_batch);
 
-	while(m_input_queue.pull_front(std::move(ml)) != queue_op_status::closed)
+		while(PullBatch(batch) != queue_op_status::closed)
+		{
+			BufferMatchLists(batch);
+		}
+	}
+
+	Flush();
+
+	if(m_output_format != OutputFormat::TEXT)
+	{
+		WriteSummary();
+	}
+
+	if(m_run_stats != nullptr)
+	{
+		RunStats stats;
+		stats.m_files_with_matches = m_total_files_with_matches;
+		stats.m_matched_lines = m_total_matched_lines;
+		stats.m_matches = m_total_matches;
+		stats.m_write = m_write_time;
+		*m_run_stats += stats;
+	}
+}
+
+void OutputTask::RunOrdered()
+{
+	std::vector<MatchList> batch;
+	std::vector<MatchList> ready;
+
+	// The reorder buffer.  The MatchList with sequence number n goes in slot n % size.  The scanners won't send us
+	// anything beyond the window, so nothing can collide.
+	std::vector<std::optional<MatchList>> pending(m_reorder_window->size());
+
+	// The sequence number of the next MatchList to print.
+	size_t next = 0;
+
+	while(PullBatch(batch) != queue_op_status::closed)
 	{
-		if(first_matchlist_printed && !m_prefix_file)
+		for(auto &ml : batch)
 		{
-			// Print a blank line between the match lists (i.e. the groups of matches in one file).
-			std::cout << '\n';
+			pending[ml.GetSequenceNumber() % pending.size()] = std::move(ml);
+		}
+		batch.clear();
+
+		// Collect everything we now have in order.
+		size_t prev_next = next;
+		for(auto *slot = &pending[next % pending.size()]; slot->has_value(); slot = &pending[next % pending.size()])
+		{
+			// Files without matches are only here to keep the sequence going.
+			if(!(*slot)->empty())
+			{
+				ready.push_back(std::move(**slot));
+			}
+			slot->reset();
+			++next;
+		}
+
+		if(next != prev_next)
+		{
+			// Let the scanners move ahead before we block on the write.
+			m_reorder_window->Advance(next);
+		}
+
+		if(!ready.empty())
+		{
+			BufferMatchLists(ready);
+		}
+	}
+
+	/// @note Every file gets a MatchList, so if we get here, nothing is left in the buffer.
+}
+
+queue_op_status OutputTask::PullBatch(std::vector<MatchList> &batch)
+{
+	while(true)
+	{
+		if(m_unflushed.empty())
+		{
+			// Nothing's waiting to be written, so there's no hurry.
+			return m_input_queue.pull_front(batch, f_max_write_batch);
+		}
+
+		auto status = m_input_queue.pull_front_until(batch, f_max_write_batch, m_unflushed_since + f_max_flush_delay);
+		if(status != queue_op_status::timeout)
+		{
+			return status;
+		}
+
+		// Results are trickling in too slowly to fill the buffer.  Don't sit on the ones we have.
+		Flush();
+	}
+}
+
+void OutputTask::BufferMatchLists(std::vector<MatchList> &match_lists)
+{
+	if(m_unflushed.empty())
+	{
+		m_unflushed_since = std::chrono::steady_clock::now();
+	}
+
+	for(auto &ml : match_lists)
+	{
+		if(ml.GetFormattedOutput().empty())
+		{
+			// The scanner didn't format it for us.
+			ml.Format(*m_output_context);
 		}
-		ml.Print(sstrm, *m_output_context);
-		std::cout << sstrm.str();
-		std::cout.flush();
-		sstrm.str(std::string());
-		sstrm.clear();
-		first_matchlist_printed = true;
 
 		// Count up the total number of matches.
 		m_total_matched_lines += ml.GetNumberOfMatchedLines();
+		m_total_matches += ml.GetNumberOfMatches();
+		++m_total_files_with_matches;
+
+		m_unflushed_bytes += ml.GetFormattedOutput().size();
+		m_unflushed.push_back(std::move(ml));
+	}
+
+	match_lists.clear();
+
+	if(m_unflushed_bytes >= m_flush_threshold)
+	{
+		Flush();
+	}
+}
+
+void OutputTask::Flush()
+{
+	if(m_unflushed.empty())
+	{
+		return;
+	}
+
+	/// @note The iovecs are built here, and not as the MatchLists are buffered, since moving a MatchList into
+	/// m_unflushed can move a short formatted output string, which is stored in the std::string object itself.
+	m_iovecs.clear();
+	for(const auto &ml : m_unflushed)
+	{
+		if(m_output_format != OutputFormat::TEXT)
+		{
+			// The machine-readable formats delimit the files themselves.
+		}
+		else if(m_first_matchlist_printed && !m_prefix_file)
+		{
+			// Print a blank line between the match lists (i.e. the groups of matches in one file).
+			m_iovecs.push_back({ const_cast<char*>(f_blank_line), 1 });
+		}
+		else if(m_first_matchlist_printed && m_print_context)
+		{
+			m_iovecs.push_back({ const_cast<char*>(f_group_separator), sizeof(f_group_separator)-1 });
+		}
+		const std::string &output = ml.GetFormattedOutput();
+		m_iovecs.push_back({ const_cast<char*>(output.data()), output.size() });
+		m_first_matchlist_printed = true;
+	}
+
+	std::optional<StageTimer> write_timer;
+	if(m_run_stats != nullptr)
+	{
+		write_timer.emplace();
+	}
+
+	if(!m_write_failed && !writev_all(STDOUT_FILENO, m_iovecs))
+	{
+		// Most likely the reader went away.  Keep draining the queue so the scanners finish, but don't keep trying.
+		m_write_failed = true;
+		LOG(INFO) << "Write to stdout failed: " << LOG_STRERROR();
 	}
+
+	if(write_timer)
+	{
+		write_timer->Lap(m_write_time);
+	}
+
+	if(!m_time_to_first_output)
+	{
+		m_time_to_first_output = std::chrono::steady_clock::now() - m_start_time;
+	}
+
+	m_unflushed.clear();
+	m_unflushed_bytes = 0;
 }
 
+void OutputTask::WriteSummary()
+{
+	using namespace std::chrono;
+
+	auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - m_start_time);
+	auto elapsed_secs = duration_cast<seconds>(elapsed);
+	auto elapsed_nanos = elapsed - elapsed_secs;
+
+	std::string summary;
+	if(m_output_format == OutputFormat::JSON)
+	{
+		char human[32];
+		std::snprintf(human, sizeof(human), "%.6fs", duration<double>(elapsed).count());
+
+		summary += "{\"data\":{\"elapsed_total\":{\"secs\":";
+		append_decimal(summary, elapsed_secs.count());
+		summary += ",\"nanos\":";
+		append_decimal(summary, elapsed_nanos.count());
+		summary += ",\"human\":\"";
+		summary += human;
+		summary += "\"},\"stats\":{\"matched_lines\":";
+		append_decimal(summary, m_total_matched_lines);
+		summary += ",\"matches\":";
+		append_decimal(summary, m_total_matches);
+		summary += ",\"searches_with_match\":";
+		append_decimal(summary, m_total_files_with_matches);
+		summary += "}},\"type\":\"summary\"}\n";
+	}
+	else
+	{
+		summary += 'S';
+		append_le<uint32_t>(summary, 16);
+		append_le<uint64_t>(summary, m_total_matched_lines);
+		append_le<uint64_t>(summary, m_total_files_with_matches);
+	}
+
+	m_iovecs.clear();
+	m_iovecs.push_back({ summary.data(), summary.size() });
+	if(!m_write_failed && !writev_all(STDOUT_FILENO, m_iovecs))
+	{
+		m_write_failed = true;
+		LOG(INFO) << "Write to stdout failed: " << LOG_STRERROR();
+	}
+}
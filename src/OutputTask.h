@@ -25,9 +25,16 @@
 #include <MatchList.h>
 
 #include <memory>
+#include <vector>
+#include <chrono>
+#include <optional>
+
+#include <sys/uio.h> // For struct iovec.
 
 #include "sync_queue_impl_selector.h"
 #include "OutputContext.h"
+#include "RunStats.h"
+#include "libext/ReorderWindow.hpp"
 
 /**
  * Task which serializes the output from the FileScanner threads.
@@ -36,15 +43,83 @@ class OutputTask
 {
 public:
   OutputTask(bool flag_color, bool flag_prefix_file, bool flag_line_number,
-             bool flag_column, bool flag_nullsep, sync_queue<MatchList> &input_queue);
+             bool flag_column, bool flag_nullsep, sync_queue<MatchList> &input_queue,
+             OutputFormat output_format = OutputFormat::TEXT);
 	virtual ~OutputTask();
 
+	/**
+	 * Enable ordered output.  The incoming MatchLists, which must then include one for every file, are printed in
+	 * sequence number order.  Those which arrive early are held until the ones before them have been printed, in a
+	 * reorder buffer of @c window->size() slots.  Must be called before Run().
+	 *
+	 * @param window  Not owned.
+	 */
+	void SetReorderWindow(ReorderWindow *window) noexcept { m_reorder_window = window; };
+
+	/**
+	 * Tell the OutputTask that context lines are being printed, with @p before lines before and @p after lines after
+	 * each match.  The FileScanners put them in the MatchLists; all we do is separate the files' results with "--"
+	 * when there's no file header to separate them.  Must be called before Run().
+	 */
+	void SetContextLines(size_t before, size_t after) noexcept { m_print_context = (before != 0 || after != 0); };
+
+	/**
+	 * Write results out as soon as we have them, whatever stdout is, instead of buffering them when it isn't a
+	 * terminal.  For interactive uses which care more about the time to the first result than the total time, e.g.
+	 * editor integrations, which read our output from a pipe.  Must be called before Run().
+	 */
+	void SetLowLatency(bool low_latency) noexcept { if(low_latency) { m_flush_threshold = 0; } };
+
+	/**
+	 * Time the writes, and add them and the match counts to @p run_stats once Run() is done.  Must be called before
+	 * Run().
+	 *
+	 * @param run_stats  Not owned.
+	 */
+	void SetRunStats(RunStats *run_stats) noexcept { m_run_stats = run_stats; };
+
 	void Run();
 
 	[[nodiscard]] long long GetTotalMatchedLines() const { return m_total_matched_lines; };
 
+	/**
+	 * The time from when we were constructed, at startup, to when the first output was written.  Only valid after
+	 * Run() has returned.
+	 *
+	 * @return  The time, or std::nullopt if nothing was written.
+	 */
+	[[nodiscard]] std::optional<std::chrono::steady_clock::duration> GetTimeToFirstOutput() const noexcept { return m_time_to_first_output; };
+
+	/// The OutputContext the FileScanners should format the MatchLists with.
+	[[nodiscard]] const OutputContext& GetOutputContext() const noexcept { return *m_output_context; };
+
 private:
 
+	/// Run() for ordered output.
+	void RunOrdered();
+
+	/**
+	 * Pull the next batch of MatchLists off the input queue into @p batch.  If there's buffered output, only wait
+	 * for so long before flushing it.
+	 *
+	 * @return  As sync_queue::pull_front(), i.e. queue_op_status::closed once there's nothing more to pull.
+	 */
+	queue_op_status PullBatch(std::vector<MatchList> &batch);
+
+	/**
+	 * Buffer the formatted output of @p match_lists for writing, count their matches, and clear @p match_lists.  Any
+	 * which haven't been formatted yet are formatted here.  If enough output is now buffered, Flush() it.
+	 *
+	 * @param match_lists
+	 */
+	void BufferMatchLists(std::vector<MatchList> &match_lists);
+
+	/// Write all buffered output to stdout in one writev() (or as few as possible).
+	void Flush();
+
+	/// For the machine-readable formats, write the summary of the whole search once everything else has been written.
+	void WriteSummary();
+
 	/// The queue from which we'll pull our MatchLists.
 	sync_queue<MatchList> &m_input_queue;
 
@@ -63,10 +138,59 @@ private:
 	/// Whether to write a null after a filename instead of ':'.
 	bool m_nullsep;
 
+	/// Whether context lines are being printed.
+	bool m_print_context { false };
+
+	OutputFormat m_output_format;
+
+	/// When we were constructed, for the summary's elapsed time.
+	std::chrono::steady_clock::time_point m_start_time;
+
+	/// How long after m_start_time the first output was written, if it has been.
+	std::optional<std::chrono::steady_clock::duration> m_time_to_first_output;
+
 	std::unique_ptr<OutputContext> m_output_context;
 
+	/// If non-null, output is ordered.
+	ReorderWindow *m_reorder_window { nullptr };
+
+	/// Whether we've printed anything yet.
+	bool m_first_matchlist_printed { false };
+
+	/// @name Output buffering.
+	/// The buffer holds the MatchLists themselves, whose output is written straight from their strings.
+	///@{
+
+	/// Flush once this many bytes are buffered.  0 to flush every batch, as we do for a terminal.
+	size_t m_flush_threshold { 0 };
+
+	std::vector<MatchList> m_unflushed;
+	size_t m_unflushed_bytes { 0 };
+
+	/// When the oldest buffered output was buffered.
+	std::chrono::steady_clock::time_point m_unflushed_since;
+	///@}
+
+	/// Scratch space for Flush().
+	std::vector<struct iovec> m_iovecs;
+
+	/// Set if a write to stdout fails, after which we stop trying.
+	bool m_write_failed { false };
+
+	/// If non-null, where to add our stats when we're done.
+	RunStats *m_run_stats { nullptr };
+
+	/// Time spent writing, if m_run_stats is set.
+	StageTime m_write_time;
+
 	/// The total number of matched lines as reported by the incoming MatchLists.
 	long long m_total_matched_lines { 0 };
+
+	/// The total number of matches, which can be more than the number of matched lines.
+	long long m_total_matches { 0 };
+
+	/// The number of files with matches.
+	long long m_total_files_with_matches { 0 };
 };
 
 #endif /* OUTPUTTASK_H_ */
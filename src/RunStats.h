@@ -0,0 +1,155 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file RunStats.h */
+
+#ifndef SRC_RUNSTATS_H_
+#define SRC_RUNSTATS_H_
+
+#include <config.h>
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <optional>
+#include <ostream>
+
+#include <libext/StageTimer.hpp>
+
+/**
+ * The counts and per-stage timings of a whole run, for the --stats report.
+ *
+ * As with DirTraversalStats, each thread collects its own numbers in its own instance, and adds them to the one
+ * shared instance only once, when it's done, so the only locking is that one-time sum.
+ */
+class RunStats
+{
+	/**
+	 * Using X-macros to make fields easier to add/rearrange/remove.
+	 */
+#define M_COUNTLIST \
+	X("Files considered", m_files_considered) \
+	X("Files skipped", m_files_skipped) \
+	X("Directories skipped", m_dirs_skipped) \
+	X("Files scanned", m_files_scanned) \
+	X("Bytes read", m_bytes_read) \
+	X("Files with matches", m_files_with_matches) \
+	X("Matched lines", m_matched_lines) \
+	X("Matches", m_matches)
+
+#define M_STAGELIST \
+	X("traversal", m_traversal) \
+	X("read", m_read) \
+	X("scan", m_scan) \
+	X("format", m_format) \
+	X("write", m_write)
+
+public:
+#define X(d,s) size_t s {0};
+	M_COUNTLIST
+#undef X
+
+	/// @name The time spent in each stage of the pipeline.
+	/// Except for the traversal, whose wall time is that of the whole traversal, the times are summed over the
+	/// threads doing that stage, so can add up to more than the total time.
+	///@{
+#define X(d,s) StageTime s;
+	M_STAGELIST
+#undef X
+	///@}
+
+	/// @name The most items each queue held at once.
+	///@{
+	size_t m_file_queue_high_water {0};
+	size_t m_match_queue_high_water {0};
+	///@}
+
+	/// @name Directory descriptor cache counts.
+	///@{
+	size_t m_dir_fds_opened {0};
+	size_t m_dir_fds_evicted {0};
+	size_t m_dir_fds_max_open {0};
+	///@}
+
+	/// Wall time of the whole run.
+	std::chrono::nanoseconds m_elapsed {0};
+
+	/// Time from startup to the first output, if there was any.
+	std::optional<std::chrono::nanoseconds> m_time_to_first_output;
+
+	/**
+	 * Atomic compound assignment by sum.
+	 * Adds the counts and stage times from #other to *this in a thread-safe manner.
+	 * @param other
+	 */
+	void operator+=(const RunStats & other)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+#define X(d,s) s += other. s;
+		M_COUNTLIST
+		M_STAGELIST
+#undef X
+	}
+
+	/**
+	 * Friend function stream insertion operator.  Prints the human-readable report.
+	 *
+	 * @param os
+	 * @param rs
+	 * @return
+	 */
+	friend std::ostream& operator<<(std::ostream& os, const RunStats &rs)
+	{
+		os
+#define X(d,s) << d ": " << rs. s << "\n"
+		M_COUNTLIST
+#undef X
+		;
+
+		char line[80];
+		std::snprintf(line, sizeof(line), "%-10s %12s %12s\n", "Stage", "Wall (ms)", "CPU (ms)");
+		os << line;
+#define X(d,s) std::snprintf(line, sizeof(line), "%-10s %12.3f %12.3f\n", d, ms(rs. s .m_wall), ms(rs. s .m_cpu)); os << line;
+		M_STAGELIST
+#undef X
+
+		os << "Queue high-water marks: " << rs.m_file_queue_high_water << " files to scan, "
+				<< rs.m_match_queue_high_water << " results to write\n";
+		os << "Directory descriptors: " << rs.m_dir_fds_opened << " opened, " << rs.m_dir_fds_evicted << " evicted, "
+				<< rs.m_dir_fds_max_open << " open at most\n";
+		if(rs.m_time_to_first_output)
+		{
+			std::snprintf(line, sizeof(line), "Time to first output: %.3f ms\n", ms(*rs.m_time_to_first_output));
+			os << line;
+		}
+		std::snprintf(line, sizeof(line), "Total time: %.3f ms\n", ms(rs.m_elapsed));
+		return os << line;
+	};
+
+private:
+
+	/// Mutex for making the compound assignment by sum operator thread-safe.
+	std::mutex m_mutex;
+
+	static double ms(std::chrono::nanoseconds ns) noexcept { return std::chrono::duration<double, std::milli>(ns).count(); };
+
+#undef M_COUNTLIST
+#undef M_STAGELIST
+};
+
+#endif /* SRC_RUNSTATS_H_ */
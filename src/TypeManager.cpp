@@ -23,6 +23,7 @@
 #include "TypeManager.h"
 
 #include <algorithm>
+#include <cstring>
 #include <set>
 #include <array>
 #include <iterator>
@@ -30,7 +31,7 @@
 #include <iomanip>
 #include <string>
 #include <libext/string.hpp>
-#include <fnmatch.h>
+#include <libext/bytesearch.hpp>
 #include <libext/Logger.h>
 
 struct Type
@@ -136,32 +137,28 @@ TypeManager::TypeManager()
 	}
 }
 
-bool TypeManager::FileShouldBeScanned(const name_string_type& name) const noexcept
+/**
+ * Find the period starting the extension of @p name.
+ *
+ * @return  Pointer to the last period in @p name, or nullptr if there isn't one.
+ */
+static inline const char * f_find_last_period(std::string_view name) noexcept
+{
+	return find_byte_backward(name.data(), name.data() + name.size(), '.');
+}
+
+bool TypeManager::FileShouldBeScanned(name_string_type name) const noexcept
 {
 	// Find the name's extension.
-	auto last_period_offset = name.find_last_of('.');
-	auto last_period = (last_period_offset == name_string_type::npos) ? name.cend() : name.cbegin() + last_period_offset;
-	if(last_period != name.cend())
+	const char *last_period = f_find_last_period(name);
+	if(last_period != nullptr)
 	{
 		// There was a period, might be an extension.
-		if(last_period != name.cbegin())
+		if(last_period != name.data())
 		{
-			bool include_it = false;
-
 			// Name doesn't start with a period, it still could be an extension.
-			size_t ext_plus_period_size = name.cend() - last_period;
-
-			if(ext_plus_period_size <= microstring::max_size()+1)
-			{
-				// Use the 8-byte microstring fast map.
-				microstring mext(last_period+1, name.end());
-				include_it = std::binary_search(m_fast_include_extensions.cbegin(), m_fast_include_extensions.cend(), mext);
-			}
-			else if(m_include_extensions.find(std::string(last_period, name.cend())) != m_include_extensions.end())
-			{
-				// Found the extension in the hash of extensions to include.
-				include_it = true;
-			}
+			// Look it up in the perfect hash of extensions to include.
+			bool include_it = m_include_extensions.contains(std::string_view(last_period + 1, name.data() + name.size() - (last_period + 1)));
 
 			if(include_it)
 			{
@@ -194,36 +191,93 @@ bool TypeManager::FileShouldBeScanned(const name_string_type& name) const noexce
 
 	// Now the checks start to get expensive.  So far we haven't ruled the file in or out by its extension or literal filename.
 	// Check if the filename matches the collection of the globbing patterns we're including and excluding.
-	// We have to match each filename against each glob pattern to deal with include/exclude sequences which match the overlapping filenames.
-	enum { nomatch, include, exclude } glob_verdict = nomatch;
-	for(const auto& glob : m_include_exclude_globs)
+	// The last glob which matches decides, to deal with include/exclude sequences which match the overlapping filenames.
+	if(m_include_exclude_globs.empty())
 	{
-		std::string name_str = std::string(name);
-		int result = fnmatch(glob.first.c_str(), name_str.c_str(), 0);
-		if(result == 0)
-		{
-			// Glob matched, return whether we should include this file or not.
-			if(glob.second)
-			{
-				glob_verdict = include;
-			}
-			else
-			{
-				glob_verdict = exclude;
-			}
-		}
+		return false;
 	}
-
-	if(glob_verdict == include)
+	int last_match = m_include_exclude_glob_set.LastMatch(name);
+	if(last_match >= 0 && m_include_exclude_globs[last_match].second)
 	{
 		return true;
 	}
 
-	/// @todo Support first-line regexes.
+	// Files without an extension may still be recognized by their first line, but that's for the scanner to decide
+	// once it's read it.  See FileTypeDependsOnFirstLine().
 
 	return false;
 }
 
+bool TypeManager::HasFirstLineRegexes() const noexcept
+{
+	return m_first_line_regex != nullptr;
+}
+
+bool TypeManager::FileTypeDependsOnFirstLine(name_string_type name) const noexcept
+{
+	if(!HasFirstLineRegexes())
+	{
+		return false;
+	}
+
+	// Only names without an extension.  As in FileShouldBeScanned(), a leading period doesn't start an extension.
+	const char *last_period = f_find_last_period(name);
+	if(last_period != nullptr && last_period != name.data())
+	{
+		return false;
+	}
+
+	// An exclude glob still rules it out.
+	if(IsExcludedByAnyGlob(name))
+	{
+		return false;
+	}
+
+	return true;
+}
+
+#if HAVE_LIBPCRE2
+/// Each scanner thread's match data for FirstLineShouldBeScanned().
+static thread_local std::unique_ptr<pcre2_match_data, void(*)(pcre2_match_data*)> f_first_line_match_data { nullptr, pcre2_match_data_free };
+#endif
+
+bool TypeManager::FirstLineShouldBeScanned(const char *file_data, size_t size) const noexcept
+{
+	if(!HasFirstLineRegexes())
+	{
+		return false;
+	}
+
+	// Match against the first line only, without its line ending.
+	const char *eol = static_cast<const char*>(std::memchr(file_data, '\n', size));
+	if(eol != nullptr)
+	{
+		size = eol - file_data;
+	}
+	if(size > 0 && file_data[size-1] == '\r')
+	{
+		--size;
+	}
+
+#if HAVE_LIBPCRE2
+	if(!f_first_line_match_data)
+	{
+		f_first_line_match_data.reset(pcre2_match_data_create(1, nullptr));
+		if(!f_first_line_match_data)
+		{
+			return false;
+		}
+	}
+	int rc = pcre2_match(m_first_line_regex.get(), reinterpret_cast<PCRE2_SPTR8>(file_data), size, 0, 0,
+			f_first_line_match_data.get(), nullptr);
+#elif HAVE_LIBPCRE
+	int ovector[3];
+	int rc = pcre_exec(m_first_line_regex.get(), m_first_line_regex_extra.get(), file_data, size, 0, 0, ovector, 3);
+#endif
+
+	return rc >= 0;
+}
+
 bool TypeManager::type(const std::string& type_name)
 {
 	auto it_type = m_builtin_and_user_type_map.find(type_name);
@@ -441,24 +495,19 @@ bool TypeManager::TypeDel(const std::string& type)
 	return num_erased > 0;
 }
 
-bool TypeManager::IsExcludedByAnyGlob(const std::string &name) const noexcept
+bool TypeManager::IsExcludedByAnyGlob(name_string_type name) const noexcept
 {
-	for(const auto& glob : m_exclude_globs)
+	if(m_exclude_globs.empty())
 	{
-		int result = fnmatch(glob.c_str(), name.c_str(), 0);
-		if(result == 0)
-		{
-			// Glob matched, we should exclude.
-			return true;
-		}
+		return false;
 	}
 
-	return false;
+	return m_exclude_glob_set.AnyMatch(name);
 }
 
 void TypeManager::CompileTypeTables()
 {
-	std::set<microstring> unique_microstring_extensions;
+	std::vector<std::string> include_extensions;
 
 	for(const auto& i : m_active_type_map)
 	{
@@ -476,18 +525,8 @@ void TypeManager::CompileTypeTables()
 			if(j[0] == '.')
 			{
 				// First char is a '.', this is an extension specification.
-				if(j.length() <= microstring::max_size()+1)
-				{
-					// It's 4 chars or less, minus the '.'.
-					LOG(INFO) << "Compiling ext spec \'" << j << "\' as microstring";
-					microstring m(j.cbegin()+1, j.cend());
-					unique_microstring_extensions.insert(m);
-				}
-				else
-				{
-					LOG(INFO) << "Compiling ext spec \'" << j << "\' as non-microstring";
-					m_include_extensions.emplace(j, i.first);
-				}
+				LOG(INFO) << "Compiling ext spec \'" << j << "\'";
+				include_extensions.push_back(j.substr(1));
 			}
 			else if(j[0] == '/')
 			{
@@ -510,19 +549,67 @@ void TypeManager::CompileTypeTables()
 		}
 	}
 
-	m_fast_include_extensions.resize(unique_microstring_extensions.size());
-	LOG(INFO) << "Found " << unique_microstring_extensions.size() << " unique " << microstring::max_size() << "-char or less extensions.";
-	decltype(m_fast_include_extensions)::size_type j = 0;
-	for(auto i : unique_microstring_extensions)
+	// Build the perfect hash of the extensions, so that each filename's extension is looked up with a single probe.
+	m_include_extensions.Compile(include_extensions);
+	LOG(INFO) << "Found " << m_include_extensions.size() << " unique extensions.";
+
+	// Compile the globs, so that each filename is matched against all of them in one pass.
+	m_exclude_glob_set.Compile(m_exclude_globs);
+	std::vector<std::string> include_exclude_globs;
+	for(const auto& glob : m_include_exclude_globs)
 	{
-		m_fast_include_extensions[j] = i;
-		++j;
+		include_exclude_globs.push_back(glob.first);
+	}
+	m_include_exclude_glob_set.Compile(include_exclude_globs);
 
-		LOG(INFO) << "Added " << static_cast<std::string>(i) << " (" << to_string(i.urep(), std::hex) << ") to m_fast_include_extensions";
+	CompileFirstLineRegexes();
+}
+
+void TypeManager::CompileFirstLineRegexes()
+{
+	if(m_included_first_line_regexes.empty())
+	{
+		return;
 	}
 
-	// Sort the fast_include_extensions list so we can binary search it.
-	std::sort(m_fast_include_extensions.begin(), m_fast_include_extensions.end());
+	// Combine the regexes into one alternation, so that a first line is matched against all of them in one pass.
+	// Sort them first, so the combined regex doesn't depend on the hash order.
+	std::set<std::string> regexes;
+	for(const auto& i : m_included_first_line_regexes)
+	{
+		// Strip the enclosing '/'s.
+		const std::string &spec = i.first;
+		size_t end = (spec.size() >= 2 && spec.back() == '/') ? spec.size()-1 : spec.size();
+		regexes.insert(spec.substr(1, end-1));
+	}
+	std::string combined;
+	for(const auto& regex : regexes)
+	{
+		combined += (combined.empty() ? "(?:" : "|(?:") + regex + ")";
+	}
+	LOG(INFO) << "Compiling combined first-line regex \'" << combined << "\'";
+
+#if HAVE_LIBPCRE2
+	int error_code;
+	PCRE2_SIZE error_offset;
+	m_first_line_regex.reset(pcre2_compile(reinterpret_cast<PCRE2_SPTR8>(combined.c_str()), combined.length(), 0,
+			&error_code, &error_offset, nullptr));
+	if(!m_first_line_regex)
+	{
+		throw TypeManagerException("Couldn't compile the first-line regexes \"" + combined + "\"");
+	}
+	// JIT compilation is only an optimization.
+	(void)pcre2_jit_compile(m_first_line_regex.get(), PCRE2_JIT_COMPLETE);
+#elif HAVE_LIBPCRE
+	const char *error;
+	int error_offset;
+	m_first_line_regex.reset(pcre_compile(combined.c_str(), 0, &error, &error_offset, nullptr));
+	if(!m_first_line_regex)
+	{
+		throw TypeManagerException("Couldn't compile the first-line regexes \"" + combined + "\": " + error);
+	}
+	m_first_line_regex_extra.reset(pcre_study(m_first_line_regex.get(), PCRE_STUDY_JIT_COMPILE, &error));
+#endif
 }
 
 void TypeManager::PrintTypesForHelp(std::ostream& s) const
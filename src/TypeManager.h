@@ -24,13 +24,24 @@
 
 #include <future/string_view.hpp>
 #include <libext/string.hpp>
+#include <libext/GlobSet.h>
+#include <libext/PerfectHashSet.h>
 
 #include <iosfwd>
 #include <tuple>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <unordered_map>
+#include <functional>
+
+#if HAVE_LIBPCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#elif HAVE_LIBPCRE
+#include <pcre.h>
+#endif
 
 
 /**
@@ -50,16 +61,35 @@ public:
 	TypeManager();
 	~TypeManager() = default;
 
-	using name_string_type = std::string;
+	using name_string_type = std::string_view;
 
 	/**
 	 * Determine if the file with the given @p name should be scanned based on the
-	 * enabled file types.
+	 * enabled file types.  Doesn't allocate.
 	 *
 	 * @param name
 	 * @return true if file should be scanned, false otherwise.
 	 */
-	bool FileShouldBeScanned(const name_string_type &name) const noexcept;
+	bool FileShouldBeScanned(name_string_type name) const noexcept;
+
+	/// @return true if any of the enabled file types can be recognized by the first line of the file.
+	[[nodiscard]] bool HasFirstLineRegexes() const noexcept;
+
+	/**
+	 * Determine if the file with the given @p name, which FileShouldBeScanned() has rejected, could still be one of
+	 * the enabled types, recognized by its first line, so that FirstLineShouldBeScanned() has to decide.  This is
+	 * the case for names without an extension which no --exclude glob matches.  Doesn't allocate.
+	 */
+	[[nodiscard]] bool FileTypeDependsOnFirstLine(name_string_type name) const noexcept;
+
+	/**
+	 * Determine if a file which FileTypeDependsOnFirstLine() should be scanned, by matching its first line against the
+	 * first-line regexes of all the enabled types at once.  Thread-safe.
+	 *
+	 * @param file_data  The start of the file's contents.  Only the first line is looked at.
+	 * @param size       The number of bytes at @p file_data.
+	 */
+	[[nodiscard]] bool FirstLineShouldBeScanned(const char *file_data, size_t size) const noexcept;
 
 	/**
 	 * Add the given file type to the types which will be scanned.  For handling the
@@ -149,7 +179,10 @@ private:
 
 	void TypeAddGlobInclude(const std::string &type, const std::string &glob);
 
-	bool IsExcludedByAnyGlob(const std::string &name) const noexcept;
+	bool IsExcludedByAnyGlob(name_string_type name) const noexcept;
+
+	/// Compile m_included_first_line_regexes into m_first_line_regex.  Called by CompileTypeTables().
+	void CompileFirstLineRegexes();
 
 	/// Flag to keep track of the first call to type().
 	bool m_first_type_has_been_seen = { false };
@@ -174,14 +207,18 @@ private:
 	/// CompileTypeTables() after all config file and command-line processing is complete.
 	/// @{
 
-	/// File extensions in microstring format, which can be binary searched quickly.
-	std::vector<microstring> m_fast_include_extensions;
+	/// File extensions which will be examined, without their periods, in a perfect hash.
+	PerfectHashSet m_include_extensions;
 
-	/// File extensions which will be examined.  Maps to file type.
-	std::unordered_multimap<std::string, std::string> m_include_extensions;
+	/// Hash for m_included_literal_filenames which lets it be searched by string_view without building a std::string.
+	struct name_hash
+	{
+		using is_transparent = void;
+		size_t operator()(std::string_view s) const noexcept { return std::hash<std::string_view>{}(s); };
+	};
 
 	/// Literal filenames which will be examined.  Maps to file type.
-	std::unordered_multimap<std::string, std::string> m_included_literal_filenames;
+	std::unordered_multimap<std::string, std::string, name_hash, std::equal_to<>> m_included_literal_filenames;
 
 	/// Vector of glob patterns to check for exclusion.
 	/// This is separate from m_include_exclude_globs because only the exclude globs need to be
@@ -195,10 +232,24 @@ private:
 	/// The bool is true if include, false if exclude.
 	std::vector<std::pair<std::string, bool>> m_include_exclude_globs;
 
+	/// m_exclude_globs, compiled.
+	GlobSet m_exclude_glob_set;
+
+	/// m_include_exclude_globs, compiled.  The last glob which matches a filename decides whether it's included.
+	GlobSet m_include_exclude_glob_set;
+
 	/// Map of the regexes to try to match to the first line of the file (key) to
 	/// the file type (value).
 	std::unordered_multimap<std::string, std::string> m_included_first_line_regexes;
 
+	/// m_included_first_line_regexes, compiled into a single regex which matches if any of them do.
+#if HAVE_LIBPCRE2
+	std::unique_ptr<pcre2_code, void(*)(pcre2_code*)> m_first_line_regex { nullptr, pcre2_code_free };
+#elif HAVE_LIBPCRE
+	std::unique_ptr<pcre, void(*)(void*)> m_first_line_regex { nullptr, pcre_free };
+	std::unique_ptr<pcre_extra, void(*)(pcre_extra*)> m_first_line_regex_extra { nullptr, pcre_free_study };
+#endif
+
 	///@}
 };
 
@@ -21,7 +21,9 @@
 
 #include "DirTree.h"
 
+#include "DirentReader.h"
 #include "Logger.h"
+#include "StatBatch.h"
 
 #include <sys/stat.h>
 #include <unistd.h>
@@ -41,12 +43,15 @@
 /// m_dir_has_been_visited will resize/rehash if it needs more space.
 constexpr auto M_INITIAL_NUM_DIR_ESTIMATE = 10000;
 
-DirTree::DirTree(sync_queue<std::shared_ptr<FileID>>& output_queue,
+DirTree::DirTree(sync_queue<FileRecord>& output_queue,
+		DirTable &dir_table,
 		const file_basename_filter_type &file_basename_filter,
 		const dir_basename_filter_type &dir_basename_filter,
 		bool recurse,
-		bool follow_symlinks)
-	: m_recurse(recurse), m_follow_symlinks(follow_symlinks), m_out_queue(output_queue),
+		bool follow_symlinks,
+		bool sort_files,
+		WorkerGate *dirjob_gate)
+	: m_recurse(recurse), m_follow_symlinks(follow_symlinks), m_sort_files(sort_files), m_dirjob_gate(dirjob_gate), m_out_queue(output_queue), m_dir_table(dir_table),
 	  m_file_basename_filter(file_basename_filter), m_dir_basename_filter(dir_basename_filter)
 {
 	m_dir_has_been_visited.reserve(M_INITIAL_NUM_DIR_ESTIMATE);
@@ -54,13 +59,21 @@ DirTree::DirTree(sync_queue<std::shared_ptr<FileID>>& output_queue,
 
 void DirTree::Scandir(std::vector<std::string> start_paths, int dirjobs)
 {
-	m_dirjobs = dirjobs;
+	m_dirjobs = (m_dirjob_gate != nullptr) ? m_dirjob_gate->max() : dirjobs;
+
+	if(m_one_file_system || m_fs_policy)
+	{
+		m_mount_table.Load();
+	}
 
 	// Start at the cwd of the process (~AT_FDCWD)
 	std::shared_ptr<FileID> root_file_id = std::make_shared<FileID>(FileID::path_known_cwd_tag());
 
-	// OpenDir() it just so that FStatAt() works.
-	DIR *d = root_file_id->OpenDir();
+	// For a sorted traversal, the command-line files and dirs, in the order given.
+	std::vector<SortedEntry> sorted_roots;
+
+	// The directories of the files we find here.
+	std::vector<std::shared_ptr<FileID>> dirs_with_files;
 
 	//
 	// Step 1: Process the paths and/or filenames specified by the user on the command line.
@@ -82,15 +95,45 @@ void DirTree::Scandir(std::vector<std::string> start_paths, int dirjobs)
 		case FT_REG:
 		{
 			// Explicitly not filtering files specified on command line.
-			file_or_dir->SetFileDescriptorMode(FAM_RDONLY, FCF_NOATIME | FCF_NOCTTY);
-			m_out_queue.push_back(file_or_dir);
+			if(dirs_with_files.empty())
+			{
+				dirs_with_files.push_back(root_file_id);
+			}
+			FileRecord file(root_file_id.get(), file_or_dir->GetBasename());
+			file.SetOnNetworkFilesystem(IsOnNetworkFilesystem(*file_or_dir));
+			if(m_sort_files)
+			{
+				sorted_roots.push_back(SortedEntry{DirToRead(), std::move(file)});
+			}
+			else
+			{
+				m_out_queue.push_back(std::move(file));
+			}
 			break;
 		}
 		case FT_DIR:
 		{
 			// Explicitly not filtering nor obeying no-recurse for dirs specified on command line.
+			if(m_max_depth == 0)
+			{
+				// None of its entries are shallow enough.
+				break;
+			}
 			file_or_dir->SetFileDescriptorMode(FAM_RDONLY, FCF_DIRECTORY | FCF_NOATIME | FCF_NOCTTY | FCF_NONBLOCK);
-			m_dir_queue.push_back(file_or_dir);
+
+			// The paths of the entries below the cwd don't start with "./".
+			const std::string &start_path = file_or_dir->GetPath();
+			size_t start_path_size = (start_path == ".") ? 0 : start_path.size() + 1;
+
+			DirToRead dir {file_or_dir, nullptr, 0, start_path_size, IsOnNetworkFilesystem(*file_or_dir)};
+			if(m_sort_files)
+			{
+				sorted_roots.push_back(SortedEntry{std::move(dir), FileRecord()});
+			}
+			else
+			{
+				m_dir_queue.push_back(std::move(dir));
+			}
 			break;
 		}
 		case FT_SYMLINK:
@@ -115,29 +158,47 @@ void DirTree::Scandir(std::vector<std::string> start_paths, int dirjobs)
 		}
 	}
 
-	root_file_id->CloseDir(d);
-
-	// Create and start the directory traversal threads.
-	std::vector<std::thread> threads;
-
-	for(int i=0; i<m_dirjobs; i++)
+	if(m_sort_files)
 	{
-		threads.emplace_back(std::thread(&DirTree::ReaddirLoop, this, i));
+		// Traverse in this thread, in a deterministic order.
+		SortedTraversal(std::move(sorted_roots), dirs_with_files);
 	}
+	else
+	{
+		// Tell the dir queue how many workers to expect before any of them start, since throttled
+		// threads will adjust this count as soon as they're started.
+		m_dir_queue.set_num_workers(m_dirjobs);
 
-	LOG(INFO) << "Globber threads = " << threads.size();
+		// Create and start the directory traversal threads.
+		std::vector<std::thread> threads;
 
-	// Wait for the producer+consumer threads to finish.
-	m_dir_queue.wait_for_worker_completion(m_dirjobs);
+		for(int i=0; i<m_dirjobs; i++)
+		{
+			threads.emplace_back(std::thread(&DirTree::ReaddirLoop, this, i));
+		}
 
-	m_dir_queue.close();
+		LOG(INFO) << "Globber threads = " << threads.size();
 
-	// Wait for all the threads to finish.
-	for(auto &thr : threads)
-	{
-		thr.join();
+		// Wait for the producer+consumer threads to finish.
+		m_dir_queue.wait_for_worker_completion(0);
+
+		m_dir_queue.close();
+
+		if(m_dirjob_gate != nullptr)
+		{
+			// Release any parked threads so they see the closed queue and exit.
+			m_dirjob_gate->Open();
+		}
+
+		// Wait for all the threads to finish.
+		for(auto &thr : threads)
+		{
+			thr.join();
+		}
 	}
 
+	m_dir_table.Adopt(dirs_with_files);
+
 	// Log the traversal stats.
 	LOG(INFO) << m_stats;
 	LOG(INFO) << "FileID stats:\n" << *root_file_id;
@@ -145,43 +206,72 @@ void DirTree::Scandir(std::vector<std::string> start_paths, int dirjobs)
 
 void DirTree::ReaddirLoop(int dirjob_num)
 {
-	std::shared_ptr<FileID> dse;
-	DIR *d {nullptr};
-	struct dirent *dp {nullptr};
+	DirToRead dir_to_read;
+	DirentReader reader;
+	DirentView de;
+	StatBatch stat_batch;
 
 	DirTraversalStats stats;
+	auto cpu_start = StageTimer::ThreadCpuTime();
 
 	// Create a local queue to collect up any files we find without locking the main queue.
-	std::deque<std::shared_ptr<FileID>> local_file_queue;
+	std::deque<FileRecord> local_file_queue;
+
+	// The directories the FileRecords we've sent point to.
+	std::vector<std::shared_ptr<FileID>> dirs_with_files;
 
 	// Set the name of this thread, for logging and debug purposes.
 	set_thread_name("READDIR_" + std::to_string(dirjob_num));
 
-	while(m_dir_queue.pull_front(std::move(dse)) != queue_op_status::closed)
+	while(true)
 	{
+		// Wait here if we've been throttled.
+		WaitForDirjobGate(dirjob_num);
+
+		if(m_dir_queue.pull_front(std::move(dir_to_read)) == queue_op_status::closed)
+		{
+			break;
+		}
+		const std::shared_ptr<FileID> &dse = dir_to_read.m_dir;
+
 		LOG(DEBUG) << "Examining files in directory '" << dse->GetPath() << "'";
 
 		local_file_queue.clear();
 
-		// Get a DIR* representing the directory specified by dse.
-		d = dse->OpenDir();
-		if(d == nullptr)
+		// Open the directory specified by dse.
+		if(!reader.Open(*dse))
 		{
 			// At a minimum, this wasn't a directory.
 			WARN() << "OpenDir() failed on path " << dse->GetBasename() << ": " << LOG_STRERROR();
 			continue;
 		}
 
+		// Add this directory's ignore files, if any, to the rules inherited from its ancestors.
+		auto ignore_rules = m_use_ignore_files ? IgnoreRules::Load(*dse, dir_to_read.m_ignore_rules, &reader) : nullptr;
+
 		// Read all entries in this directory.
-		do
+		auto num_files_before = stats.m_num_files_scanned;
+		auto *file_queue = m_low_latency ? nullptr : &local_file_queue;
+		while(reader.Next(de))
 		{
-			if((dp = readdir(d)) != NULL)
+			if(NeedsStat(de))
 			{
-				ProcessDirent(dse, dp, stats, &local_file_queue);
+				stat_batch.Add(de.m_name, de.m_ino, StatFlags());
+				if(stat_batch.full())
+				{
+					FlushStatBatch(stat_batch, dir_to_read, ignore_rules, stats, file_queue, nullptr);
+				}
+				continue;
 			}
-		} while(dp != NULL);
+			ProcessDirent(dir_to_read, ignore_rules, de, stats, file_queue);
+		}
+		FlushStatBatch(stat_batch, dir_to_read, ignore_rules, stats, file_queue, nullptr);
+		if(stats.m_num_files_scanned != num_files_before)
+		{
+			dirs_with_files.push_back(dse);
+		}
 
-		// Check if readdir is just done with this directory, or encountered an error.
+		// Check if we're just done with this directory, or encountered an error.
 		if(errno != 0)
 		{
 			WARN() << "Could not read directory: " << LOG_STRERROR(errno) << ". Skipping.";
@@ -193,16 +283,282 @@ void DirTree::ReaddirLoop(int dirjob_num)
 			m_out_queue.push_back(local_file_queue);
 		}
 
-		dse->CloseDir(d);
+		reader.Close();
+	}
+
+	m_dir_table.Adopt(dirs_with_files);
+
+	stats.m_cpu_time = StageTimer::ThreadCpuTime() - cpu_start;
+	m_stats += stats;
+}
+
+void DirTree::SortedTraversal(std::vector<SortedEntry> roots, std::vector<std::shared_ptr<FileID>> &dirs_with_files)
+{
+	DirTraversalStats stats;
+	auto cpu_start = StageTimer::ThreadCpuTime();
+
+	// Files we've found but not yet sent to the output queue.  We send them a directory's worth at a time, so we
+	// don't have to lock the queue for every file.
+	std::deque<FileRecord> batch;
+
+	// Depth-first traversal stack.  Each frame is one directory's entries in sorted order, plus the index of the
+	// next entry to visit.
+	struct Frame
+	{
+		std::vector<SortedEntry> m_entries;
+		size_t m_next {0};
+	};
+	std::vector<Frame> stack;
+	stack.push_back(Frame{std::move(roots)});
+
+	std::deque<FileRecord> local_file_queue;
+	std::deque<DirToRead> local_dir_queue;
+	std::vector<std::pair<std::string, SortedEntry>> named_entries;
+	DirentReader reader;
+	DirentView de;
+	StatBatch stat_batch;
+
+	while(!stack.empty())
+	{
+		Frame &top = stack.back();
+		if(top.m_next == top.m_entries.size())
+		{
+			// Done with this directory.
+			stack.pop_back();
+			continue;
+		}
+
+		SortedEntry sorted_entry = std::move(top.m_entries[top.m_next++]);
+
+		if(!sorted_entry.m_dir.m_dir)
+		{
+			AddInSequence(std::move(sorted_entry.m_file), batch);
+			continue;
+		}
+		const DirToRead dir_to_read = std::move(sorted_entry.m_dir);
+		const std::shared_ptr<FileID> &entry = dir_to_read.m_dir;
+
+		// Let the scanners get going on what we have so far while we read the directory.
+		if(!batch.empty())
+		{
+			m_out_queue.push_back(batch);
+			batch.clear();
+		}
+
+		LOG(DEBUG) << "Examining files in directory '" << entry->GetPath() << "'";
+
+		if(!reader.Open(*entry))
+		{
+			WARN() << "OpenDir() failed on path " << entry->GetBasename() << ": " << LOG_STRERROR();
+			continue;
+		}
+
+		auto ignore_rules = m_use_ignore_files ? IgnoreRules::Load(*entry, dir_to_read.m_ignore_rules, &reader) : nullptr;
+
+		// Read the whole directory and close it before descending into any of its subdirectories, so we never have
+		// more than one directory open at once.
+		local_file_queue.clear();
+		local_dir_queue.clear();
+		while(reader.Next(de))
+		{
+			if(NeedsStat(de))
+			{
+				stat_batch.Add(de.m_name, de.m_ino, StatFlags());
+				if(stat_batch.full())
+				{
+					FlushStatBatch(stat_batch, dir_to_read, ignore_rules, stats, &local_file_queue, &local_dir_queue);
+				}
+				continue;
+			}
+			ProcessDirent(dir_to_read, ignore_rules, de, stats, &local_file_queue, &local_dir_queue);
+		}
+		FlushStatBatch(stat_batch, dir_to_read, ignore_rules, stats, &local_file_queue, &local_dir_queue);
+
+		if(errno != 0)
+		{
+			WARN() << "Could not read directory: " << LOG_STRERROR(errno) << ". Skipping.";
+			errno = 0;
+		}
+
+		reader.Close();
+
+		if(!local_file_queue.empty())
+		{
+			dirs_with_files.push_back(entry);
+		}
+
+		// Sort the files and subdirectories together by name.  Get the names once up front, since
+		// FileID::GetBasename() returns by value.
+		named_entries.clear();
+		for(auto &file : local_file_queue)
+		{
+			std::string name {file.GetBasename()};
+			named_entries.emplace_back(std::move(name), SortedEntry{DirToRead(), std::move(file)});
+		}
+		for(auto &dir : local_dir_queue)
+		{
+			std::string name {dir.m_dir->GetBasename()};
+			named_entries.emplace_back(std::move(name), SortedEntry{std::move(dir), FileRecord()});
+		}
+		std::sort(named_entries.begin(), named_entries.end(),
+				[](const auto &a, const auto &b){ return a.first < b.first; });
+
+		Frame frame;
+		frame.m_entries.reserve(named_entries.size());
+		for(auto &ne : named_entries)
+		{
+			frame.m_entries.push_back(std::move(ne.second));
+		}
+
+		/// @note This invalidates top.
+		stack.push_back(std::move(frame));
+	}
+
+	if(!batch.empty())
+	{
+		m_out_queue.push_back(batch);
 	}
 
+	stats.m_cpu_time = StageTimer::ThreadCpuTime() - cpu_start;
 	m_stats += stats;
 }
 
+bool DirTree::NeedsStat(const DirentView &de) const noexcept
+{
+	return (de.m_type == DT_UNKNOWN || (m_follow_symlinks && de.m_type == DT_LNK))
+			&& de.m_name != "." && de.m_name != "..";
+}
+
+bool DirTree::IsOnNetworkFilesystem(const FileID &start_path) const
+{
+	if(!m_fs_policy || m_mount_table.GetKind(start_path.GetDev()) != FSK_NETWORK)
+	{
+		return false;
+	}
+
+	LOG(INFO) << "'" << start_path.GetPath() << "' is on a " << m_mount_table.GetType(start_path.GetDev())
+			<< " network filesystem, limiting concurrent reads.";
+	return true;
+}
+
+bool DirTree::ShouldDescendInto(const DirToRead &dir, std::string_view name, dev_t dev, bool &on_network_fs,
+		DirTraversalStats &stats) const
+{
+	if(dev == dir.m_dir->GetDev())
+	{
+		// Same filesystem.
+		return true;
+	}
+
+	stats.m_num_mount_points_found++;
+
+	if(m_one_file_system)
+	{
+		LOG(INFO) << "... on another filesystem, skipping.";
+		stats.m_num_mount_points_rejected++;
+		return false;
+	}
+
+	if(m_fs_policy)
+	{
+		switch(m_mount_table.GetKind(dev))
+		{
+		case FSK_PSEUDO:
+			LOG(INFO) << "'" << dir.m_dir->GetPath() << "/" << name << "' is on a " << m_mount_table.GetType(dev)
+					<< " pseudo filesystem, skipping.";
+			stats.m_num_mount_points_rejected++;
+			return false;
+		case FSK_NETWORK:
+			LOG(INFO) << "'" << dir.m_dir->GetPath() << "/" << name << "' is on a " << m_mount_table.GetType(dev)
+					<< " network filesystem, limiting concurrent reads.";
+			on_network_fs = true;
+			break;
+		default:
+			on_network_fs = false;
+			break;
+		}
+	}
+
+	return true;
+}
+
+int DirTree::StatFlags() const noexcept
+{
+	return AT_NO_AUTOMOUNT | (!m_follow_symlinks ? AT_SYMLINK_NOFOLLOW : 0);
+}
+
+void DirTree::FlushStatBatch(StatBatch &stat_batch, const DirToRead &dir,
+		const std::shared_ptr<const IgnoreRules> &ignore_rules, DirTraversalStats &stats,
+		std::deque<FileRecord> *local_file_queue, std::deque<DirToRead> *local_dir_queue)
+{
+	if(stat_batch.empty())
+	{
+		return;
+	}
+
+	// Don't clobber the caller's errno from reading the directory.
+	int saved_errno = errno;
+	const std::shared_ptr<FileID> &dse = dir.m_dir;
+
+	int dir_fd = dse->OpenDirDescriptor();
+	if(dir_fd < 0)
+	{
+		WARN() << "Could not open directory '" << dse->GetPath() << "' to stat its entries: " << LOG_STRERROR();
+		stat_batch.clear();
+		errno = saved_errno;
+		return;
+	}
+	stat_batch.Run(dir_fd, dse->GetDev());
+	dse->CloseDirDescriptor(dir_fd);
+
+	for(size_t i = 0; i < stat_batch.size(); ++i)
+	{
+		if(stat_batch.GetError(i) != 0)
+		{
+			stats.m_num_filetype_stats++;
+			WARN() << "Attempt to stat file '" << stat_batch.GetName(i) << "' in directory '" << dse->GetPath()
+					<< "' failed: " << LOG_STRERROR(stat_batch.GetError(i));
+			continue;
+		}
+		DirentView de {stat_batch.GetName(i), DT_UNKNOWN, stat_batch.GetIno(i)};
+		ProcessDirent(dir, ignore_rules, de, stats, local_file_queue, local_dir_queue, &stat_batch.GetStat(i));
+	}
+
+	stat_batch.clear();
+	errno = saved_errno;
+}
+
+void DirTree::AddInSequence(FileRecord file, std::deque<FileRecord> &batch)
+{
+	file.SetSequenceNumber(m_next_sequence_number++);
+	batch.push_back(std::move(file));
+}
+
+void DirTree::WaitForDirjobGate(int dirjob_num)
+{
+	if(m_dirjob_gate == nullptr || m_dirjob_gate->IsActive(dirjob_num))
+	{
+		return;
+	}
+
+	// We've been throttled.  Step out of the pool of workers the dir queue is waiting on, or the
+	// traversal would never be seen as complete.
+	m_dir_queue.adjust_num_workers(-1);
+	LOG(INFO) << "Parking traversal thread " << dirjob_num;
+	m_dirjob_gate->WaitUntilActive(dirjob_num);
+	LOG(INFO) << "Resuming traversal thread " << dirjob_num;
+	m_dir_queue.adjust_num_workers(+1);
+}
 
-void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* current_dirent, DirTraversalStats &stats,
-		std::deque<std::shared_ptr<FileID>> *local_file_queue)
+
+void DirTree::ProcessDirent(const DirToRead &dir, const std::shared_ptr<const IgnoreRules> &ignore_rules,
+		const DirentView &de, DirTraversalStats &stats,
+		std::deque<FileRecord> *local_file_queue,
+		std::deque<DirToRead> *local_dir_queue,
+		const struct stat *known_stat)
 {
+	const std::shared_ptr<FileID> &dse = dir.m_dir;
+
 	struct stat statbuf;
 
 	bool is_dir {false};
@@ -210,13 +566,12 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 	bool is_symlink {false};
 	bool is_unknown {true};
 
-#if defined(_DIRENT_HAVE_D_TYPE)
 	// Reject anything that isn't a directory, a regular file, or a symlink.
 	// If it's DT_UNKNOWN, we'll have to do a stat to find out.
-	is_dir = (current_dirent->d_type == DT_DIR);
-	is_file = (current_dirent->d_type == DT_REG);
-	is_symlink = (current_dirent->d_type == DT_LNK);
-	is_unknown = (current_dirent->d_type == DT_UNKNOWN);
+	is_dir = (de.m_type == DT_DIR);
+	is_file = (de.m_type == DT_REG);
+	is_symlink = (de.m_type == DT_LNK);
+	is_unknown = (de.m_type == DT_UNKNOWN);
 	if(!is_file && !is_dir && !is_symlink && !is_unknown)
 	{
 		// It's a type we don't care about.
@@ -228,10 +583,9 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 		// We know the type from the dirent.
 		stats.m_num_filetype_without_stat++;
 	}
-#endif
-	const char *dname = current_dirent->d_name;
+
 	// Skip "." and "..".
-	if(dname[0] == '.' && (dname[1] == 0 || (dname[1] == '.' && dname[2] == 0)))
+	if(de.m_name == "." || de.m_name == "..")
 	{
 		// Always skip "." and "..", unless they're specified on the command line.
 		stats.m_num_dotdirs_found++;
@@ -253,8 +607,16 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 
 		stats.m_num_filetype_stats++;
 
-		// Stat the filename using the directory as the at-descriptor.
-		dse->FStatAt(dname, &statbuf, AT_NO_AUTOMOUNT | (!m_follow_symlinks ? AT_SYMLINK_NOFOLLOW : 0));
+		if(known_stat != nullptr)
+		{
+			// The caller has already stat()ed it, as part of a batch.
+			statbuf = *known_stat;
+		}
+		else
+		{
+			// Stat the filename using the directory as the at-descriptor.
+			dse->FStatAt(de.m_name.data(), &statbuf, StatFlags());
+		}
 
 		is_dir = S_ISDIR(statbuf.st_mode);
 		is_file = S_ISREG(statbuf.st_mode);
@@ -274,7 +636,7 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 	// Is the file type still unknown?
 	if(is_unknown)
 	{
-		WARN() << "cannot determine file type: " << dname << ", " << statbuf.st_mode;
+		WARN() << "cannot determine file type: " << de.m_name << ", " << statbuf.st_mode;
 		return;
 	}
 
@@ -282,10 +644,9 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 	// Is this a file type we're interested in?
 	if(is_file || is_dir || is_symlink)
 	{
-		// We'll need the file's basename.
-		std::string bname {dirent_get_name(current_dirent)};
-
-		LOG(INFO) << "Considering dirent name='" << bname << "'";
+		// Don't build a std::string of the name unless the filters accept the entry; most entries of a big tree
+		// are usually rejected.
+		LOG(INFO) << "Considering dirent name='" << de.m_name << "'";
 
 		if(is_file)
 		{
@@ -293,21 +654,34 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 			LOG(INFO) << "... normal file.";
 			stats.m_num_files_found++;
 
-			// Check for inclusion.
-			if(m_file_basename_filter(bname))
+			// Check for inclusion.  If the name doesn't decide it, the first line might.
+			bool type_deferred = false;
+			bool include = m_file_basename_filter(de.m_name);
+			if(!include && m_deferred_file_filter && m_deferred_file_filter(de.m_name))
+			{
+				include = true;
+				type_deferred = true;
+			}
+
+			if(include && (ignore_rules == nullptr || !ignore_rules->IsIgnored(*dse, de.m_name, false)))
 			{
 				// Based on the file name, this file should be scanned.
 
-				LOG(INFO) << "... should be scanned.";
+				LOG(INFO) << (type_deferred ? "... should be scanned if its first line matches." : "... should be scanned.");
 
-				std::shared_ptr<FileID> file_to_scan {std::make_shared<FileID>(FileID::path_known_relative_tag(), dse, bname,
-						statbuff_ptr,
-						FT_REG,
-						dse->GetDev(), current_dirent->d_ino,
-						FAM_RDONLY, FCF_NOCTTY | FCF_NOATIME)};
+				FileRecord file_to_scan(dse.get(), de.m_name);
+				file_to_scan.SetTypeDeferred(type_deferred);
+				file_to_scan.SetOnNetworkFilesystem(dir.m_on_network_fs);
 
 				// Queue it up.
-				local_file_queue->push_back(std::move(file_to_scan));
+				if(local_file_queue != nullptr)
+				{
+					local_file_queue->push_back(std::move(file_to_scan));
+				}
+				else
+				{
+					m_out_queue.push_back(std::move(file_to_scan));
+				}
 
 				// Count the number of files we found that were included in the search.
 				stats.m_num_files_scanned++;
@@ -322,16 +696,71 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 			LOG(INFO) << "... directory.";
 			stats.m_num_directories_found++;
 
-			if(!m_recurse || m_dir_basename_filter(bname))
+			if(!m_recurse || dir.m_depth + 1 >= m_max_depth || m_dir_basename_filter(de.m_name))
 			{
-				// This name is in the dir exclude list.  Exclude the dir and all subdirs from the scan.
+				// We're not descending this deep, or this name is in the dir exclude list.  Exclude the dir and all subdirs
+				// from the scan.
 				LOG(INFO) << "... should be ignored.";
 				stats.m_num_dirs_rejected++;
 				return;
 			}
 
-			auto dir_atfd = std::make_shared<FileID>(FileID::path_known_relative_tag(), dse, bname, statbuff_ptr, FT_DIR,
-					dse->GetDev(), current_dirent->d_ino,
+			if(m_dir_path_filter)
+			{
+				std::string_view rel_dir;
+				if(dir.m_depth > 0)
+				{
+					rel_dir = std::string_view(dse->GetPath()).substr(dir.m_start_path_size);
+				}
+				if(m_dir_path_filter(rel_dir, de.m_name))
+				{
+					LOG(INFO) << "... path should be ignored.";
+					stats.m_num_dirs_rejected++;
+					return;
+				}
+			}
+
+			if(ignore_rules != nullptr && ignore_rules->IsIgnored(*dse, de.m_name, true))
+			{
+				LOG(INFO) << "... excluded by an ignore file.";
+				stats.m_num_dirs_rejected++;
+				return;
+			}
+
+			// Is it on another filesystem?  The dirent's inode number can't tell us, since for a mount point it's that
+			// of the directory mounted over.  Only possible mount points are stat()ed to find out.
+			dev_t dev = dse->GetDev();
+			ino_t ino = de.m_ino;
+			bool on_network_fs = dir.m_on_network_fs;
+			if(statbuff_ptr != nullptr && statbuff_ptr->st_dev != dev)
+			{
+				dev = statbuff_ptr->st_dev;
+				ino = statbuff_ptr->st_ino;
+			}
+			else if((m_one_file_system || m_fs_policy) && statbuff_ptr == nullptr && m_mount_table.MightBeMountPoint(de.m_name))
+			{
+				// Don't trigger an automount, and let a network filesystem answer from its cache.
+				int dir_fd = dse->OpenDirDescriptor();
+				if(dir_fd >= 0)
+				{
+					struct stat mount_stat;
+					if(fstatat_minimal(dir_fd, de.m_name.data(), &mount_stat, AT_NO_AUTOMOUNT | AT_SYMLINK_NOFOLLOW, true) == 0
+							&& mount_stat.st_dev != dev)
+					{
+						dev = mount_stat.st_dev;
+						ino = mount_stat.st_ino;
+					}
+					dse->CloseDirDescriptor(dir_fd);
+				}
+			}
+			if(!ShouldDescendInto(dir, de.m_name, dev, on_network_fs, stats))
+			{
+				stats.m_num_dirs_rejected++;
+				return;
+			}
+
+			auto dir_atfd = std::make_shared<FileID>(FileID::path_known_relative_tag(), dse, std::string(de.m_name), statbuff_ptr,
+					FT_DIR, dev, ino,
 					FAM_RDONLY, FCF_DIRECTORY | FCF_NOATIME | FCF_NOCTTY | FCF_NONBLOCK);
 
 			if(m_follow_symlinks)
@@ -346,7 +775,16 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 				}
 			}
 
-			m_dir_queue.push_back(std::move(dir_atfd));
+			if(local_dir_queue != nullptr)
+			{
+				local_dir_queue->push_back(DirToRead{std::move(dir_atfd), ignore_rules, dir.m_depth + 1, dir.m_start_path_size,
+						on_network_fs});
+			}
+			else
+			{
+				m_dir_queue.push_back(DirToRead{std::move(dir_atfd), ignore_rules, dir.m_depth + 1, dir.m_start_path_size,
+						on_network_fs});
+			}
 		}
 		else if(is_symlink)
 		{
@@ -358,7 +796,7 @@ void DirTree::ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent* c
 			else
 			{
 				// Physical traversal, just ignore the symlink.
-				LOG(INFO) << "Found symlink during physical traversal: '" << dse->GetPath() << "/" << bname << "'";
+				LOG(INFO) << "Found symlink during physical traversal: '" << dse->GetPath() << "/" << de.m_name << "'";
 			}
 			return;
 		}
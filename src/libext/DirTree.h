@@ -22,14 +22,23 @@
 
 #include <config.h>
 
+#include <limits>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <functional>
-#include <unordered_set>
 
 /// @todo Break this dependency on the output queue class.
 #include "../sync_queue_impl_selector.h"
+#include "DirentReader.h"
 #include "FileID.h"
+#include "FileRecord.h"
+#include "IgnoreRules.h"
+#include "MountTable.h"
+#include "WorkerGate.hpp"
+#include "ShardedSet.hpp"
+#include "StageTimer.hpp"
+#include "StatBatch.h"
 
 #include <dirent.h>
 
@@ -53,13 +62,18 @@ class DirTraversalStats
 	X("Number of files rejected", m_num_files_rejected) \
 	X("Number of files sent for scanning", m_num_files_scanned) \
 	X("Number of files which required a stat() call to determine type", m_num_filetype_stats) \
-	X("Number of files which did not require a stat() call to determine type", m_num_filetype_without_stat)
+	X("Number of files which did not require a stat() call to determine type", m_num_filetype_without_stat) \
+	X("Number of mount points found", m_num_mount_points_found) \
+	X("Number of mount points not descended into", m_num_mount_points_rejected)
 
 public:
 #define X(d,s) size_t s {0};
 	M_STATLIST
 #undef X
 
+	/// CPU time used by the traversal threads.
+	std::chrono::nanoseconds m_cpu_time {0};
+
 	/**
 	 * Atomic compound assignment by sum.
 	 * Adds the stats from #other to *this in a thread-safe manner.
@@ -72,6 +86,7 @@ public:
 #define X(d,s) s += other. s;
 		M_STATLIST
 #undef X
+		m_cpu_time += other.m_cpu_time;
 	}
 
 	/**
@@ -99,8 +114,13 @@ private:
 };
 
 /// Types of the file and directory include/exclude predicates.
-using file_basename_filter_type = std::function<bool (const std::string& name)>;
-using dir_basename_filter_type = std::function<bool (const std::string& name)>;
+/// The name is only valid for the duration of the call.
+using file_basename_filter_type = std::function<bool (std::string_view name)>;
+using dir_basename_filter_type = std::function<bool (std::string_view name)>;
+
+/// Type of the directory exclusion predicate which also gets the path of the directory's parent, relative to the
+/// starting path it was found under (empty for the starting path itself).
+using dir_path_filter_type = std::function<bool (std::string_view rel_dir, std::string_view name)>;
 
 
 /**
@@ -110,21 +130,86 @@ class DirTree
 {
 public:
 	DirTree() = delete;
-	DirTree(sync_queue<std::shared_ptr<FileID>>& output_queue,
+	DirTree(sync_queue<FileRecord>& output_queue,
+			DirTable &dir_table,
 			const file_basename_filter_type &file_basename_filter,
 			const dir_basename_filter_type &dir_basename_filter,
 			bool recurse,
-			bool follow_symlinks);
+			bool follow_symlinks,
+			bool sort_files = false,
+			WorkerGate *dirjob_gate = nullptr);
 	~DirTree() = default;
 
 	/**
 	 * Begin the directory tree traversal, starting with the given #start_paths.
 	 *
+	 * If sorted traversal was requested in the constructor, the traversal is done by the calling thread in a
+	 * deterministic order: the #start_paths in the order given, and the entries of each directory sorted by name, with
+	 * subdirectories visited depth-first in their sorted position.  Each file is given its position in that order via
+	 * FileRecord::SetSequenceNumber(), and the files are sent to the output queue in that order.
+	 *
 	 * @param start_paths
-	 * @param dirjobs
+	 * @param dirjobs      Number of traversal threads to start.  Ignored if a WorkerGate was given to the constructor,
+	 *                     in which case its max() threads are started, and only its active() threads run at any one time.
+	 *                     Also ignored for a sorted traversal.
 	 */
 	void Scandir(std::vector<std::string> start_paths, int dirjobs);
 
+	/**
+	 * Favor getting the first files to the scanners quickly over throughput.  Normally, the files found in a
+	 * directory are collected up and sent to the output queue in one batch once the whole directory has been read,
+	 * which saves a lot of locking of the queue.  With this set, each file is sent as soon as it's found.
+	 *
+	 * @note Either way, the directory queue is FIFO, so directories are traversed roughly breadth-first, i.e. those
+	 * nearest the starting paths are read first.
+	 */
+	void SetLowLatency(bool low_latency) noexcept { m_low_latency = low_latency; };
+
+	/**
+	 * Skip the files and directories excluded by the .gitignore, .ignore and .ucgignore files of the directories
+	 * traversed; see IgnoreRules.  The ignore files of a directory apply to everything below it, and are checked
+	 * before anything else is done with an entry, so an ignored subtree is never opened.
+	 */
+	void SetUseIgnoreFiles(bool use_ignore_files) noexcept { m_use_ignore_files = use_ignore_files; };
+
+	/**
+	 * Exclude directories which @p dir_path_filter returns true for, in addition to those the basename filter
+	 * excludes.  Only set this if it's needed, since working out the relative paths isn't free.
+	 */
+	void SetDirPathFilter(const dir_path_filter_type &dir_path_filter) { m_dir_path_filter = dir_path_filter; };
+
+	/**
+	 * Queue files which the basename filter rejects, but @p deferred_file_filter accepts, marked with
+	 * FileRecord::SetTypeDeferred(), so that the scanner can decide whether to search them once it's read the start of
+	 * them.  Must be called before Scandir().
+	 */
+	void SetDeferredFileFilter(const file_basename_filter_type &deferred_file_filter) { m_deferred_file_filter = deferred_file_filter; };
+
+	/**
+	 * Descend at most @p max_depth levels below the starting paths.  At 1, only the entries of the starting
+	 * directories are searched, and at 0, only files given as starting paths.  Directories deeper than this are
+	 * neither opened nor queued.
+	 */
+	void SetMaxDepth(size_t max_depth) noexcept { m_max_depth = max_depth; };
+
+	/**
+	 * Don't descend into directories on other filesystems than the starting path they're under, like find -xdev.
+	 * Must be called before Scandir().
+	 */
+	void SetOneFileSystem(bool one_file_system) noexcept { m_one_file_system = one_file_system; };
+
+	/**
+	 * Treat the filesystems of the starting paths, and those mounted below them, according to their FilesystemKind:
+	 * don't descend into pseudo filesystems mounted below the starting paths, such as /proc, and mark the files on
+	 * network and FUSE filesystems with
+	 * FileRecord::SetOnNetworkFilesystem().  The filesystems' kinds come from the MountTable, so they're never asked
+	 * themselves.  Must be called before Scandir().
+	 */
+	void SetFilesystemPolicy(bool fs_policy) noexcept { m_fs_policy = fs_policy; };
+
+	/// The stats of the traversal.  Only complete once Scandir() has returned.
+	[[nodiscard]] const DirTraversalStats& GetStats() const noexcept { return m_stats; };
+
 private:
 
 	/// Flag indicating whether to recurse into subdirectories.
@@ -133,39 +218,150 @@ private:
 	/// Flag indicating whether we should traverse symlinks or not.
 	bool m_follow_symlinks { false };
 
+	/// Flag indicating whether to do a single-threaded, sorted traversal.
+	bool m_sort_files { false };
+
+	/// Flag indicating whether to send files to the output queue one at a time.
+	bool m_low_latency { false };
+
+	/// Flag indicating whether to obey ignore files.
+	bool m_use_ignore_files { false };
+
+	/// How many levels below the starting paths to descend.
+	size_t m_max_depth { std::numeric_limits<size_t>::max() };
+
+	/// Flag indicating whether to stay on the starting paths' filesystems.
+	bool m_one_file_system { false };
+
+	/// Flag indicating whether to skip pseudo filesystems and mark files on network filesystems.
+	bool m_fs_policy { false };
+
+	/// The system's mounts, if either of the above is set.
+	MountTable m_mount_table;
+
+	/// In a sorted traversal, the sequence number to give the next file found.
+	size_t m_next_sequence_number { 0 };
+
 	int m_dirjobs {4};
 
+	/// Optional gate throttling the number of running traversal threads.  Not owned.
+	WorkerGate *m_dirjob_gate { nullptr };
+
+	/// A directory waiting to be read, and the ignore rules which apply to its entries, before its own are added.
+	struct DirToRead
+	{
+		std::shared_ptr<FileID> m_dir;
+		std::shared_ptr<const IgnoreRules> m_ignore_rules;
+
+		/// How far below its starting path the directory is.  The starting paths themselves are at depth 0.
+		size_t m_depth {0};
+
+		/// How much of the start of the directory's path is the starting path, i.e. what to drop from GetPath() to get
+		/// the path relative to the starting path.
+		size_t m_start_path_size {0};
+
+		/// Whether the directory is on a network filesystem.
+		bool m_on_network_fs {false};
+	};
+
 	/// Directory queue.  Used internally.
-	sync_queue<std::shared_ptr<FileID>> m_dir_queue;
+	sync_queue<DirToRead> m_dir_queue;
 
 	/// File output queue.
-	sync_queue<std::shared_ptr<FileID>>& m_out_queue;
+	sync_queue<FileRecord>& m_out_queue;
+
+	/// Where the directories the queued FileRecords point to are kept alive.
+	DirTable &m_dir_table;
 
 	file_basename_filter_type m_file_basename_filter;
 	dir_basename_filter_type m_dir_basename_filter;
+	dir_path_filter_type m_dir_path_filter;
+	file_basename_filter_type m_deferred_file_filter;
 
 	DirTraversalStats m_stats;
 
-	using visited_set = std::unordered_set<dev_ino_pair>;
-	std::mutex m_dir_mutex;
-	visited_set m_dir_has_been_visited;
+	/// The directories we've visited, for detecting symlink cycles.  Sharded so that the traversal threads don't
+	/// all serialize on one lock when following symlinks.
+	ShardedSet<dev_ino_pair> m_dir_has_been_visited;
 	bool HasDirBeenVisited(dev_ino_pair di)
 	{
-		std::lock_guard<std::mutex> lock(m_dir_mutex);
-		return !m_dir_has_been_visited.insert(di).second;
+		return !m_dir_has_been_visited.insert(di);
 	}
 
 	void ReaddirLoop(int dirjob_num);
 
+	/// An entry of a sorted traversal: a directory to descend into, or, if m_dir.m_dir is null, a file.
+	struct SortedEntry
+	{
+		DirToRead m_dir;
+		FileRecord m_file;
+	};
+
 	/**
-	 * Process a single directory entry (dirent) structure #de, with parent #dse.  Push any files found on the #m_out_queue,
-	 * push any directories found on the #m_dir_queue.  Maintain statistics in #stats.
+	 * Do the sorted traversal of the files and directories in #roots, in that order.
 	 *
-	 * @param dse
+	 * @param roots
+	 * @param dirs_with_files  The directories of the files in #roots.  Any others files are found in are added to it.
+	 */
+	void SortedTraversal(std::vector<SortedEntry> roots, std::vector<std::shared_ptr<FileID>> &dirs_with_files);
+
+	/**
+	 * Give #file the next sequence number and add it to #batch.
+	 */
+	void AddInSequence(FileRecord file, std::deque<FileRecord> &batch);
+
+	/**
+	 * Park traversal thread #dirjob_num while m_dirjob_gate says it shouldn't be running.  While parked, the thread is
+	 * removed from the set of workers m_dir_queue waits on for completion.
+	 *
+	 * @param dirjob_num
+	 */
+	void WaitForDirjobGate(int dirjob_num);
+
+	/**
+	 * Process a single directory entry #de, with parent #dir.  Push any files found on #local_file_queue if given,
+	 * or #m_out_queue if not, push any directories found on #local_dir_queue if given, or #m_dir_queue if not.  Maintain statistics in #stats.
+	 * The FileRecords of any files found point to #dir, so the caller has to hand it over to #m_dir_table if there are any.
+	 *
+	 * @param dir
+	 * @param ignore_rules  The ignore rules which apply to the entries of #dir, or null if there are none.
 	 * @param de
+	 * @param known_stat    If #de has to be stat()ed to find out what it is, the result, if the caller already has it.
+	 */
+	void ProcessDirent(const DirToRead &dir, const std::shared_ptr<const IgnoreRules> &ignore_rules,
+			const DirentView &de, DirTraversalStats &stats,
+			std::deque<FileRecord> *local_file_queue,
+			std::deque<DirToRead> *local_dir_queue = nullptr,
+			const struct stat *known_stat = nullptr);
+
+	/// Whether the entry #de has to be stat()ed to find out what it is: its dirent didn't say, or it's a symlink and
+	/// we're following symlinks.
+	bool NeedsStat(const DirentView &de) const noexcept;
+
+	/// Whether the starting path #start_path is on a network filesystem, as far as the filesystem policy goes.  Only
+	/// the MountTable is consulted, never the filesystem itself.
+	bool IsOnNetworkFilesystem(const FileID &start_path) const;
+
+	/**
+	 * Decide whether to descend into the subdirectory #name of #dir, which is on device #dev.  If that's not #dir's
+	 * device, #name is a mount point, and --one-file-system and the filesystem policies decide.
+	 *
+	 * @param on_network_fs  Set to whether the subdirectory is on a network filesystem mounted below its starting
+	 *                       path.
+	 */
+	bool ShouldDescendInto(const DirToRead &dir, std::string_view name, dev_t dev, bool &on_network_fs,
+			DirTraversalStats &stats) const;
+
+	/// The AT_* flags for stat()ing an entry.
+	int StatFlags() const noexcept;
+
+	/**
+	 * Stat the entries of #dir collected in #stat_batch, all at once, then ProcessDirent() each of them.  Empties
+	 * #stat_batch.
 	 */
-	void ProcessDirent(const std::shared_ptr<FileID>& dse, struct dirent *de, DirTraversalStats &stats,
-			std::deque<std::shared_ptr<FileID>> *local_file_queue);
+	void FlushStatBatch(StatBatch &stat_batch, const DirToRead &dir,
+			const std::shared_ptr<const IgnoreRules> &ignore_rules, DirTraversalStats &stats,
+			std::deque<FileRecord> *local_file_queue, std::deque<DirToRead> *local_dir_queue);
 
 };
 
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "DirentReader.h"
+
+#include "FileID.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if HAVE_DECL_SYS_GETDENTS64
+	#include <unistd.h>
+	#include <sys/syscall.h>
+#endif
+
+#if HAVE_DECL_SYS_GETDENTS64
+
+/// Size of the getdents64() buffer.  Big enough that all but the biggest directories are read in one call.
+static constexpr size_t f_getdents_buffer_size = 1024*1024;
+
+/**
+ * The fixed-size start of the records getdents64() returns; see struct linux_dirent64 in getdents(2).  The entry's
+ * NUL-terminated name starts right after d_type, and the record is padded out to d_reclen bytes.
+ */
+struct linux_dirent64_header
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+};
+
+/// Offset of the name in a getdents64() record.
+static constexpr size_t f_name_offset = offsetof(linux_dirent64_header, d_type) + 1;
+
+/// The biggest a getdents64() record can be: a NAME_MAX name and its NUL, padded to a multiple of 8 bytes.
+static constexpr size_t f_max_record_size = (f_name_offset + NAME_MAX + 1 + 7) & ~static_cast<size_t>(7);
+
+#endif
+
+
+DirentReader::~DirentReader()
+{
+	Close();
+}
+
+bool DirentReader::Open(FileID &dir)
+{
+	Close();
+
+#if HAVE_DECL_SYS_GETDENTS64
+	m_fd = dir.OpenDirDescriptor();
+	if(m_fd < 0)
+	{
+		return false;
+	}
+	if(!m_buffer)
+	{
+		m_buffer = std::make_unique<char[]>(f_getdents_buffer_size);
+	}
+	m_pos = m_end = 0;
+	m_at_end = false;
+#else
+	m_dirp = dir.OpenDir();
+	if(m_dirp == nullptr)
+	{
+		return false;
+	}
+#endif
+
+	m_dir = &dir;
+	return true;
+}
+
+bool DirentReader::Next(DirentView &entry)
+{
+#if HAVE_DECL_SYS_GETDENTS64
+	if(m_pos == m_end)
+	{
+		if(m_at_end)
+		{
+			errno = 0;
+			return false;
+		}
+
+		// Refill the buffer.
+		long num_bytes = syscall(SYS_getdents64, m_fd, m_buffer.get(), f_getdents_buffer_size);
+		if(num_bytes <= 0)
+		{
+			// End of the directory, or an error.
+			if(num_bytes == 0)
+			{
+				errno = 0;
+			}
+			return false;
+		}
+		m_pos = 0;
+		m_end = static_cast<size_t>(num_bytes);
+	}
+
+	// Every record is at least as big as the header, since the name and its NUL come after d_type, and the whole
+	// thing is padded to a multiple of 8 bytes.
+	const char *record = m_buffer.get() + m_pos;
+	linux_dirent64_header header;
+	std::memcpy(&header, record, sizeof(header));
+	m_pos += header.d_reclen;
+
+	const char *name = record + f_name_offset;
+	entry.m_name = std::string_view(name, strnlen(name, header.d_reclen - f_name_offset));
+	entry.m_type = header.d_type;
+	entry.m_ino = header.d_ino;
+	return true;
+#else
+	errno = 0;
+	struct dirent *de = readdir(m_dirp);
+	if(de == nullptr)
+	{
+		return false;
+	}
+
+	entry.m_name = std::string_view(de->d_name);
+#if defined(_DIRENT_HAVE_D_TYPE)
+	entry.m_type = de->d_type;
+#else
+	entry.m_type = DT_UNKNOWN;
+#endif
+	entry.m_ino = de->d_ino;
+	return true;
+#endif
+}
+
+bool DirentReader::FindNames(const char *const *names, size_t num_names, bool *found)
+{
+#if HAVE_DECL_SYS_GETDENTS64
+	// Read ahead until the end of the directory, or until the buffer might not have room for the next record.  Unless
+	// the directory is too big for the buffer, these are the calls Next() would have made anyway.
+	while(!m_at_end)
+	{
+		if(f_getdents_buffer_size - m_end < f_max_record_size)
+		{
+			return false;
+		}
+		long num_bytes = syscall(SYS_getdents64, m_fd, m_buffer.get() + m_end, f_getdents_buffer_size - m_end);
+		if(num_bytes < 0)
+		{
+			// Next() will get the error again when it refills the buffer.
+			return false;
+		}
+		m_at_end = (num_bytes == 0);
+		m_end += static_cast<size_t>(num_bytes);
+	}
+
+	std::fill(found, found + num_names, false);
+	for(size_t pos = m_pos; pos < m_end; )
+	{
+		const char *record = m_buffer.get() + pos;
+		linux_dirent64_header header;
+		std::memcpy(&header, record, sizeof(header));
+		pos += header.d_reclen;
+
+		const char *name = record + f_name_offset;
+		for(size_t i = 0; i < num_names; ++i)
+		{
+			if(!found[i] && std::strcmp(name, names[i]) == 0)
+			{
+				found[i] = true;
+			}
+		}
+	}
+	return true;
+#else
+	(void)names;
+	(void)num_names;
+	(void)found;
+	return false;
+#endif
+}
+
+void DirentReader::Close()
+{
+	if(m_dir == nullptr)
+	{
+		return;
+	}
+
+#if HAVE_DECL_SYS_GETDENTS64
+	m_dir->CloseDirDescriptor(m_fd);
+	m_fd = -1;
+#else
+	m_dir->CloseDir(m_dirp);
+	m_dirp = nullptr;
+#endif
+	m_dir = nullptr;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file DirentReader.h */
+
+#ifndef SRC_LIBEXT_DIRENTREADER_H_
+#define SRC_LIBEXT_DIRENTREADER_H_
+
+#include <config.h>
+
+#include <memory>
+#include <string_view>
+
+#include <sys/types.h>
+#include <dirent.h>
+
+class FileID;
+
+/**
+ * A view of one directory entry, valid until the next call to DirentReader::Next() or DirentReader::Close().
+ */
+struct DirentView
+{
+	/// The entry's name.  It's NUL-terminated, i.e. m_name.data() can be passed to the *at() functions.
+	std::string_view m_name;
+
+	/// The DT_* type of the entry, DT_UNKNOWN if the filesystem didn't say.
+	unsigned char m_type;
+
+	ino_t m_ino;
+};
+
+/**
+ * Reads the entries of a directory.  Where the OS lets us, this is done with raw getdents64() calls into a large buffer,
+ * which the entries are then read from in place.  Compared to readdir(), whose libc buffer only holds a few dozen KB
+ * of entries, that's a small fraction of the system calls on a big directory.
+ *
+ * The buffer is allocated on the first Open() and kept until the DirentReader is destroyed, so each traversal thread
+ * should have its own DirentReader and reuse it for every directory.
+ */
+class DirentReader
+{
+public:
+	DirentReader() = default;
+	~DirentReader();
+
+	DirentReader(const DirentReader&) = delete;
+	DirentReader& operator=(const DirentReader&) = delete;
+
+	/**
+	 * Start reading the entries of the directory @p dir, closing any directory which was already open.  In between this
+	 * and Close(), @p dir's FStatAt() can be used.
+	 *
+	 * @return false, with errno set, if the directory couldn't be opened.
+	 */
+	bool Open(FileID &dir);
+
+	/**
+	 * Get the next entry, including "." and "..".
+	 *
+	 * @return false at the end of the directory, with errno set to 0, or on an error, with errno set.
+	 */
+	bool Next(DirentView &entry);
+
+	/**
+	 * Find which of @p names are entries of the directory, without consuming any entries, if that can be done without
+	 * asking the filesystem about each name, i.e. if all the entries fit in the buffer.  Must be called before the
+	 * first Next().
+	 *
+	 * @param found  Set to whether each of the @p num_names @p names is an entry, if this returns true.
+	 * @return false if the entries don't all fit in the buffer, or can't be read ahead.
+	 */
+	bool FindNames(const char *const *names, size_t num_names, bool *found);
+
+	/// Close the directory, if one is open.
+	void Close();
+
+private:
+
+	/// The directory being read, if any.
+	FileID *m_dir { nullptr };
+
+#if HAVE_DECL_SYS_GETDENTS64
+	int m_fd { -1 };
+
+	std::unique_ptr<char[]> m_buffer;
+
+	/// The start of the next unread record in m_buffer, and the end of the records in it.
+	size_t m_pos { 0 };
+	size_t m_end { 0 };
+
+	/// Set once getdents64() has returned 0, i.e. the records in m_buffer are the last.
+	bool m_at_end { false };
+#else
+	DIR *m_dirp { nullptr };
+#endif
+};
+
+#endif /* SRC_LIBEXT_DIRENTREADER_H_ */
@@ -21,17 +21,193 @@
 
 #include "FileDescriptorCache.h"
 
-#include "filesystem.hpp"
+#include <algorithm>
 
+#include <unistd.h> // For close().
+#include <sys/resource.h>
 
-FileDescriptorCache::FileDescriptorCache()
-{
-	// TODO Auto-generated constructor stub
 
+/// Bounds on the default cap.  The upper one is for when RLIMIT_NOFILE is huge or unlimited.
+static constexpr size_t f_min_default_capacity = 16;
+static constexpr size_t f_max_default_capacity = 65536;
+
+FileDescriptorCache::FileDescriptorCache(size_t capacity)
+{
+	SetCapacity(capacity);
 }
 
 FileDescriptorCache::~FileDescriptorCache()
 {
-	// TODO Auto-generated destructor stub
+	for(auto &e : m_entries)
+	{
+		close(e.second.m_fd);
+	}
+}
+
+void FileDescriptorCache::SetCapacity(size_t capacity) noexcept
+{
+	m_capacity = (capacity != 0) ? capacity : DefaultCapacity();
+}
+
+size_t FileDescriptorCache::DefaultCapacity() noexcept
+{
+	struct rlimit rl;
+
+	if(getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY)
+	{
+		return f_max_default_capacity;
+	}
+
+	return std::clamp(static_cast<size_t>(rl.rlim_cur / 2), f_min_default_capacity, f_max_default_capacity);
+}
+
+int FileDescriptorCache::TryAcquire(const void *key) noexcept
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	auto it = m_entries.find(key);
+	if(it == m_entries.end())
+	{
+		return -1;
+	}
+
+	Entry &e = it->second;
+	if(e.m_pins++ == 0)
+	{
+		m_lru.erase(e.m_lru_pos);
+	}
+	return e.m_fd;
+}
+
+int FileDescriptorCache::Insert(const void *key, int fd)
+{
+	std::vector<int> to_close;
+	int retval;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto [it, inserted] = m_entries.try_emplace(key, Entry{fd, 1, m_lru.end()});
+		if(inserted)
+		{
+			++m_stats.m_opens;
+			retval = fd;
+		}
+		else
+		{
+			// Someone else opened it while we were, use theirs.
+			Entry &e = it->second;
+			if(e.m_pins++ == 0)
+			{
+				m_lru.erase(e.m_lru_pos);
+			}
+			to_close.push_back(fd);
+			retval = e.m_fd;
+		}
+
+		EvictToCapacity(to_close);
+		m_stats.m_max_open = std::max(m_stats.m_max_open, m_entries.size());
+	}
+
+	for(int cfd : to_close)
+	{
+		close(cfd);
+	}
+
+	return retval;
+}
+
+void FileDescriptorCache::Release(const void *key) noexcept
+{
+	std::vector<int> to_close;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_entries.find(key);
+		if(it == m_entries.end() || it->second.m_pins == 0)
+		{
+			return;
+		}
+
+		Entry &e = it->second;
+		if(--e.m_pins == 0)
+		{
+			m_lru.push_front(key);
+			e.m_lru_pos = m_lru.begin();
+			EvictToCapacity(to_close);
+		}
+	}
+
+	for(int fd : to_close)
+	{
+		close(fd);
+	}
+}
+
+void FileDescriptorCache::Erase(const void *key) noexcept
+{
+	int fd;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto it = m_entries.find(key);
+		if(it == m_entries.end())
+		{
+			return;
+		}
+
+		fd = it->second.m_fd;
+		if(it->second.m_pins == 0)
+		{
+			m_lru.erase(it->second.m_lru_pos);
+		}
+		m_entries.erase(it);
+	}
+
+	close(fd);
 }
 
+size_t FileDescriptorCache::EvictUnpinned() noexcept
+{
+	std::vector<int> to_close;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		for(const void *key : m_lru)
+		{
+			auto it = m_entries.find(key);
+			to_close.push_back(it->second.m_fd);
+			m_entries.erase(it);
+		}
+		m_lru.clear();
+		m_stats.m_evictions += to_close.size();
+	}
+
+	for(int fd : to_close)
+	{
+		close(fd);
+	}
+
+	return to_close.size();
+}
+
+FileDescriptorCache::Stats FileDescriptorCache::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
+
+void FileDescriptorCache::EvictToCapacity(std::vector<int> &to_close)
+{
+	while(m_entries.size() > m_capacity && !m_lru.empty())
+	{
+		auto it = m_entries.find(m_lru.back());
+		to_close.push_back(it->second.m_fd);
+		m_entries.erase(it);
+		m_lru.pop_back();
+		++m_stats.m_evictions;
+	}
+}
@@ -22,21 +22,128 @@
 
 #include <config.h>
 
-#include "FileDescriptor.hpp"
-#include "filesystem.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
-/*
+/**
+ * A thread-safe LRU cache of open file descriptors, with a cap on how many it keeps open at once.
  *
+ * Each descriptor belongs to a key (for FileID, its impl), and is opened on demand by the opener the caller passes to
+ * Acquire().  A descriptor is pinned from Acquire() until the matching Release(), and only unpinned descriptors are
+ * ever closed to make room, so an evicted descriptor is simply reopened by the next Acquire() of its key.  If more
+ * descriptors than the cap are pinned at once, the cache grows past the cap until enough of them are released.
  */
 class FileDescriptorCache
 {
 public:
-	FileDescriptorCache();
+	/// Counts for the --stats report.
+	struct Stats
+	{
+		size_t m_opens {0};
+		size_t m_evictions {0};
+		size_t m_max_open {0};
+	};
+
+	/// @param capacity  The most unpinned descriptors to keep open, or 0 for DefaultCapacity().
+	explicit FileDescriptorCache(size_t capacity = 0);
+
+	/// Closes every descriptor still in the cache.
 	~FileDescriptorCache();
 
+	FileDescriptorCache(const FileDescriptorCache&) = delete;
+	FileDescriptorCache& operator=(const FileDescriptorCache&) = delete;
+
+	/// Set the cap, 0 meaning DefaultCapacity().  Not thread-safe, call before the cache is shared.
+	void SetCapacity(size_t capacity) noexcept;
+
+	[[nodiscard]] size_t GetCapacity() const noexcept { return m_capacity; };
+
+	/**
+	 * The default cap: half of the soft RLIMIT_NOFILE, which leaves the other half for the files being searched,
+	 * the output, and anything else the process has open.
+	 */
+	static size_t DefaultCapacity() noexcept;
+
+	/**
+	 * Get the descriptor for @p key and pin it.  If it isn't in the cache, @p opener is called, without any lock held,
+	 * to open it.  If that fails with EMFILE or ENFILE, every unpinned descriptor is closed and @p opener is tried once
+	 * more.
+	 *
+	 * @param key     Identifies the descriptor.  Must stay valid until Erase(key) is called.
+	 * @param opener  Callable returning a new file descriptor, or -1 with errno set.  The cache takes ownership of it.
+	 * @return  The descriptor, which stays open at least until the matching Release(), or -1 with errno set.
+	 */
+	template <typename Opener>
+	int Acquire(const void *key, Opener &&opener)
+	{
+		int fd = TryAcquire(key);
+		if(fd >= 0)
+		{
+			return fd;
+		}
+
+		fd = opener();
+		if(fd < 0 && (errno == EMFILE || errno == ENFILE) && EvictUnpinned() > 0)
+		{
+			fd = opener();
+		}
+		if(fd < 0)
+		{
+			return -1;
+		}
+
+		return Insert(key, fd);
+	}
+
+	/// Unpin the descriptor of @p key, which was returned by Acquire().
+	void Release(const void *key) noexcept;
+
+	/// Close the descriptor of @p key, if it's in the cache.  Call when @p key goes away.
+	void Erase(const void *key) noexcept;
+
+	/// Close all unpinned descriptors.  @return The number closed.
+	size_t EvictUnpinned() noexcept;
+
+	[[nodiscard]] Stats GetStats() const;
+
 private:
 
+	/// If @p key's descriptor is in the cache, pin it and return it, else return -1.
+	int TryAcquire(const void *key) noexcept;
+
+	/// Add the newly opened @p fd as @p key's descriptor and pin it.  If another thread beat us to it, @p fd is
+	/// closed and theirs is returned instead.
+	int Insert(const void *key, int fd);
+
+	/// Remove unpinned entries, least recently used first, until no more than #m_capacity remain open.  Must be called
+	/// with #m_mutex held.  Their descriptors are added to @p to_close, to be closed after the lock is released.
+	void EvictToCapacity(std::vector<int> &to_close);
+
+	struct Entry
+	{
+		int m_fd;
+
+		/// Number of Acquire()s not yet Release()d.
+		unsigned int m_pins;
+
+		/// Position in #m_lru, valid only if m_pins == 0.
+		std::list<const void*>::iterator m_lru_pos;
+	};
+
+	mutable std::mutex m_mutex;
+
+	size_t m_capacity;
+
+	std::unordered_map<const void*, Entry> m_entries;
+
+	/// Keys of the unpinned entries, most recently released first.
+	std::list<const void*> m_lru;
 
+	Stats m_stats;
 };
 
 #endif /* SRC_LIBEXT_FILEDESCRIPTORCACHE_H_ */
@@ -25,13 +25,40 @@
 
 #include "FileID.h"
 
+#include <atomic>
+
 #include <fcntl.h> // For AT_FDCWD, AT_NO_AUTOMOUNT
 #include <unistd.h> // For close().
 #include <sys/stat.h>
 
 #include "DoubleCheckedLock.hpp"
+#include "FileDescriptorCache.h"
+#include "StatBatch.h"
+
+/// The descriptors of the directories, shared by all FileIDs.  Files are opened with openat() relative to these, as
+/// are subdirectories, so the cache is what keeps deep or wide trees from running us out of file descriptors.
+static FileDescriptorCache f_dir_fd_cache;
 
-#define M_ENABLE_FD_STATS 0
+/**
+ * Whether an object's directory descriptor has ever been put in #f_dir_fd_cache under the object's address.  Any
+ * number of threads can set it at once.  Since it's about the object's address, it doesn't go along with a copy or
+ * move: a new object starts out not in the cache, and one assigned to stays in it if it was.
+ */
+class DirFdCachedFlag
+{
+public:
+	DirFdCachedFlag() = default;
+	DirFdCachedFlag(const DirFdCachedFlag&) noexcept {};
+	DirFdCachedFlag& operator=(const DirFdCachedFlag&) noexcept { return *this; };
+
+	/// Relaxed is enough, since the flag is only read by the destructor of its object, which runs after the last of
+	/// the threads which might set it has dropped its reference.
+	void set() noexcept { m_flag.store(true, std::memory_order_relaxed); };
+	[[nodiscard]] bool get() const noexcept { return m_flag.load(std::memory_order_relaxed); };
+
+private:
+	std::atomic<bool> m_flag { false };
+};
 
 /**
  * pImpl factorization of the FileID class.  This is the unsynchronized "pImpl" part which holds all the data.
@@ -66,6 +93,10 @@ public:
 		{
 			close(m_file_descriptor);
 		}
+		if(m_dir_fd_cached.get())
+		{
+			f_dir_fd_cache.Erase(this);
+		}
 	}
 
 	const std::string& GetBasename() const noexcept;
@@ -78,12 +109,24 @@ public:
 //protected:
 	static std::ostream& dump_stats(std::ostream &ostrm, const FileID::impl &impl)
 	{
-		return ostrm << "Max descriptors, regular: " << FileID::impl::m_atomic_fd_max_reg << "\n"
-				<< "Max descriptors, dir: " << FileID::impl::m_atomic_fd_max_dir << "\n"
-				<< "Max descriptors, other: " << FileID::impl::m_atomic_fd_max_other << "\n";
+		auto stats = f_dir_fd_cache.GetStats();
+		return ostrm << "Directory descriptors opened: " << stats.m_opens << "\n"
+				<< "Directory descriptors evicted: " << stats.m_evictions << "\n"
+				<< "Max directory descriptors open: " << stats.m_max_open << "\n";
 	}
 
-	int GetTempDirFileDesc() const noexcept;
+	/**
+	 * Get this directory's file descriptor from #f_dir_fd_cache, opening it relative to its parent if it isn't there,
+	 * and pin it there until ReleaseDirFileDesc().
+	 *
+	 * @return The descriptor, or -1 with errno set.
+	 */
+	int AcquireDirFileDesc() const noexcept;
+
+	void ReleaseDirFileDesc() const noexcept;
+
+	/// Open this directory with openat() relative to its parent's descriptor, or by its path if there's no parent.
+	int OpenDirAt() const noexcept;
 
 //private:
 
@@ -116,9 +159,9 @@ public:
 	/// The file descriptor.
 	mutable int m_file_descriptor = -987;
 
-	/// A temporary file descriptor which will be valid only between a call to OpenDir() and
-	/// the subsequent call to CloseDir().  Used for caching the AT-dir descriptor for FStatAt().
-	mutable int m_temp_dir_file_descriptor = -987;
+	/// Whether this directory's descriptor has ever been put in #f_dir_fd_cache, so it has to be erased from it on
+	/// destruction.  Set by whichever threads acquire the descriptor, possibly several at once.
+	mutable DirFdCachedFlag m_dir_fd_cached;
 
 	/// @name Info normally gathered from a stat() call.
 	///@{
@@ -140,10 +183,6 @@ public:
 	mutable blkcnt_t m_blocks { 0 };
 	///@}
 
-	// Stats
-	static std::atomic<std::uint64_t> m_atomic_fd_max_reg;
-	static std::atomic<std::uint64_t> m_atomic_fd_max_dir;
-	static std::atomic<std::uint64_t> m_atomic_fd_max_other;
 };
 
 /// @name Compile-time invariants for the FileID::impl class.
@@ -191,11 +230,6 @@ const std::string& FileID::impl::GetBasename() const noexcept
 	return m_basename;
 };
 
-// Stats
-std::atomic<std::uint64_t> FileID::impl::m_atomic_fd_max_reg;
-std::atomic<std::uint64_t> FileID::impl::m_atomic_fd_max_dir;
-std::atomic<std::uint64_t> FileID::impl::m_atomic_fd_max_other;
-
 FileID::IsValid FileID::impl::GetFileDescriptor()
 {
 	if(m_file_descriptor < 0)
@@ -207,34 +241,14 @@ FileID::IsValid FileID::impl::GetFileDescriptor()
 			throw std::runtime_error("m_open_flags is not set");
 		}
 
-#if M_ENABLE_FD_STATS
-		// Maintain stats on the number of openat()s we do for each of FT_REG/FT_DIR.
-		switch(m_file_type)
-		{
-		case FT_REG:
-		{
-			m_atomic_fd_max_reg++;
-			break;
-		}
-		case FT_DIR:
-		{
-			m_atomic_fd_max_dir++;
-			break;
-		}
-		default:
-		{
-			m_atomic_fd_max_other++;
-			break;
-		}
-		}
-#endif
-
 		if(m_at_dir)
 		{
 			int tempfd = -1;
 
 			ResolvePath();
-			tempfd = open(m_path.c_str(), m_open_flags);
+
+			// Open the file relative to its directory, which saves the kernel walking the whole path again.
+			tempfd = m_at_dir->OpenAt(m_basename.c_str(), m_open_flags);
 			if(unlikely(tempfd == -1))
 			{
 				throw FileException("GetFileDescriptor(): open(" + m_path + ") failed");
@@ -253,28 +267,50 @@ void FileID::impl::SetDevIno(dev_t d, ino_t i) noexcept
 	m_unique_file_identifier = dev_ino_pair(d, i);
 }
 
-int FileID::impl::GetTempDirFileDesc() const noexcept
+int FileID::impl::AcquireDirFileDesc() const noexcept
 {
-	if(m_temp_dir_file_descriptor >= 0)
+	if(m_file_descriptor >= 0)
 	{
-		return m_temp_dir_file_descriptor;
+		// We have a "permanent" file descriptor, e.g. this is the cwd.
+		return m_file_descriptor;
 	}
-	else
+
+	int fd = f_dir_fd_cache.Acquire(this, [this](){ return OpenDirAt(); });
+	if(fd >= 0)
 	{
-		// See if we already have a "permanent" file desc. we can dup().
-		if(m_file_descriptor >= 0)
-		{
-			m_temp_dir_file_descriptor = dup(m_file_descriptor);
-		}
-		else
+		m_dir_fd_cached.set();
+	}
+	return fd;
+}
+
+void FileID::impl::ReleaseDirFileDesc() const noexcept
+{
+	if(m_file_descriptor < 0)
+	{
+		f_dir_fd_cache.Release(this);
+	}
+}
+
+int FileID::impl::OpenDirAt() const noexcept
+{
+	constexpr int flags = O_RDONLY | O_NOATIME | O_NOCTTY | O_DIRECTORY;
+
+	if(m_at_dir)
+	{
+		// This reopens the parent too if it's been evicted, and so on up the tree.
+		int at_fd = m_at_dir->m_pimpl->AcquireDirFileDesc();
+		if(at_fd >= 0)
 		{
-			// Create a new temp file descriptor.
-			ResolvePath();
-			m_temp_dir_file_descriptor = open(m_path.c_str(), O_RDONLY | O_NOATIME | O_NOCTTY | O_DIRECTORY);
+			int fd = openat(at_fd, m_basename.c_str(), flags);
+			int saved_errno = errno;
+			m_at_dir->m_pimpl->ReleaseDirFileDesc();
+			errno = saved_errno;
+			return fd;
 		}
 	}
 
-	return m_temp_dir_file_descriptor;
+	ResolvePath();
+	return open(m_path.c_str(), flags);
 }
 
 FileID::IsValid FileID::impl::LazyLoadStatInfo() const noexcept
@@ -295,12 +331,12 @@ FileID::IsValid FileID::impl::LazyLoadStatInfo() const noexcept
 	if(m_file_descriptor >= 0)
 	{
 		// We have a file descriptor, stat it directly.
-		int status = fstat(m_file_descriptor, &stat_buf);
+		int status = fstatat_minimal(m_file_descriptor, "", &stat_buf, 0);
 		fstat_success = (status == 0);
 	}
 	else
 	{
-		fstat_success = m_at_dir->FStatAt(m_basename, &stat_buf, AT_NO_AUTOMOUNT);
+		fstat_success = m_at_dir->FStatAt(m_basename.c_str(), &stat_buf, AT_NO_AUTOMOUNT);
 	}
 
 	if(fstat_success)
@@ -571,29 +607,69 @@ void FileID::SetFileDescriptorMode(FileAccessMode fam, FileCreationFlag fcf)
 	}
 }
 
-#if 0
-FileID FileID::OpenAt(const std::string &name, FileType type, int flags)
+int FileID::OpenAt(const char *name, int flags) const noexcept
 {
-	FileID retval;
+	int at_fd = m_pimpl->AcquireDirFileDesc();
+	if(at_fd < 0)
+	{
+		return -1;
+	}
+
+	int fd = openat(at_fd, name, flags);
+	if(fd == -1 && (errno == EMFILE || errno == ENFILE) && f_dir_fd_cache.EvictUnpinned() > 0)
+	{
+		fd = openat(at_fd, name, flags);
+	}
+
+	int saved_errno = errno;
+	m_pimpl->ReleaseDirFileDesc();
+	errno = saved_errno;
 
-	/// @todo
-	return retval;
+	return fd;
 }
-#endif
 
 DIR *FileID::OpenDir()
 {
-	int fd = m_pimpl->GetTempDirFileDesc();
+	int fd = m_pimpl->AcquireDirFileDesc();
+	if(fd < 0)
+	{
+		return nullptr;
+	}
 
-	return fdopendir(fd);
+	// closedir() closes the descriptor it was given, and the cache owns this one, so give it a dup().
+	int dir_fd = dup(fd);
+	DIR *d = (dir_fd >= 0) ? fdopendir(dir_fd) : nullptr;
+	if(d == nullptr)
+	{
+		int saved_errno = errno;
+		if(dir_fd >= 0)
+		{
+			close(dir_fd);
+		}
+		m_pimpl->ReleaseDirFileDesc();
+		errno = saved_errno;
+	}
+
+	return d;
 }
 
-bool FileID::FStatAt(const std::string &name, struct stat *statbuf, int flags)
+int FileID::OpenDirDescriptor()
 {
-	int atdir_fd = m_pimpl->m_temp_dir_file_descriptor;
+	return m_pimpl->AcquireDirFileDesc();
+}
+
+bool FileID::FStatAt(const char *name, struct stat *statbuf, int flags)
+{
+	int atdir_fd = m_pimpl->AcquireDirFileDesc();
 
 	// Stat the file.
-	int retval = fstatat(atdir_fd, name.c_str(), statbuf, flags);
+	int retval = (atdir_fd >= 0) ? fstatat_minimal(atdir_fd, name, statbuf, flags) : -1;
+	int saved_errno = errno;
+	if(atdir_fd >= 0)
+	{
+		m_pimpl->ReleaseDirFileDesc();
+	}
+	errno = saved_errno;
 
 	if(retval == -1)
 	{
@@ -607,8 +683,24 @@ bool FileID::FStatAt(const std::string &name, struct stat *statbuf, int flags)
 }
 void FileID::CloseDir(DIR *d)
 {
-	m_pimpl->m_temp_dir_file_descriptor = -987;
 	closedir(d);
+	m_pimpl->ReleaseDirFileDesc();
+}
+
+void FileID::CloseDirDescriptor(int)
+{
+	// The descriptor stays in the cache, for opening the files and subdirectories in this directory.
+	m_pimpl->ReleaseDirFileDesc();
+}
+
+void FileID::SetDirDescriptorCacheCapacity(size_t capacity) noexcept
+{
+	f_dir_fd_cache.SetCapacity(capacity);
+}
+
+FileID::DirDescriptorStats FileID::GetDirDescriptorStats()
+{
+	return f_dir_fd_cache.GetStats();
 }
 
 int FileID::GetFileDescriptor()
@@ -38,6 +38,7 @@
 #include "integer.hpp"
 #include "filesystem.hpp"
 #include "FileDescriptor.hpp"
+#include "FileDescriptorCache.h"
 
 
 /// File Types enum.
@@ -204,13 +205,18 @@ public:
 	 */
 	void SetFileDescriptorMode(FileAccessMode fam, FileCreationFlag fcf);
 
-#if 0
-	FileID OpenAt(const std::string &name, FileType type, int flags);
-#endif
+	/**
+	 * Open @p name relative to the directory this FileID represents, with openat() on the directory's cached
+	 * descriptor.
+	 *
+	 * @return The new file descriptor, or -1 with errno set.
+	 */
+	int OpenAt(const char *name, int flags) const noexcept;
 
 	/**
 	 * Open the directory referenced by this FileID.
-	 * Consumes one file descriptor until CloseDir() is called.
+	 * Consumes one file descriptor until CloseDir() is called, and pins the directory's descriptor in the directory
+	 * descriptor cache until then.
 	 *
 	 * @todo Derived class for dirs?
      *
@@ -219,18 +225,45 @@ public:
 	DIR *OpenDir();
 
 	/**
-	 * Stat the given filename at the directory represented by this.
+	 * Open the directory referenced by this FileID for reading its entries directly, e.g. with getdents64(), instead of
+	 * through a DIR *.  The descriptor belongs to the directory descriptor cache, which won't close it until
+	 * CloseDirDescriptor() is called.
 	 *
-	 * @note Only makes sense to call on FileIDs representing directories where OpenDir() has been called.
+	 * @return The file descriptor, or -1 on error.
+	 */
+	int OpenDirDescriptor();
+
+	/**
+	 * Stat the given filename at the directory represented by this.  The directory's descriptor is reopened if it has
+	 * been evicted from the directory descriptor cache.  Only the fields fstatat_minimal() fills in are valid.
+	 *
+	 * @note Only makes sense to call on FileIDs representing directories.
 	 *
 	 * @param name
 	 * @param statbuf
 	 * @param flags
 	 */
-	bool FStatAt(const std::string &name, struct stat *statbuf, int flags);
+	bool FStatAt(const char *name, struct stat *statbuf, int flags);
 
 	void CloseDir(DIR* d);
 
+	/// Release @p fd, which was returned by OpenDirDescriptor().  It's left open in the cache, where it can be
+	/// evicted.
+	void CloseDirDescriptor(int fd);
+
+	/// @name The directory descriptor cache.
+	/// Directory descriptors are shared by all FileIDs through an LRU cache, and files and subdirectories are opened
+	/// relative to them.  Evicted ones are transparently reopened relative to their parents when they're next needed.
+	///@{
+	using DirDescriptorStats = FileDescriptorCache::Stats;
+
+	/// Set the most directory descriptors to keep open at once, 0 for the default of half the soft RLIMIT_NOFILE.
+	/// Not thread-safe, call before any traversal starts.
+	static void SetDirDescriptorCacheCapacity(size_t capacity) noexcept;
+
+	static DirDescriptorStats GetDirDescriptorStats();
+	///@}
+
 	/**
 	 * Returns the system file descriptor for the file.
 	 *
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "FileRecord.h"
+
+#include "FileID.h"
+
+#include <cstring>
+#include <iterator>
+
+static_assert(sizeof(FileRecord) <= 64, "FileRecord should fit in a cache line.");
+
+
+FileRecord::FileRecord(const FileID *dir, std::string_view basename) : m_dir(dir)
+{
+	AssignName(basename);
+}
+
+FileRecord::FileRecord(const FileRecord &other) : m_dir(other.m_dir), m_sequence_number(other.m_sequence_number),
+	m_type_deferred(other.m_type_deferred), m_on_network_fs(other.m_on_network_fs)
+{
+	AssignName(other.GetBasename());
+}
+
+FileRecord::FileRecord(FileRecord &&other) noexcept
+	: m_dir(other.m_dir), m_sequence_number(other.m_sequence_number), m_name_size(other.m_name_size),
+	  m_type_deferred(other.m_type_deferred), m_on_network_fs(other.m_on_network_fs)
+{
+	if(other.is_heap())
+	{
+		// Take its buffer.
+		m_heap = other.m_heap;
+		other.m_name_size = 0;
+		other.m_inline[0] = '\0';
+	}
+	else
+	{
+		std::memcpy(m_inline, other.m_inline, m_name_size+1);
+	}
+}
+
+FileRecord& FileRecord::operator=(const FileRecord &other)
+{
+	if(this != &other)
+	{
+		FreeName();
+		m_name_size = 0;
+		m_dir = other.m_dir;
+		m_sequence_number = other.m_sequence_number;
+		m_type_deferred = other.m_type_deferred;
+		m_on_network_fs = other.m_on_network_fs;
+		AssignName(other.GetBasename());
+	}
+	return *this;
+}
+
+FileRecord& FileRecord::operator=(FileRecord &&other) noexcept
+{
+	if(this != &other)
+	{
+		FreeName();
+		m_dir = other.m_dir;
+		m_sequence_number = other.m_sequence_number;
+		m_type_deferred = other.m_type_deferred;
+		m_on_network_fs = other.m_on_network_fs;
+		m_name_size = other.m_name_size;
+		if(other.is_heap())
+		{
+			m_heap = other.m_heap;
+			other.m_name_size = 0;
+			other.m_inline[0] = '\0';
+		}
+		else
+		{
+			std::memcpy(m_inline, other.m_inline, m_name_size+1);
+		}
+	}
+	return *this;
+}
+
+void FileRecord::AssignName(std::string_view name)
+{
+	char *buffer = m_inline;
+	if(name.size() > cm_inline_capacity)
+	{
+		buffer = new char[name.size()+1];
+		m_heap = buffer;
+	}
+	std::memcpy(buffer, name.data(), name.size());
+	buffer[name.size()] = '\0';
+	m_name_size = static_cast<uint32_t>(name.size());
+}
+
+std::string FileRecord::GetPath() const
+{
+	std::string_view bname = GetBasename();
+
+	if(is_pathname_absolute(bname))
+	{
+		return std::string(bname);
+	}
+
+	const std::string& at_path = m_dir->GetPath();
+	if(at_path.length() == 1 && at_path[0] == '.')
+	{
+		// This is the AT_FDCWD.
+		return std::string(bname);
+	}
+
+	std::string retval;
+	retval.reserve(at_path.length() + bname.size() + 1);
+	retval.append(at_path);
+	retval.append("/", 1);
+	retval.append(bname);
+	return retval;
+}
+
+int FileRecord::Open(int flags) const noexcept
+{
+	return m_dir->OpenAt(name_data(), flags);
+}
+
+
+void DirTable::Adopt(std::vector<std::shared_ptr<FileID>> &dirs)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_dirs.insert(m_dirs.end(), std::make_move_iterator(dirs.begin()), std::make_move_iterator(dirs.end()));
+	dirs.clear();
+}
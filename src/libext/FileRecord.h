@@ -0,0 +1,153 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file FileRecord.h */
+
+#ifndef SRC_LIBEXT_FILERECORD_H_
+#define SRC_LIBEXT_FILERECORD_H_
+
+#include <config.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class FileID;
+
+/**
+ * A compact record of one file found by the directory traversal, for handing off to the scanners.
+ *
+ * Unlike a FileID, a FileRecord is immutable once it's been queued, so it needs no locking, and it's a plain value:
+ * its directory is a pointer into a DirTable rather than a shared_ptr, and its basename is stored inline unless it's
+ * unusually long, so for almost all files creating one allocates nothing.  The file's stat info isn't cached; the
+ * scanner gets it from the open descriptor.
+ */
+class FileRecord
+{
+public:
+	FileRecord() noexcept { m_inline[0] = '\0'; };
+
+	/**
+	 * @param dir       The directory @p basename is relative to.  Must be kept alive, e.g. by a DirTable, for as long
+	 *                  as this record or any copy of it exists.
+	 * @param basename  The file's name relative to @p dir.  May also be a longer relative path, or an absolute one.
+	 */
+	FileRecord(const FileID *dir, std::string_view basename);
+
+	FileRecord(const FileRecord &other);
+	FileRecord(FileRecord &&other) noexcept;
+	FileRecord& operator=(const FileRecord &other);
+	FileRecord& operator=(FileRecord &&other) noexcept;
+	~FileRecord() { FreeName(); };
+
+	[[nodiscard]] const FileID* GetDir() const noexcept { return m_dir; };
+
+	/// The name relative to GetDir().  NUL-terminated.
+	[[nodiscard]] std::string_view GetBasename() const noexcept { return std::string_view(name_data(), m_name_size); };
+
+	/// The path of the file, built the same way as FileID::GetPath().
+	[[nodiscard]] std::string GetPath() const;
+
+	/// @name Sequence number.
+	/// The position of this file in the traversal order, for ordered output (--sort-files).  Set by the traversal
+	/// before the record is queued.
+	///@{
+	[[nodiscard]] size_t GetSequenceNumber() const noexcept { return m_sequence_number; };
+	void SetSequenceNumber(size_t seq) noexcept { m_sequence_number = seq; };
+	///@}
+
+	/// @name Deferred type.
+	/// Set by the traversal if the file's name didn't decide whether it's of a type being searched, and its first
+	/// line has to, once the scanner has read it.
+	///@{
+	[[nodiscard]] bool IsTypeDeferred() const noexcept { return m_type_deferred; };
+	void SetTypeDeferred(bool type_deferred) noexcept { m_type_deferred = type_deferred; };
+	///@}
+
+	/// @name Network filesystem.
+	/// Set by the traversal if the file is on a network filesystem mounted below the paths searched, so that the
+	/// scanners can limit how many such files they read at once.
+	///@{
+	[[nodiscard]] bool IsOnNetworkFilesystem() const noexcept { return m_on_network_fs; };
+	void SetOnNetworkFilesystem(bool on_network_fs) noexcept { m_on_network_fs = on_network_fs; };
+	///@}
+
+	/**
+	 * Open the file with @p flags, relative to its directory's cached descriptor.
+	 *
+	 * @return The new file descriptor, or -1 with errno set.
+	 */
+	[[nodiscard]] int Open(int flags) const noexcept;
+
+private:
+
+	/// Basenames up to this long are stored in the record itself.  Makes the whole record one 64-byte cache line.
+	static constexpr size_t cm_inline_capacity = 39;
+
+	[[nodiscard]] bool is_heap() const noexcept { return m_name_size > cm_inline_capacity; };
+	[[nodiscard]] const char* name_data() const noexcept { return is_heap() ? m_heap : m_inline; };
+
+	void AssignName(std::string_view name);
+	void FreeName() noexcept { if(is_heap()) { delete [] m_heap; } };
+
+	const FileID *m_dir { nullptr };
+
+	size_t m_sequence_number { 0 };
+
+	uint32_t m_name_size { 0 };
+
+	/// These fit in the padding after m_name_size.
+	bool m_type_deferred { false };
+	bool m_on_network_fs { false };
+
+	union
+	{
+		char m_inline[cm_inline_capacity+1];
+		char *m_heap;
+	};
+};
+
+/**
+ * The interned table of directories which FileRecords point to.  It owns them until it's destroyed, so it has to
+ * outlive all the FileRecords, i.e. the traversal and the scanners.
+ *
+ * Each traversal thread collects the directories it found files in locally, and hands them all over to the table
+ * at once when it's done, so adding to the table doesn't cost a lock per directory.
+ */
+class DirTable
+{
+public:
+	DirTable() = default;
+	~DirTable() = default;
+
+	DirTable(const DirTable&) = delete;
+	DirTable& operator=(const DirTable&) = delete;
+
+	/// Take ownership of all the directories in @p dirs, leaving it empty.  Thread-safe.
+	void Adopt(std::vector<std::shared_ptr<FileID>> &dirs);
+
+private:
+	std::mutex m_mutex;
+
+	std::vector<std::shared_ptr<FileID>> m_dirs;
+};
+
+#endif /* SRC_LIBEXT_FILERECORD_H_ */
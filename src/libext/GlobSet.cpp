@@ -0,0 +1,464 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "GlobSet.h"
+
+#include <algorithm>
+
+#include <fnmatch.h>
+
+/// The most 64-bit words of NFA state.  Patterns beyond the first 2048 elements are left to fnmatch() instead, which
+/// keeps the state small enough to live on the stack.
+static constexpr size_t f_max_nfa_words = 32;
+
+/// Set bit @p i of the bitmap @p bits.
+static inline void f_set_bit(uint64_t *bits, size_t i) noexcept
+{
+	bits[i/64] |= uint64_t(1) << (i%64);
+}
+
+static inline bool f_test_bit(const uint64_t *bits, size_t i) noexcept
+{
+	return (bits[i/64] >> (i%64)) & 1;
+}
+
+void GlobSet::Compile(const std::vector<std::string> &globs)
+{
+	*this = GlobSet();
+	m_num_globs = static_cast<int>(globs.size());
+
+	// Parse the patterns, and hash the ones with a simple shape.
+	std::vector<std::pair<std::vector<Element>, int>> nfa_globs;
+	size_t num_elements = 0;
+	for(int glob_number = 0; glob_number < m_num_globs; ++glob_number)
+	{
+		const std::string &glob = globs[glob_number];
+		std::vector<Element> elements;
+
+		if(!Parse(glob, elements))
+		{
+			m_fnmatch_globs.emplace_back(glob, glob_number);
+			continue;
+		}
+
+		// See whether it's all literal bytes, other than a star at one end.
+		size_t num_stars = 0, num_literals = 0;
+		for(const auto &e : elements)
+		{
+			num_stars += (e.m_kind == Element::star);
+			num_literals += (e.m_kind == Element::literal);
+		}
+		if(num_stars + num_literals == elements.size() && num_stars <= 1)
+		{
+			std::string literal;
+			for(const auto &e : elements)
+			{
+				if(e.m_kind == Element::literal)
+				{
+					// Exactly one bit is set in m_bytes.
+					for(int i = 0; i < 4; ++i)
+					{
+						if(e.m_bytes[i] != 0)
+						{
+							literal += static_cast<char>(i*64 + __builtin_ctzll(e.m_bytes[i]));
+						}
+					}
+				}
+			}
+
+			if(num_stars == 0)
+			{
+				m_names[literal] = glob_number;
+				continue;
+			}
+			else if(elements.front().m_kind == Element::star)
+			{
+				m_suffix_lengths.push_back(literal.size());
+				m_suffixes[literal] = glob_number;
+				continue;
+			}
+			else if(elements.back().m_kind == Element::star)
+			{
+				m_prefix_lengths.push_back(literal.size());
+				m_prefixes[literal] = glob_number;
+				continue;
+			}
+		}
+
+		if(num_elements + elements.size() > f_max_nfa_words * 64)
+		{
+			m_fnmatch_globs.emplace_back(glob, glob_number);
+			continue;
+		}
+		num_elements += elements.size();
+		nfa_globs.emplace_back(std::move(elements), glob_number);
+	}
+
+	for(auto *lengths : {&m_suffix_lengths, &m_prefix_lengths})
+	{
+		std::sort(lengths->begin(), lengths->end());
+		lengths->erase(std::unique(lengths->begin(), lengths->end()), lengths->end());
+	}
+
+	// Lay out the rest end to end in the NFA.
+	m_num_words = (num_elements + 63) / 64;
+	m_byte_masks.assign(256 * m_num_words, 0);
+	m_first.assign(m_num_words, 0);
+	m_stars.assign(m_num_words, 0);
+	for(const auto &g : nfa_globs)
+	{
+		AddToNFA(g.first, g.second);
+	}
+
+	std::reverse(m_accepts.begin(), m_accepts.end());
+	std::reverse(m_fnmatch_globs.begin(), m_fnmatch_globs.end());
+}
+
+bool GlobSet::Parse(const std::string &glob, std::vector<Element> &elements) const
+{
+	const size_t size = glob.size();
+	size_t i = 0;
+	while(i < size)
+	{
+		Element e {Element::literal};
+		char c = glob[i++];
+
+		if(c == '*')
+		{
+			if(!elements.empty() && elements.back().m_kind == Element::star)
+			{
+				// Consecutive stars are the same as one, and the NFA relies on there being no such runs.
+				continue;
+			}
+			e.m_kind = Element::star;
+		}
+		else if(c == '?')
+		{
+			e.m_kind = Element::any_char;
+		}
+		else if(c == '[')
+		{
+			e.m_kind = Element::bracket;
+
+			bool negate = false;
+			if(i < size && (glob[i] == '!' || glob[i] == '^'))
+			{
+				negate = true;
+				++i;
+			}
+
+			// A ']' right at the start is a member, not the end of the bracket expression.
+			bool first = true;
+			while(true)
+			{
+				if(i >= size)
+				{
+					// Unterminated.
+					return false;
+				}
+				unsigned char lo = glob[i++];
+				if(lo == ']' && !first)
+				{
+					break;
+				}
+				first = false;
+				if(lo == '[' && i < size && (glob[i] == ':' || glob[i] == '=' || glob[i] == '.'))
+				{
+					// A character class, equivalence class or collating symbol.
+					return false;
+				}
+				if(lo == '\\')
+				{
+					if(i >= size)
+					{
+						return false;
+					}
+					lo = glob[i++];
+				}
+
+				unsigned char hi = lo;
+				if(i + 1 < size && glob[i] == '-' && glob[i+1] != ']')
+				{
+					// It's a range.
+					i++;
+					hi = glob[i++];
+					if(hi == '[')
+					{
+						return false;
+					}
+					if(hi == '\\')
+					{
+						if(i >= size)
+						{
+							return false;
+						}
+						hi = glob[i++];
+					}
+					if(hi < lo)
+					{
+						return false;
+					}
+				}
+
+				for(unsigned int b = lo; b <= hi; ++b)
+				{
+					f_set_bit(e.m_bytes, b);
+				}
+			}
+
+			if(negate)
+			{
+				for(auto &w : e.m_bytes)
+				{
+					w = ~w;
+				}
+			}
+		}
+		else
+		{
+			if(c == '\\')
+			{
+				if(i >= size)
+				{
+					// fnmatch() never matches a pattern ending in a lone backslash.
+					return false;
+				}
+				c = glob[i++];
+			}
+			f_set_bit(e.m_bytes, static_cast<unsigned char>(c));
+		}
+
+		elements.push_back(e);
+	}
+
+	return true;
+}
+
+void GlobSet::AddToNFA(const std::vector<Element> &elements, int glob_number)
+{
+	// Find where this pattern starts, i.e. the number of elements already in the NFA.
+	size_t base = m_accepts.empty() ? 0 : m_accepts.back().first + 1;
+
+	f_set_bit(m_first.data(), base);
+	for(size_t i = 0; i < elements.size(); ++i)
+	{
+		const Element &e = elements[i];
+		size_t bit = base + i;
+		for(unsigned int b = 0; b < 256; ++b)
+		{
+			if(e.m_kind == Element::star || e.m_kind == Element::any_char || f_test_bit(e.m_bytes, b))
+			{
+				f_set_bit(&m_byte_masks[b * m_num_words], bit);
+			}
+		}
+		if(e.m_kind == Element::star)
+		{
+			f_set_bit(m_stars.data(), bit);
+		}
+	}
+
+	m_accepts.emplace_back(base + elements.size() - 1, glob_number);
+	m_nfa_last_glob = glob_number;
+}
+
+int GlobSet::LastLiteralMatch(const literal_map &map, const std::vector<size_t> &lengths, std::string_view name,
+		bool prefix) noexcept
+{
+	int retval = -1;
+	for(size_t length : lengths)
+	{
+		if(length > name.size())
+		{
+			break;
+		}
+		auto it = map.find(prefix ? name.substr(0, length) : name.substr(name.size() - length));
+		if(it != map.end())
+		{
+			retval = std::max(retval, it->second);
+		}
+	}
+	return retval;
+}
+
+int GlobSet::LastMatch(std::string_view name) const
+{
+	int retval = -1;
+
+	if(!m_names.empty())
+	{
+		auto it = m_names.find(name);
+		if(it != m_names.end())
+		{
+			retval = it->second;
+		}
+	}
+	retval = std::max(retval, LastLiteralMatch(m_suffixes, m_suffix_lengths, name, false));
+	retval = std::max(retval, LastLiteralMatch(m_prefixes, m_prefix_lengths, name, true));
+
+	if(m_nfa_last_glob > retval)
+	{
+		// Run the NFA.  Bit i of the state is set when element i of some pattern can have matched the last byte
+		// consumed, or for a star, some (possibly empty) run of bytes ending there.
+		const size_t num_words = m_num_words;
+		uint64_t state[f_max_nfa_words], next[f_max_nfa_words];
+
+		// Before the first byte, only stars which start a pattern can have matched, and they've matched nothing.
+		for(size_t w = 0; w < num_words; ++w)
+		{
+			state[w] = m_first[w] & m_stars[w];
+		}
+
+		bool at_start = true;
+		for(unsigned char c : name)
+		{
+			const uint64_t *mask = &m_byte_masks[c * num_words];
+			uint64_t carry = 0, live = 0;
+			for(size_t w = 0; w < num_words; ++w)
+			{
+				// Any element whose predecessor in its pattern matched (or at the start, any first element) can
+				// consume c.  A star that's matched can also keep consuming.
+				uint64_t advanced = ((state[w] << 1) | carry) & ~m_first[w];
+				carry = state[w] >> 63;
+				if(at_start)
+				{
+					advanced |= m_first[w];
+				}
+				next[w] = (advanced & mask[w]) | (state[w] & m_stars[w]);
+			}
+
+			// A star can match nothing, so is matched whenever its predecessor is.  There are no runs of stars, so one
+			// pass is enough.
+			carry = 0;
+			for(size_t w = 0; w < num_words; ++w)
+			{
+				uint64_t shifted = (next[w] << 1) | carry;
+				carry = next[w] >> 63;
+				state[w] = next[w] | (shifted & m_stars[w] & ~m_first[w]);
+				live |= state[w];
+			}
+
+			at_start = false;
+			if(live == 0)
+			{
+				break;
+			}
+		}
+
+		for(const auto &accept : m_accepts)
+		{
+			if(accept.second <= retval)
+			{
+				break;
+			}
+			if(f_test_bit(state, accept.first))
+			{
+				retval = accept.second;
+				break;
+			}
+		}
+	}
+
+	if(!m_fnmatch_globs.empty() && m_fnmatch_globs.front().second > retval)
+	{
+		// fnmatch() needs a NUL-terminated name.
+		const std::string name_str {name};
+		for(const auto &glob : m_fnmatch_globs)
+		{
+			if(glob.second <= retval)
+			{
+				break;
+			}
+			if(fnmatch(glob.first.c_str(), name_str.c_str(), 0) == 0)
+			{
+				retval = glob.second;
+				break;
+			}
+		}
+	}
+
+	return retval;
+}
+
+PathGlob::PathGlob(std::string_view glob)
+{
+	while(true)
+	{
+		auto slash = glob.find('/');
+		std::string_view component = glob.substr(0, slash);
+		if(!component.empty())
+		{
+			Component c {component == "**", GlobSet()};
+			if(!c.m_any_depth)
+			{
+				c.m_glob.Compile({std::string(component)});
+			}
+			m_components.push_back(std::move(c));
+		}
+		if(slash == std::string_view::npos)
+		{
+			break;
+		}
+		glob.remove_prefix(slash + 1);
+	}
+}
+
+void PathGlob::Split(std::string_view dir, std::string_view name, std::vector<std::string_view> &components)
+{
+	components.clear();
+	while(!dir.empty())
+	{
+		auto slash = dir.find('/');
+		if(slash != 0)
+		{
+			components.push_back(dir.substr(0, slash));
+		}
+		dir.remove_prefix(slash == std::string_view::npos ? dir.size() : slash + 1);
+	}
+	components.push_back(name);
+}
+
+bool PathGlob::MatchComponents(const Component *components, size_t num_components,
+		const std::string_view *path, size_t path_size)
+{
+	if(num_components == 0)
+	{
+		return path_size == 0;
+	}
+
+	if(components[0].m_any_depth)
+	{
+		if(num_components == 1)
+		{
+			return path_size > 0;
+		}
+		for(size_t skip = 0; skip <= path_size; ++skip)
+		{
+			if(MatchComponents(components + 1, num_components - 1, path + skip, path_size - skip))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	return path_size > 0 && components[0].m_glob.AnyMatch(path[0])
+			&& MatchComponents(components + 1, num_components - 1, path + 1, path_size - 1);
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file GlobSet.h */
+
+#ifndef SRC_LIBEXT_GLOBSET_H_
+#define SRC_LIBEXT_GLOBSET_H_
+
+#include <config.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * A set of glob patterns, compiled so that a name can be matched against all of them in one pass, no matter how many
+ * there are.  A name matches a pattern exactly when fnmatch(pattern, name, 0) would say it does.
+ *
+ * Compile() sorts the patterns by shape:
+ * - Literal names ("Makefile"), "*suffix" ("*.cpp") and "prefix*" ("README*") patterns go into hash maps, which are
+ *   looked up once per distinct literal length.
+ * - All other patterns are combined into a single NFA, with one bit of state per pattern element, which is run over
+ *   the name a byte at a time with bit-parallel operations.
+ * - The few patterns the NFA doesn't model (those with POSIX character classes, equivalence classes or collating
+ *   symbols in brackets, or a trailing backslash) are left to fnmatch().
+ */
+class GlobSet
+{
+public:
+	GlobSet() = default;
+	~GlobSet() = default;
+
+	/**
+	 * Replace the contents of the set with @p globs.  The patterns are numbered by their position in @p globs, which
+	 * is what LastMatch() returns.
+	 */
+	void Compile(const std::vector<std::string> &globs);
+
+	bool empty() const noexcept { return m_num_globs == 0; };
+
+	/**
+	 * Match @p name against all the patterns in the set.
+	 *
+	 * @return The number of the last pattern which matches @p name, or -1 if none do.
+	 */
+	int LastMatch(std::string_view name) const;
+
+	/// @return true if @p name matches any pattern in the set.
+	bool AnyMatch(std::string_view name) const { return LastMatch(name) >= 0; };
+
+private:
+
+	/// One element of a pattern, as modeled by the NFA.
+	struct Element
+	{
+		enum Kind { literal, any_char, bracket, star } m_kind;
+
+		/// For literal, the byte, and for bracket, the set of bytes, it matches.
+		uint64_t m_bytes[4] {0, 0, 0, 0};
+	};
+
+	bool Parse(const std::string &glob, std::vector<Element> &elements) const;
+
+	void AddToNFA(const std::vector<Element> &elements, int glob_number);
+
+	/// Hash which lets the maps be searched by string_view without building a std::string.
+	struct name_hash
+	{
+		using is_transparent = void;
+		size_t operator()(std::string_view s) const noexcept { return std::hash<std::string_view>{}(s); };
+	};
+
+	/// Map from a literal (a whole name, a suffix or a prefix) to the number of the last pattern using it.
+	using literal_map = std::unordered_map<std::string, int, name_hash, std::equal_to<>>;
+
+	/// Looks up every prefix (if @p prefix) or suffix of @p name whose length is in @p lengths in @p map.
+	static int LastLiteralMatch(const literal_map &map, const std::vector<size_t> &lengths, std::string_view name,
+			bool prefix) noexcept;
+
+	int m_num_globs {0};
+
+	/// @name The hashed patterns.
+	///@{
+	literal_map m_names;
+	literal_map m_suffixes;
+	literal_map m_prefixes;
+
+	/// The distinct lengths of the suffixes and prefixes, in increasing order.
+	std::vector<size_t> m_suffix_lengths;
+	std::vector<size_t> m_prefix_lengths;
+	///@}
+
+	/// @name The NFA.
+	/// Bit i of each of these is for the i'th element of all the NFA patterns, laid end to end.
+	///@{
+	size_t m_num_words {0};
+
+	/// 256 masks, one for each byte value, of the elements which can consume that byte.  Stars can consume any byte.
+	std::vector<uint64_t> m_byte_masks;
+
+	/// The first element of each pattern.
+	std::vector<uint64_t> m_first;
+
+	/// The star elements.
+	std::vector<uint64_t> m_stars;
+
+	/// The last element of each pattern, and the number of the pattern it belongs to, by decreasing pattern number.
+	std::vector<std::pair<size_t, int>> m_accepts;
+
+	/// The number of the last pattern in the NFA, or -1 if there are none.
+	int m_nfa_last_glob {-1};
+	///@}
+
+	/// The patterns left to fnmatch(), with their numbers, by decreasing pattern number.
+	std::vector<std::pair<std::string, int>> m_fnmatch_globs;
+};
+
+/**
+ * A glob which is matched against a relative path a component at a time, so that, as with fnmatch()'s FNM_PATHNAME, a
+ * wildcard never matches a '/'.  A "**" component matches any number of components, including none, except at the
+ * end, where it matches one or more, so that it matches everything inside the directory before it, but not the
+ * directory itself.
+ */
+class PathGlob
+{
+public:
+	/// A glob which only matches the empty path.
+	PathGlob() = default;
+
+	/// @param glob  The pattern.  Empty components, e.g. from a leading or doubled '/', are dropped.
+	explicit PathGlob(std::string_view glob);
+
+	/**
+	 * Split the path @p dir (which may be empty), plus @p name, into @p components, for passing to Match().
+	 */
+	static void Split(std::string_view dir, std::string_view name, std::vector<std::string_view> &components);
+
+	/// @return true if the path made up of @p components matches.
+	[[nodiscard]] bool Match(const std::vector<std::string_view> &components) const
+	{
+		return MatchComponents(m_components.data(), m_components.size(), components.data(), components.size());
+	};
+
+private:
+
+	struct Component
+	{
+		/// True for a "**" component.
+		bool m_any_depth;
+
+		GlobSet m_glob;
+	};
+
+	static bool MatchComponents(const Component *components, size_t num_components,
+			const std::string_view *path, size_t path_size);
+
+	std::vector<Component> m_components;
+};
+
+#endif /* SRC_LIBEXT_GLOBSET_H_ */
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "IgnoreRules.h"
+
+#include "DirentReader.h"
+#include "FileID.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Read the whole of the file @p name in @p dir into @p contents.
+ *
+ * @return false if the file couldn't be opened or read.
+ */
+static bool f_read_file_at(const FileID &dir, const char *name, std::string &contents)
+{
+	int fd = dir.OpenAt(name, O_RDONLY | O_NOCTTY);
+	if(fd < 0)
+	{
+		if(errno != ENOENT)
+		{
+			LOG(INFO) << "Could not open '" << dir.GetPath() << "/" << name << "': " << LOG_STRERROR();
+		}
+		return false;
+	}
+
+	contents.clear();
+	char buffer[4096];
+	ssize_t num_read;
+	while((num_read = read(fd, buffer, sizeof(buffer))) > 0)
+	{
+		contents.append(buffer, num_read);
+	}
+	close(fd);
+
+	return num_read == 0;
+}
+
+std::shared_ptr<const IgnoreRules> IgnoreRules::Load(const FileID &dir, const std::shared_ptr<const IgnoreRules> &parent,
+		DirentReader *reader)
+{
+	std::shared_ptr<IgnoreRules> rules;
+	std::string contents;
+
+	// Most directories have none of the ignore files, and on a network filesystem, every failed open is a round trip
+	// to the server.  So if the reader already has the directory's names, only open the files which are there.
+	constexpr size_t num_ignore_files = std::size(cm_ignore_filenames);
+	bool exists[num_ignore_files];
+	if(reader == nullptr || !reader->FindNames(cm_ignore_filenames, num_ignore_files, exists))
+	{
+		std::fill(std::begin(exists), std::end(exists), true);
+	}
+
+	for(size_t i = 0; i < num_ignore_files; ++i)
+	{
+		const char *name = cm_ignore_filenames[i];
+		if(!exists[i] || !f_read_file_at(dir, name, contents))
+		{
+			continue;
+		}
+		if(!rules)
+		{
+			// Can't use make_shared<>, the constructor's private.
+			rules.reset(new IgnoreRules(parent, dir.GetPath()));
+		}
+		rules->AddRules(contents);
+	}
+
+	if(!rules)
+	{
+		return parent;
+	}
+
+	rules->Compile();
+	return rules;
+}
+
+IgnoreRules::IgnoreRules(std::shared_ptr<const IgnoreRules> parent, std::string dir_path)
+	: m_parent(std::move(parent)), m_dir_path(std::move(dir_path))
+{
+}
+
+void IgnoreRules::AddRules(std::string_view text)
+{
+	while(!text.empty())
+	{
+		auto eol = text.find('\n');
+		std::string_view line = text.substr(0, eol);
+		text.remove_prefix(eol == std::string_view::npos ? text.size() : eol + 1);
+
+		if(!line.empty() && line.back() == '\r')
+		{
+			line.remove_suffix(1);
+		}
+		if(line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		// Trailing spaces are dropped, unless they're escaped with a backslash.
+		while(!line.empty() && line.back() == ' ' && !(line.size() >= 2 && line[line.size()-2] == '\\'))
+		{
+			line.remove_suffix(1);
+		}
+
+		Rule rule {};
+		if(!line.empty() && line[0] == '!')
+		{
+			rule.m_negated = true;
+			line.remove_prefix(1);
+		}
+		if(!line.empty() && line.back() == '/')
+		{
+			rule.m_dir_only = true;
+			line.remove_suffix(1);
+		}
+
+		// A "**/" prefix on an otherwise slash-free rule just means "at any depth", which is what slash-free rules do
+		// anyway.
+		if(line.substr(0, 3) == "**/" && line.find('/', 3) == std::string_view::npos)
+		{
+			line.remove_prefix(3);
+		}
+		rule.m_anchored = (line.find('/') != std::string_view::npos);
+		if(!line.empty() && line[0] == '/')
+		{
+			line.remove_prefix(1);
+		}
+
+		if(line.empty())
+		{
+			continue;
+		}
+		rule.m_glob = line;
+		m_rules.push_back(std::move(rule));
+	}
+}
+
+void IgnoreRules::Compile()
+{
+	std::vector<std::string> dir_globs, file_globs;
+
+	for(int i = 0; i < static_cast<int>(m_rules.size()); ++i)
+	{
+		Rule &rule = m_rules[i];
+
+		if(!rule.m_anchored)
+		{
+			dir_globs.push_back(rule.m_glob);
+			m_dir_glob_rules.push_back(i);
+			if(!rule.m_dir_only)
+			{
+				file_globs.push_back(rule.m_glob);
+				m_file_glob_rules.push_back(i);
+			}
+			continue;
+		}
+
+		rule.m_path_glob = PathGlob(rule.m_glob);
+		m_anchored_rules.push_back(i);
+	}
+
+	m_dir_globs.Compile(dir_globs);
+	m_file_globs.Compile(file_globs);
+	std::reverse(m_anchored_rules.begin(), m_anchored_rules.end());
+}
+
+bool IgnoreRules::IsIgnored(const FileID &dir, std::string_view name, bool is_dir) const
+{
+	// The innermost directory with a rule that matches decides.
+	for(const IgnoreRules *rules = this; rules != nullptr; rules = rules->m_parent.get())
+	{
+		int rule = rules->LastMatch(dir, name, is_dir);
+		if(rule >= 0)
+		{
+			return !rules->m_rules[rule].m_negated;
+		}
+	}
+
+	return false;
+}
+
+int IgnoreRules::LastMatch(const FileID &dir, std::string_view name, bool is_dir) const
+{
+	int retval = -1;
+
+	int glob_number = is_dir ? m_dir_globs.LastMatch(name) : m_file_globs.LastMatch(name);
+	if(glob_number >= 0)
+	{
+		retval = is_dir ? m_dir_glob_rules[glob_number] : m_file_glob_rules[glob_number];
+	}
+
+	if(m_anchored_rules.empty() || m_anchored_rules.front() <= retval)
+	{
+		return retval;
+	}
+
+	// Split the path of the entry, relative to the directory these rules came from, into components.
+	std::string_view dir_path = dir.GetPath();
+	std::string_view rel_dir;
+	if(m_dir_path == ".")
+	{
+		// Paths under the cwd don't start with "./", so every directory but the cwd itself is relative as-is.
+		if(dir_path != ".")
+		{
+			rel_dir = dir_path;
+		}
+	}
+	else if(dir_path.size() > m_dir_path.size() && dir_path.substr(0, m_dir_path.size()) == m_dir_path)
+	{
+		// Strip the rules' directory and the '/' after it.  If the rules' directory is "/", the '/' is part of it.
+		std::string_view rest = dir_path.substr(m_dir_path.size());
+		if(m_dir_path.back() == '/')
+		{
+			rel_dir = rest;
+		}
+		else if(rest.front() == '/')
+		{
+			rel_dir = rest.substr(1);
+		}
+	}
+	std::vector<std::string_view> path;
+	PathGlob::Split(rel_dir, name, path);
+
+	for(int rule_number : m_anchored_rules)
+	{
+		if(rule_number <= retval)
+		{
+			break;
+		}
+		const Rule &rule = m_rules[rule_number];
+		if(rule.m_dir_only && !is_dir)
+		{
+			continue;
+		}
+		if(rule.m_path_glob.Match(path))
+		{
+			retval = rule_number;
+			break;
+		}
+	}
+
+	return retval;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file IgnoreRules.h */
+
+#ifndef SRC_LIBEXT_IGNORERULES_H_
+#define SRC_LIBEXT_IGNORERULES_H_
+
+#include <config.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "GlobSet.h"
+
+class DirentReader;
+class FileID;
+
+/**
+ * The rules from the .gitignore, .ignore and .ucgignore files of one directory, compiled for matching, plus a pointer
+ * to those of the nearest ancestor directory which had any.
+ *
+ * The rules follow gitignore(5): blank lines and lines starting with '#' are skipped, a leading '!' re-includes what an
+ * earlier rule excluded, a trailing '/' makes a rule match only directories, and a rule with a '/' anywhere else is
+ * matched against the entry's path relative to the directory of the ignore file, where a "**" component matches any
+ * number of directories.  Other rules are matched against the name alone, at any depth.  Within a directory, the last matching
+ * rule wins, with the files read in the order above; the rules of a directory take precedence over those of its
+ * ancestors.
+ *
+ * Instances are immutable once loaded, so a directory's rules are shared by all of its subdirectories' traversals
+ * without any locking.
+ */
+class IgnoreRules
+{
+public:
+	/**
+	 * Read the ignore files in @p dir.
+	 *
+	 * @param dir     The directory.  Its ignore files are opened relative to its cached descriptor.
+	 * @param parent  The rules which apply to @p dir itself, i.e. those of its parent, or null if there are none.
+	 * @param reader  If given, the DirentReader which has just opened @p dir.  When all of @p dir's entries fit in its
+	 *                buffer, only the ignore files found there are opened, instead of trying to open each of them.
+	 * @return The rules which apply to the entries of @p dir.  This is just @p parent if @p dir has no ignore files.
+	 */
+	static std::shared_ptr<const IgnoreRules> Load(const FileID &dir, const std::shared_ptr<const IgnoreRules> &parent,
+			DirentReader *reader = nullptr);
+
+	/**
+	 * Check whether the entry @p name of directory @p dir is excluded by these rules or their ancestors'.
+	 *
+	 * @param dir     The directory the entry is in.  This directory or one of its ancestors must be the one the rules
+	 *                were loaded from.
+	 * @param name    The entry's name.
+	 * @param is_dir  Whether the entry is a directory.
+	 */
+	[[nodiscard]] bool IsIgnored(const FileID &dir, std::string_view name, bool is_dir) const;
+
+	/// The names of the ignore files, in increasing order of precedence.
+	static constexpr const char *cm_ignore_filenames[] { ".gitignore", ".ignore", ".ucgignore" };
+
+private:
+
+	IgnoreRules(std::shared_ptr<const IgnoreRules> parent, std::string dir_path);
+
+	/// Parse the rules in @p text, the contents of an ignore file, and add them after those already added.
+	void AddRules(std::string_view text);
+
+	/// Compile the rules added by AddRules() for matching.
+	void Compile();
+
+	/// @return The number of the last of this directory's rules which matches, or -1 if none do.
+	int LastMatch(const FileID &dir, std::string_view name, bool is_dir) const;
+
+	struct Rule
+	{
+		std::string m_glob;
+		bool m_negated;
+		bool m_dir_only;
+
+		/// Whether the rule is matched against the relative path, rather than the name alone.
+		bool m_anchored;
+
+		/// For anchored rules, m_glob compiled.
+		PathGlob m_path_glob;
+	};
+
+	std::shared_ptr<const IgnoreRules> m_parent;
+
+	/// The path of the directory the rules were loaded from, as returned by FileID::GetPath().
+	std::string m_dir_path;
+
+	std::vector<Rule> m_rules;
+
+	/// @name The unanchored rules, compiled.
+	/// One set for matching directories, with all of them, and one for matching files, without those which only
+	/// match directories.  Each set's pattern numbers are mapped back to rule numbers.
+	///@{
+	GlobSet m_dir_globs;
+	std::vector<int> m_dir_glob_rules;
+	GlobSet m_file_globs;
+	std::vector<int> m_file_glob_rules;
+	///@}
+
+	/// The numbers of the anchored rules, in decreasing order.
+	std::vector<int> m_anchored_rules;
+};
+
+#endif /* SRC_LIBEXT_IGNORERULES_H_ */
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "MountTable.h"
+
+#include "Logger.h"
+
+#include <charconv>
+#include <exception>
+#include <fstream>
+#include <sstream>
+
+#if HAVE_SYS_VFS_H
+#include <sys/vfs.h> // For fstatfs().
+#endif
+#if HAVE_SYS_SYSMACROS_H
+#include <sys/sysmacros.h> // For makedev().
+#endif
+
+FilesystemKind filesystem_kind_of_magic(unsigned long f_type) noexcept
+{
+	// The f_type magic numbers from linux/magic.h and the filesystems' own headers.  Not all of them are in the
+	// former, so they're spelled out here.
+	switch(f_type & 0xFFFFFFFFUL)
+	{
+	case 0x9FA0UL:		// proc
+	case 0x62656572UL:	// sysfs
+	case 0x1CD1UL:		// devpts
+	case 0x27E0EBUL:	// cgroup
+	case 0x63677270UL:	// cgroup2
+	case 0x64626720UL:	// debugfs
+	case 0x74726163UL:	// tracefs
+	case 0x73636673UL:	// securityfs
+	case 0x6165676CUL:	// pstore
+	case 0xCAFE4A11UL:	// bpf
+	case 0x62656570UL:	// configfs
+	case 0x19800202UL:	// mqueue
+	case 0x958458F6UL:	// hugetlbfs
+	case 0x42494E4DUL:	// binfmt_misc
+	case 0xDE5E81E4UL:	// efivarfs
+	case 0xF97CFF8CUL:	// selinuxfs
+	case 0x6E736673UL:	// nsfs
+	case 0x65735543UL:	// fusectl
+	case 0x67596969UL:	// rpc_pipefs
+		return FSK_PSEUDO;
+	case 0x6969UL:		// NFS
+	case 0x517BUL:		// SMB
+	case 0xFF534D42UL:	// CIFS
+	case 0xFE534D42UL:	// SMB2
+	case 0x00C36400UL:	// Ceph
+	case 0x5346414FUL:	// AFS
+	case 0x6B414653UL:	// kAFS
+	case 0x73757245UL:	// Coda
+	case 0x564CUL:		// NCP
+	case 0x01021997UL:	// 9P
+	case 0x01161970UL:	// GFS2
+	case 0x0BD00BD0UL:	// Lustre
+	case 0x47504653UL:	// GPFS
+	case 0x7461636FUL:	// OCFS2
+	case 0x65735546UL:	// FUSE
+		return FSK_NETWORK;
+	default:
+		return FSK_LOCAL;
+	}
+}
+
+FilesystemKind filesystem_kind_of_type(std::string_view type) noexcept
+{
+	static constexpr std::string_view pseudo_types[] {
+		"proc", "sysfs", "devtmpfs", "devpts", "cgroup", "cgroup2", "debugfs", "tracefs", "securityfs", "pstore",
+		"bpf", "configfs", "mqueue", "hugetlbfs", "binfmt_misc", "efivarfs", "selinuxfs", "nsfs", "fusectl",
+		"rpc_pipefs"
+	};
+	static constexpr std::string_view network_types[] {
+		"nfs", "nfs4", "cifs", "smb3", "smbfs", "ceph", "afs", "coda", "ncpfs", "9p", "gfs2", "lustre", "gpfs",
+		"ocfs2", "davfs", "fuse"
+	};
+
+	for(auto t : pseudo_types)
+	{
+		if(type == t)
+		{
+			return FSK_PSEUDO;
+		}
+	}
+	for(auto t : network_types)
+	{
+		if(type == t)
+		{
+			return FSK_NETWORK;
+		}
+	}
+	// FUSE filesystems are "fuse.<name>", e.g. "fuse.sshfs".  Those backed by a local block device, such as NTFS
+	// volumes, are "fuseblk", and count as local.
+	if(type.substr(0, 5) == "fuse.")
+	{
+		return FSK_NETWORK;
+	}
+
+	return FSK_LOCAL;
+}
+
+FilesystemKind get_filesystem_kind(int fd) noexcept
+{
+#if HAVE_FSTATFS && HAVE_SYS_VFS_H
+	struct statfs sfs;
+	if(fstatfs(fd, &sfs) != 0)
+	{
+		return FSK_LOCAL;
+	}
+	return filesystem_kind_of_magic(static_cast<unsigned long>(sfs.f_type));
+#else
+	(void)fd;
+	return FSK_LOCAL;
+#endif
+}
+
+/**
+ * Undo the octal escapes of the spaces, tabs, newlines and backslashes in a mountinfo path, e.g. "\040" for ' '.
+ */
+static std::string f_unescape_mountinfo_path(std::string_view path)
+{
+	std::string retval;
+	retval.reserve(path.size());
+	for(size_t i = 0; i < path.size(); ++i)
+	{
+		if(path[i] == '\\' && i + 3 < path.size()
+				&& path[i+1] >= '0' && path[i+1] <= '3'
+				&& path[i+2] >= '0' && path[i+2] <= '7'
+				&& path[i+3] >= '0' && path[i+3] <= '7')
+		{
+			retval.push_back(static_cast<char>(((path[i+1]-'0') << 6) | ((path[i+2]-'0') << 3) | (path[i+3]-'0')));
+			i += 3;
+		}
+		else
+		{
+			retval.push_back(path[i]);
+		}
+	}
+	return retval;
+}
+
+bool MountTable::Load()
+{
+	std::ifstream mountinfo("/proc/self/mountinfo");
+	if(!mountinfo)
+	{
+		LOG(INFO) << "No mount table, filesystems will be identified by stat()ing directories";
+		return false;
+	}
+
+	try
+	{
+		std::stringstream contents;
+		contents << mountinfo.rdbuf();
+		const std::string text = contents.str();
+
+		std::vector<std::string> mount_point_basenames;
+		std::string_view rest {text};
+		while(!rest.empty())
+		{
+			auto eol = rest.find('\n');
+			AddMount(rest.substr(0, eol), mount_point_basenames);
+			rest.remove_prefix(eol == std::string_view::npos ? rest.size() : eol + 1);
+		}
+
+		m_mount_point_basenames.Compile(mount_point_basenames);
+	}
+	catch(const std::exception &e)
+	{
+		// This runs on the traversal's thread, so don't let it take the search down.  Without the table, every
+		// directory might be a mount point, and is stat()ed to find out.
+		LOG(INFO) << "Couldn't load the mount table (" << e.what()
+				<< "), filesystems will be identified by stat()ing directories";
+		*this = MountTable();
+		return false;
+	}
+
+	m_loaded = true;
+	return true;
+}
+
+void MountTable::AddMount(std::string_view line, std::vector<std::string> &mount_point_basenames)
+{
+	// The fields are space-separated:
+	//   mount-id parent-id major:minor root mount-point options [optional-fields...] - type source super-options
+	std::vector<std::string_view> fields;
+	while(!line.empty())
+	{
+		auto space = line.find(' ');
+		fields.push_back(line.substr(0, space));
+		line.remove_prefix(space == std::string_view::npos ? line.size() : space + 1);
+	}
+
+	size_t separator = 6;
+	while(separator < fields.size() && fields[separator] != "-")
+	{
+		++separator;
+	}
+	if(separator + 1 >= fields.size())
+	{
+		// Malformed.
+		return;
+	}
+
+	std::string_view dev_field = fields[2];
+	auto colon = dev_field.find(':');
+	unsigned int major = 0, minor = 0;
+	if(colon == std::string_view::npos
+			|| std::from_chars(dev_field.data(), dev_field.data() + colon, major).ec != std::errc()
+			|| std::from_chars(dev_field.data() + colon + 1, dev_field.data() + dev_field.size(), minor).ec != std::errc())
+	{
+		return;
+	}
+
+	std::string type {fields[separator + 1]};
+	FilesystemKind kind = filesystem_kind_of_type(type);
+	m_filesystems.emplace(makedev(major, minor), Filesystem{std::move(type), kind});
+
+	std::string mount_point = f_unescape_mountinfo_path(fields[4]);
+	auto last_slash = mount_point.find_last_of('/');
+	if(last_slash != std::string::npos && last_slash + 1 < mount_point.size())
+	{
+		mount_point_basenames.push_back(mount_point.substr(last_slash + 1));
+	}
+}
+
+FilesystemKind MountTable::GetKind(dev_t dev) const noexcept
+{
+	auto it = m_filesystems.find(dev);
+	return (it == m_filesystems.end()) ? FSK_LOCAL : it->second.m_kind;
+}
+
+std::string_view MountTable::GetType(dev_t dev) const noexcept
+{
+	auto it = m_filesystems.find(dev);
+	return (it == m_filesystems.end()) ? std::string_view() : std::string_view(it->second.m_type);
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file MountTable.h */
+
+#ifndef SRC_LIBEXT_MOUNTTABLE_H_
+#define SRC_LIBEXT_MOUNTTABLE_H_
+
+#include <config.h>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "PerfectHashSet.h"
+
+/// What a filesystem is, as far as how to search it goes.
+enum FilesystemKind : uint8_t
+{
+	/// Ordinary local storage.
+	FSK_LOCAL,
+	/// Kernel or virtual filesystems such as /proc and /sys, whose "files" aren't worth searching and can block or be
+	/// endless when read.
+	FSK_PSEUDO,
+	/// Network and cluster filesystems, and FUSE filesystems, where every operation can be a round trip to a server or
+	/// a user-space daemon.
+	FSK_NETWORK
+};
+
+/// The FilesystemKind of a statfs() f_type magic number.
+FilesystemKind filesystem_kind_of_magic(unsigned long f_type) noexcept;
+
+/// The FilesystemKind of a filesystem type name, as in /proc/self/mountinfo, e.g. "nfs4" or "fuse.sshfs".
+FilesystemKind filesystem_kind_of_type(std::string_view type) noexcept;
+
+/// The FilesystemKind of the filesystem @p fd is on, from fstatfs().  FSK_LOCAL if it can't be determined.
+FilesystemKind get_filesystem_kind(int fd) noexcept;
+
+/**
+ * The system's mounts, read once from /proc/self/mountinfo, so that the type of the filesystem on a device can be
+ * looked up without making any calls into the filesystem itself, which for a hung FUSE daemon or NFS server would
+ * block.
+ *
+ * Immutable once loaded, so it's shared by all traversal threads without locking.
+ */
+class MountTable
+{
+public:
+	MountTable() = default;
+	~MountTable() = default;
+
+	/// Read the mount table.  @return false if there isn't one to read, e.g. if this isn't Linux, or if it couldn't be
+	/// loaded.  Never throws.
+	bool Load();
+
+	/// Whether Load() succeeded.
+	[[nodiscard]] bool IsLoaded() const noexcept { return m_loaded; };
+
+	/**
+	 * Whether a directory entry named @p name could be a mount point, i.e. some mount point has that basename.  If
+	 * not, it's on the same filesystem as its parent without having to stat it to check.  Always true if the table
+	 * couldn't be loaded.
+	 */
+	[[nodiscard]] bool MightBeMountPoint(std::string_view name) const noexcept
+	{
+		return !m_loaded || m_mount_point_basenames.contains(name);
+	};
+
+	/// The kind of the filesystem on device @p dev.  FSK_LOCAL if it's not in the table.
+	[[nodiscard]] FilesystemKind GetKind(dev_t dev) const noexcept;
+
+	/// The type name of the filesystem on device @p dev, for logging.  Empty if it's not in the table.
+	[[nodiscard]] std::string_view GetType(dev_t dev) const noexcept;
+
+private:
+
+	/// Parse the /proc/self/mountinfo line @p line.
+	void AddMount(std::string_view line, std::vector<std::string> &mount_point_basenames);
+
+	bool m_loaded { false };
+
+	struct Filesystem
+	{
+		std::string m_type;
+		FilesystemKind m_kind;
+	};
+
+	/// The filesystems, by device.
+	std::unordered_map<dev_t, Filesystem> m_filesystems;
+
+	/// The last components of all the mount points.
+	PerfectHashSet m_mount_point_basenames;
+};
+
+#endif /* SRC_LIBEXT_MOUNTTABLE_H_ */
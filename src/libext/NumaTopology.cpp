@@ -0,0 +1,180 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "NumaTopology.h"
+
+#include "Logger.h"
+
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#include <dirent.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+	#include <sched.h>
+#endif
+
+/// Where Linux exposes the NUMA topology.
+static constexpr char f_sysfs_node_dir[] = "/sys/devices/system/node";
+
+
+std::vector<int> NumaTopology::ParseCpuList(const std::string &cpulist)
+{
+	std::vector<int> retval;
+	std::istringstream iss(cpulist);
+	std::string range;
+
+	while(std::getline(iss, range, ','))
+	{
+		// Trim any whitespace, e.g. the trailing '\n' from sysfs.
+		range.erase(std::remove_if(range.begin(), range.end(), [](unsigned char c){ return std::isspace(c); }), range.end());
+		if(range.empty())
+		{
+			continue;
+		}
+
+		char *endptr;
+		long first = std::strtol(range.c_str(), &endptr, 10);
+		long last = first;
+		if(endptr == range.c_str())
+		{
+			// Not a number.
+			return {};
+		}
+		if(*endptr == '-')
+		{
+			const char *second = endptr+1;
+			last = std::strtol(second, &endptr, 10);
+			if(endptr == second)
+			{
+				return {};
+			}
+		}
+		if(*endptr != '\0' || first < 0 || last < first)
+		{
+			return {};
+		}
+
+		for(long cpu = first; cpu <= last; ++cpu)
+		{
+			retval.push_back(static_cast<int>(cpu));
+		}
+	}
+
+	return retval;
+}
+
+NumaTopology NumaTopology::Discover()
+{
+	NumaTopology retval;
+
+#ifdef HAVE_SCHED_SETAFFINITY
+	// Get the set of CPUs we're allowed to run on.  This respects taskset, cgroup cpusets, etc.
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	bool have_allowed = (sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+
+	// Find the nodeN directories.  Use a map so the nodes end up in node-number order.
+	std::map<int, std::vector<int>> nodes;
+	DIR *d = opendir(f_sysfs_node_dir);
+	if(d != nullptr)
+	{
+		struct dirent *de;
+		while((de = readdir(d)) != nullptr)
+		{
+			const char *name = de->d_name;
+			if(std::strncmp(name, "node", 4) != 0 || !std::isdigit(static_cast<unsigned char>(name[4])))
+			{
+				continue;
+			}
+
+			std::ifstream cpulist_file(std::string(f_sysfs_node_dir) + "/" + name + "/cpulist");
+			std::string cpulist;
+			if(!std::getline(cpulist_file, cpulist))
+			{
+				continue;
+			}
+
+			std::vector<int> cpus = ParseCpuList(cpulist);
+			if(have_allowed)
+			{
+				cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+						[&allowed](int cpu){ return cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed); }), cpus.end());
+			}
+			if(!cpus.empty())
+			{
+				nodes[std::atoi(name+4)] = std::move(cpus);
+			}
+		}
+		closedir(d);
+	}
+
+	for(auto &node : nodes)
+	{
+		LOG(INFO) << "NUMA node " << node.first << ": " << node.second.size() << " usable CPUs";
+		retval.m_node_cpus.push_back(std::move(node.second));
+	}
+#endif
+
+	if(retval.m_node_cpus.empty())
+	{
+		// No NUMA info.  Treat the system as a single node with all CPUs.
+		LOG(INFO) << "No NUMA topology info, assuming a single node";
+		std::vector<int> all_cpus;
+		for(unsigned int cpu = 0; cpu < std::max(1U, std::thread::hardware_concurrency()); ++cpu)
+		{
+			all_cpus.push_back(cpu);
+		}
+		retval.m_node_cpus.push_back(std::move(all_cpus));
+	}
+
+	return retval;
+}
+
+bool NumaTopology::BindCurrentThreadToNode(size_t node_index) const noexcept
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	if(node_index >= m_node_cpus.size())
+	{
+		return false;
+	}
+
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	for(int cpu : m_node_cpus[node_index])
+	{
+		if(cpu < CPU_SETSIZE)
+		{
+			CPU_SET(cpu, &cpuset);
+		}
+	}
+
+	return sched_setaffinity(0, sizeof(cpuset), &cpuset) == 0;
+#else
+	(void)node_index;
+	return false;
+#endif
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#ifndef SRC_LIBEXT_NUMATOPOLOGY_H_
+#define SRC_LIBEXT_NUMATOPOLOGY_H_
+
+#include <config.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * The NUMA nodes of the system, and which CPUs belong to each.
+ *
+ * On Linux this is read from sysfs (/sys/devices/system/node/nodeN/cpulist), restricted to the CPUs the process
+ * is allowed to run on, and with nodes with no such CPUs dropped.  On other systems, or if sysfs isn't available,
+ * the topology is a single node containing all CPUs.
+ */
+class NumaTopology
+{
+public:
+	NumaTopology() = default;
+	~NumaTopology() = default;
+
+	/**
+	 * Build a NumaTopology describing the system we're running on.
+	 */
+	static NumaTopology Discover();
+
+	/**
+	 * Parse a Linux sysfs-format CPU list (e.g. "0-3,8-11") into a vector of CPU numbers.
+	 *
+	 * @param cpulist
+	 * @return  The CPU numbers, in the order they appear in @p cpulist.  Empty if @p cpulist is malformed.
+	 */
+	static std::vector<int> ParseCpuList(const std::string &cpulist);
+
+	[[nodiscard]] size_t num_nodes() const noexcept { return m_node_cpus.size(); };
+
+	/**
+	 * The CPUs belonging to the @p node_index'th node.  Note that this is an index, not the node's number in sysfs.
+	 */
+	[[nodiscard]] const std::vector<int>& cpus(size_t node_index) const { return m_node_cpus.at(node_index); };
+
+	/**
+	 * Restrict the calling thread to the CPUs of the @p node_index'th node.  Since Linux's default memory policy
+	 * allocates pages on the node of the CPU which first touches them, memory the thread allocates and initializes
+	 * after this call will be local to that node.
+	 *
+	 * @param node_index
+	 * @return  true on success, false if the thread couldn't be pinned (or pinning isn't supported).
+	 */
+	bool BindCurrentThreadToNode(size_t node_index) const noexcept;
+
+private:
+
+	/// The CPUs of each node.
+	std::vector<std::vector<int>> m_node_cpus;
+};
+
+#endif /* SRC_LIBEXT_NUMATOPOLOGY_H_ */
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "PerfectHashSet.h"
+
+#include <algorithm>
+
+/// The average number of keys per bucket.  More makes for fewer pilots, but a longer search for them.
+static constexpr size_t f_keys_per_bucket = 4;
+
+/// How many pilots to try for one bucket before giving up on the seed.
+static constexpr uint64_t f_max_pilot = 1 << 16;
+
+/// How many seeds to try before giving up on the perfect hash.  Distinct short keys have distinct words, and so
+/// different hashes under almost every seed, unless they differ only in trailing NULs.
+static constexpr uint64_t f_max_seeds = 64;
+
+void PerfectHashSet::Compile(const std::vector<std::string> &keys)
+{
+	std::vector<std::string> unique_keys {keys};
+	std::sort(unique_keys.begin(), unique_keys.end());
+	unique_keys.erase(std::unique(unique_keys.begin(), unique_keys.end()), unique_keys.end());
+
+	*this = PerfectHashSet();
+
+	std::vector<std::string> short_keys;
+	for(auto &key : unique_keys)
+	{
+		if(key.size() <= sizeof(uint64_t))
+		{
+			short_keys.push_back(std::move(key));
+		}
+		else
+		{
+			m_other_keys.insert(std::move(key));
+		}
+	}
+	if(short_keys.empty())
+	{
+		return;
+	}
+
+	for(uint64_t seed = 0; seed < f_max_seeds; ++seed)
+	{
+		if(TryBuild(short_keys, Hash(seed, 0x9e3779b97f4a7c15ULL)))
+		{
+			return;
+		}
+	}
+
+	// Only keys which differ just in trailing NULs, which can't come from the command line, get here.  They can still
+	// be looked up, just not as fast.
+	m_seed = 0;
+	m_pilot_hashes.clear();
+	m_slots.clear();
+	m_other_keys.insert(short_keys.begin(), short_keys.end());
+}
+
+bool PerfectHashSet::TryBuild(const std::vector<std::string> &keys, uint64_t seed)
+{
+	const size_t num_keys = keys.size();
+	const size_t num_buckets = std::max<size_t>(1, num_keys / f_keys_per_bucket);
+
+	m_seed = seed;
+	m_pilot_hashes.assign(num_buckets, 0);
+	m_slots.assign(num_keys, Slot{0, 0});
+
+	// Sort the keys into buckets.
+	std::vector<std::vector<size_t>> buckets(num_buckets);
+	std::vector<uint64_t> hashes(num_keys);
+	for(size_t i = 0; i < num_keys; ++i)
+	{
+		hashes[i] = Hash(KeyWord(keys[i]), seed);
+		buckets[Reduce(hashes[i] >> 32, num_buckets)].push_back(i);
+	}
+
+	// Place the biggest buckets first, while there's the most room.
+	std::vector<size_t> bucket_order(num_buckets);
+	for(size_t b = 0; b < num_buckets; ++b)
+	{
+		bucket_order[b] = b;
+	}
+	std::stable_sort(bucket_order.begin(), bucket_order.end(),
+			[&buckets](size_t a, size_t b){ return buckets[a].size() > buckets[b].size(); });
+
+	std::vector<bool> taken(num_keys, false);
+	std::vector<size_t> slots;
+	for(size_t b : bucket_order)
+	{
+		const auto &bucket = buckets[b];
+		if(bucket.empty())
+		{
+			break;
+		}
+
+		// Find a pilot which puts each of the bucket's keys in a different free slot.
+		bool placed = false;
+		for(uint64_t pilot = 0; pilot < f_max_pilot && !placed; ++pilot)
+		{
+			uint64_t pilot_hash = Hash(pilot, seed);
+			slots.clear();
+			placed = true;
+			for(size_t i : bucket)
+			{
+				size_t slot = SlotOf(hashes[i], pilot_hash, num_keys);
+				if(taken[slot] || std::find(slots.begin(), slots.end(), slot) != slots.end())
+				{
+					placed = false;
+					break;
+				}
+				slots.push_back(slot);
+			}
+			if(placed)
+			{
+				m_pilot_hashes[b] = pilot_hash;
+			}
+		}
+		if(!placed)
+		{
+			return false;
+		}
+
+		for(size_t k = 0; k < bucket.size(); ++k)
+		{
+			const std::string &key = keys[bucket[k]];
+			taken[slots[k]] = true;
+			m_slots[slots[k]] = Slot{KeyWord(key), key.size()};
+		}
+	}
+
+	return true;
+}
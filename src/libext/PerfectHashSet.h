@@ -0,0 +1,141 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file PerfectHashSet.h */
+
+#ifndef SRC_LIBEXT_PERFECTHASHSET_H_
+#define SRC_LIBEXT_PERFECTHASHSET_H_
+
+#include <config.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * An immutable set of short strings, e.g. filename extensions, with a minimal perfect hash built over them by
+ * Compile(), so that a lookup is always one hash computation, one probe, and one comparison.
+ *
+ * The hash is of the hash-and-displace kind: a key's hash picks a bucket, and the bucket's "pilot", found at
+ * Compile() time, is mixed into the hash to pick the key's slot.  The pilots are chosen so that no two keys share a
+ * slot, and there are exactly as many slots as keys.
+ *
+ * Keys of up to 8 bytes, which is almost all extensions, are hashed and compared as a single 64-bit word, so no two
+ * of them can have the same hash under every seed.  Longer keys can't be packed into a word without losing bytes,
+ * so they're kept in an ordinary hash set instead, which hashes every byte.
+ */
+class PerfectHashSet
+{
+public:
+	PerfectHashSet() = default;
+	~PerfectHashSet() = default;
+
+	/// Replace the contents of the set with @p keys.  Duplicates are ignored.  Any set of keys can be compiled.
+	void Compile(const std::vector<std::string> &keys);
+
+	[[nodiscard]] bool empty() const noexcept { return m_slots.empty() && m_other_keys.empty(); };
+
+	[[nodiscard]] size_t size() const noexcept { return m_slots.size() + m_other_keys.size(); };
+
+	/// @return true if @p key is in the set.
+	[[nodiscard]] bool contains(std::string_view key) const noexcept
+	{
+		if(key.size() <= sizeof(uint64_t) && !m_slots.empty())
+		{
+			// All the short keys are in the perfect hash.
+			uint64_t word = KeyWord(key);
+			const Slot &slot = m_slots[SlotOf(Hash(word, m_seed))];
+			return slot.m_word == word && slot.m_size == key.size();
+		}
+
+		return !m_other_keys.empty() && m_other_keys.find(key) != m_other_keys.end();
+	};
+
+private:
+
+	/// The key, which must be no more than 8 bytes long, as a word: its bytes, zero-padded.
+	static uint64_t KeyWord(std::string_view key) noexcept
+	{
+		uint64_t word = 0;
+		std::memcpy(&word, key.data(), key.size());
+		return word;
+	};
+
+	/// 64-bit mixer, from MurmurHash3's finalizer.
+	static uint64_t Hash(uint64_t word, uint64_t seed) noexcept
+	{
+		word ^= seed;
+		word ^= word >> 33;
+		word *= 0xff51afd7ed558ccdULL;
+		word ^= word >> 33;
+		word *= 0xc4ceb9fe1a85ec53ULL;
+		word ^= word >> 33;
+		return word;
+	};
+
+	/// Map the 32-bit value @p x into [0, @p n) without a division.
+	static size_t Reduce(uint32_t x, size_t n) noexcept { return (static_cast<uint64_t>(x) * n) >> 32; };
+
+	[[nodiscard]] size_t SlotOf(uint64_t hash) const noexcept
+	{
+		return SlotOf(hash, m_pilot_hashes[Reduce(hash >> 32, m_pilot_hashes.size())], m_slots.size());
+	};
+
+	/**
+	 * The slot, out of @p num_slots, of the key with hash @p hash in the bucket whose pilot's hash is @p pilot_hash.
+	 * The multiply spreads all the bits of the combination into the high ones which Reduce() uses, so that two keys
+	 * which differ only in their low bits aren't always in the same slot.
+	 */
+	static size_t SlotOf(uint64_t hash, uint64_t pilot_hash, size_t num_slots) noexcept
+	{
+		return Reduce(((hash ^ pilot_hash) * 0x9e3779b97f4a7c15ULL) >> 32, num_slots);
+	};
+
+	/// Try to build the hash with seed @p seed.  @return false if some bucket's keys couldn't be placed.
+	bool TryBuild(const std::vector<std::string> &keys, uint64_t seed);
+
+	struct Slot
+	{
+		uint64_t m_word;
+		uint64_t m_size;
+	};
+
+	uint64_t m_seed {0};
+
+	/// The hashes of each bucket's pilot.
+	std::vector<uint64_t> m_pilot_hashes;
+
+	/// The keys, by slot.
+	std::vector<Slot> m_slots;
+
+	/// std::hash<std::string_view>, made transparent so that #m_other_keys can be searched without a std::string.
+	struct StringViewHash
+	{
+		using is_transparent = void;
+		size_t operator()(std::string_view key) const noexcept { return std::hash<std::string_view>()(key); };
+	};
+
+	/// The keys longer than 8 bytes.  Also the short keys, in the can't-happen case that no perfect hash of them
+	/// could be found.
+	std::unordered_set<std::string, StringViewHash, std::equal_to<>> m_other_keys;
+};
+
+#endif /* SRC_LIBEXT_PERFECTHASHSET_H_ */
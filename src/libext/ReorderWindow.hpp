@@ -0,0 +1,98 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#ifndef SRC_LIBEXT_REORDERWINDOW_HPP_
+#define SRC_LIBEXT_REORDERWINDOW_HPP_
+
+#include <config.h>
+
+#include <cstddef>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Bounds how far ahead of an in-order consumer a set of out-of-order producers may get.
+ *
+ * Work items carry dense sequence numbers starting at 0.  The consumer emits them strictly in sequence order, holding
+ * any which arrive early in a reorder buffer of size() slots, and calls Advance() as it emits.  A producer calls
+ * WaitUntilInWindow() before handing over an item, which blocks while the item wouldn't fit in the consumer's buffer.
+ * As long as the producers take the items in sequence order, the item the consumer is waiting for is always
+ * inside the window, so this can't deadlock.
+ */
+class ReorderWindow
+{
+public:
+	explicit ReorderWindow(size_t size = 1024) : m_size(size == 0 ? 1 : size) {};
+	~ReorderWindow() = default;
+
+	[[nodiscard]] size_t size() const noexcept { return m_size; };
+
+	/**
+	 * Block until the item with sequence number @p seq can be accepted by the consumer.
+	 *
+	 * @param seq
+	 */
+	void WaitUntilInWindow(size_t seq)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if(seq < m_next + m_size)
+		{
+			return;
+		}
+		++m_num_waiting;
+		m_cv.wait(lock, [this, seq](){ return seq < m_next + m_size; });
+		--m_num_waiting;
+	}
+
+	/**
+	 * Called by the consumer to report that all items before @p next have been emitted.
+	 *
+	 * @param next
+	 */
+	void Advance(size_t next)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_next = next;
+		bool notify = (m_num_waiting > 0);
+		lock.unlock();
+
+		if(notify)
+		{
+			// Only pay for the wakeup if a producer is actually blocked.
+			m_cv.notify_all();
+		}
+	}
+
+private:
+
+	/// Number of slots in the consumer's reorder buffer.
+	const size_t m_size;
+
+	std::mutex m_mutex;
+
+	std::condition_variable m_cv;
+
+	/// The sequence number the consumer is waiting for next.
+	size_t m_next { 0 };
+
+	/// Number of producers blocked in WaitUntilInWindow().
+	int m_num_waiting { 0 };
+};
+
+#endif /* SRC_LIBEXT_REORDERWINDOW_HPP_ */
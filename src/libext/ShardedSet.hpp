@@ -0,0 +1,86 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#ifndef SRC_LIBEXT_SHARDEDSET_HPP_
+#define SRC_LIBEXT_SHARDEDSET_HPP_
+
+#include <config.h>
+
+#include <cstddef>
+#include <array>
+#include <mutex>
+#include <unordered_set>
+#include <functional>
+
+/**
+ * A thread-safe set supporting concurrent insertion, split into NumShards independently-locked std::unordered_set<>s.
+ *
+ * Each key is assigned to a shard by the high bits of its hash, so concurrent inserters only contend when they hit the
+ * same shard.  The shard's own std::unordered_set<> buckets by the low bits of the same hash, so @p Hash should
+ * distribute both well (as e.g. std::hash<dev_ino_pair> does).  Each shard is on its own cache line, so threads
+ * inserting into different shards don't false-share.
+ */
+template <typename Key, typename Hash = std::hash<Key>, std::size_t NumShards = 64>
+class ShardedSet
+{
+	static_assert(NumShards > 0 && (NumShards & (NumShards-1)) == 0, "NumShards must be a power of 2");
+
+public:
+	ShardedSet() = default;
+	~ShardedSet() = default;
+
+	/**
+	 * Reserve space for a total of @p count keys, spread evenly over the shards.
+	 * Not thread-safe, call before sharing the set.
+	 */
+	void reserve(std::size_t count)
+	{
+		for(auto &shard : m_shards)
+		{
+			shard.m_set.reserve(count / NumShards + 1);
+		}
+	}
+
+	/**
+	 * Insert @p key if it isn't already in the set.  Thread-safe.
+	 *
+	 * @param key
+	 * @return  true if @p key was inserted, false if it was already in the set.
+	 */
+	bool insert(const Key &key)
+	{
+		std::size_t h = Hash{}(key);
+		Shard &shard = m_shards[(h >> (sizeof(std::size_t)*8 - 16)) & (NumShards-1)];
+
+		std::lock_guard<std::mutex> lock(shard.m_mutex);
+		return shard.m_set.insert(key).second;
+	}
+
+private:
+
+	struct alignas(64) Shard
+	{
+		std::mutex m_mutex;
+		std::unordered_set<Key, Hash> m_set;
+	};
+
+	std::array<Shard, NumShards> m_shards;
+};
+
+#endif /* SRC_LIBEXT_SHARDEDSET_HPP_ */
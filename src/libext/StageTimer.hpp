@@ -0,0 +1,84 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file StageTimer.hpp
+ * Wall-clock and CPU time accounting for the stages of a pipeline.
+ */
+
+#ifndef SRC_LIBEXT_STAGETIMER_HPP_
+#define SRC_LIBEXT_STAGETIMER_HPP_
+
+#include <config.h>
+
+#include <chrono>
+#include <ctime>
+
+/**
+ * The wall-clock and CPU time spent in one stage, summed over all the threads doing it.
+ */
+struct StageTime
+{
+	std::chrono::nanoseconds m_wall {0};
+	std::chrono::nanoseconds m_cpu {0};
+
+	StageTime& operator+=(const StageTime &other) noexcept
+	{
+		m_wall += other.m_wall;
+		m_cpu += other.m_cpu;
+		return *this;
+	}
+};
+
+/**
+ * Splits the time a thread spends into laps, each charged to a StageTime.  The CPU time is the calling thread's, so a
+ * StageTimer must only be used by the thread which created it.
+ */
+class StageTimer
+{
+public:
+	StageTimer() noexcept : m_wall_start(std::chrono::steady_clock::now()), m_cpu_start(ThreadCpuTime()) {};
+
+	/// Add the time since construction or the last Lap() to @p stage, and start the next lap.
+	void Lap(StageTime &stage) noexcept
+	{
+		auto wall_now = std::chrono::steady_clock::now();
+		auto cpu_now = ThreadCpuTime();
+		stage.m_wall += wall_now - m_wall_start;
+		stage.m_cpu += cpu_now - m_cpu_start;
+		m_wall_start = wall_now;
+		m_cpu_start = cpu_now;
+	}
+
+	/// The CPU time used by the calling thread so far, or 0 if the platform can't tell us.
+	static std::chrono::nanoseconds ThreadCpuTime() noexcept
+	{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+		struct timespec ts;
+		if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+		{
+			return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+		}
+#endif
+		return std::chrono::nanoseconds(0);
+	}
+
+private:
+	std::chrono::steady_clock::time_point m_wall_start;
+	std::chrono::nanoseconds m_cpu_start;
+};
+
+#endif /* SRC_LIBEXT_STAGETIMER_HPP_ */
@@ -0,0 +1,357 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#include <config.h>
+
+#include "StatBatch.h"
+
+#include "Logger.h"
+#include "MountTable.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#if HAVE_SYS_SYSMACROS_H
+#include <sys/sysmacros.h> // For makedev().
+#endif
+
+/// Whether stat()ing a batch through an io_uring is possible at all.
+#define HAVE_IO_URING_STATX (HAVE_STATX && HAVE_DECL_IORING_OP_STATX && HAVE_DECL_IORING_REGISTER_PROBE)
+
+#if HAVE_IO_URING_STATX
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if HAVE_STATX
+/// All we need to know about a file: whether it's a file or directory, how big it is, and for directories, whether
+/// we've been there before.  On network filesystems in particular, the other fields can cost a round trip.
+static constexpr unsigned int f_statx_mask = STATX_TYPE | STATX_SIZE | STATX_INO;
+
+static void f_statx_to_stat(const struct statx &stx, struct stat *statbuf) noexcept
+{
+	*statbuf = {};
+	statbuf->st_mode = stx.stx_mode;
+	statbuf->st_ino = stx.stx_ino;
+	statbuf->st_size = stx.stx_size;
+	statbuf->st_dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+	statbuf->st_blksize = stx.stx_blksize;
+	statbuf->st_nlink = stx.stx_nlink;
+}
+#endif
+
+int fstatat_minimal(int dir_fd, const char *name, struct stat *statbuf, int flags, bool dont_sync) noexcept
+{
+#if HAVE_STATX
+	struct statx stx;
+	if(name[0] == '\0')
+	{
+		flags |= AT_EMPTY_PATH;
+	}
+	int retval = statx(dir_fd, name, flags | (dont_sync ? AT_STATX_DONT_SYNC : 0), f_statx_mask, &stx);
+	if(retval == 0)
+	{
+		f_statx_to_stat(stx, statbuf);
+	}
+	return retval;
+#else
+	(void)dont_sync;
+	if(name[0] == '\0')
+	{
+		return fstat(dir_fd, statbuf);
+	}
+	return fstatat(dir_fd, name, statbuf, flags);
+#endif
+}
+
+#if HAVE_IO_URING_STATX
+
+/**
+ * An io_uring, set up with the raw system calls so there's no dependency on liburing.  Only one thread ever uses it,
+ * so the only synchronization needed is with the kernel, on the ring heads and tails.
+ */
+struct StatBatch::Ring
+{
+	~Ring()
+	{
+		if(m_sqes != MAP_FAILED)
+		{
+			munmap(m_sqes, m_sqes_size);
+		}
+		if(m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+		{
+			munmap(m_cq_ptr, m_cq_size);
+		}
+		if(m_sq_ptr != MAP_FAILED)
+		{
+			munmap(m_sq_ptr, m_sq_size);
+		}
+		if(m_fd >= 0)
+		{
+			close(m_fd);
+		}
+	}
+
+	/// @return true if the ring was set up and the kernel supports IORING_OP_STATX.
+	bool Setup(unsigned entries) noexcept
+	{
+		io_uring_params params {};
+		m_fd = syscall(__NR_io_uring_setup, entries, &params);
+		if(m_fd < 0)
+		{
+			return false;
+		}
+
+		m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+		if(single_mmap)
+		{
+			m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+		}
+
+		m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+		if(m_sq_ptr == MAP_FAILED)
+		{
+			return false;
+		}
+		m_cq_ptr = single_mmap ? m_sq_ptr
+				: mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+		if(m_cq_ptr == MAP_FAILED)
+		{
+			return false;
+		}
+		m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		m_sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+		if(m_sqes == MAP_FAILED)
+		{
+			return false;
+		}
+
+		char *sq = static_cast<char*>(m_sq_ptr);
+		m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+		m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+		m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+		m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+		m_sq_entries = params.sq_entries;
+		char *cq = static_cast<char*>(m_cq_ptr);
+		m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+		m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+		m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+		m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+		// io_uring itself predates IORING_OP_STATX, so ask whether it's there.
+		constexpr unsigned num_probe_ops = IORING_OP_STATX + 1;
+		std::vector<char> probe_buf(sizeof(io_uring_probe) + num_probe_ops * sizeof(io_uring_probe_op), 0);
+		auto *probe = reinterpret_cast<io_uring_probe*>(probe_buf.data());
+		if(syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, num_probe_ops) < 0
+				|| probe->last_op < IORING_OP_STATX
+				|| !(probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED))
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	int m_fd {-1};
+
+	void *m_sq_ptr {MAP_FAILED};
+	size_t m_sq_size {0};
+	void *m_cq_ptr {MAP_FAILED};
+	size_t m_cq_size {0};
+	void *m_sqes {MAP_FAILED};
+	size_t m_sqes_size {0};
+
+	unsigned *m_sq_head {nullptr};
+	unsigned *m_sq_tail {nullptr};
+	unsigned m_sq_mask {0};
+	unsigned *m_sq_array {nullptr};
+	unsigned m_sq_entries {0};
+
+	unsigned *m_cq_head {nullptr};
+	unsigned *m_cq_tail {nullptr};
+	unsigned m_cq_mask {0};
+	io_uring_cqe *m_cqes {nullptr};
+
+	/// The kernel writes the results here.
+	std::vector<struct statx> m_statx_bufs;
+};
+
+#else
+
+/// No io_uring, so there's nothing to set up.
+struct StatBatch::Ring
+{
+};
+
+#endif
+
+StatBatch::StatBatch(unsigned capacity) : m_capacity(std::max(1U, capacity))
+{
+	m_entries.reserve(m_capacity);
+}
+
+StatBatch::~StatBatch() = default;
+
+void StatBatch::Add(std::string_view name, ino_t ino, int flags)
+{
+	m_entries.push_back(Entry{m_names.size(), name.size(), ino, flags, 0, false, {}});
+	m_names.append(name);
+	m_names.push_back('\0');
+}
+
+std::string_view StatBatch::GetName(size_t i) const noexcept
+{
+	return std::string_view(m_names.data() + m_entries[i].m_name_offset, m_entries[i].m_name_size);
+}
+
+void StatBatch::clear() noexcept
+{
+	m_entries.clear();
+	m_names.clear();
+}
+
+bool StatBatch::DontSync(int dir_fd, dev_t dev)
+{
+	auto it = m_dont_sync_by_dev.find(dev);
+	if(it != m_dont_sync_by_dev.end())
+	{
+		return it->second;
+	}
+
+	bool dont_sync = (get_filesystem_kind(dir_fd) == FSK_NETWORK);
+	m_dont_sync_by_dev.emplace(dev, dont_sync);
+	return dont_sync;
+}
+
+void StatBatch::Run(int dir_fd, dev_t dev)
+{
+	if(m_entries.empty())
+	{
+		return;
+	}
+
+	bool dont_sync = DontSync(dir_fd, dev);
+
+#if HAVE_IO_URING_STATX
+	// A lone entry is one system call either way.
+	if(m_entries.size() > 1 && !m_ring && !m_ring_unavailable)
+	{
+		m_ring = std::make_unique<Ring>();
+		if(!m_ring->Setup(m_capacity))
+		{
+			LOG(INFO) << "io_uring statx unavailable, stat()ing one file at a time";
+			m_ring.reset();
+			m_ring_unavailable = true;
+		}
+	}
+	if(m_entries.size() > 1 && m_ring && !m_ring_unavailable)
+	{
+		if(!RunWithRing(dir_fd, dont_sync ? AT_STATX_DONT_SYNC : 0))
+		{
+			// Some requests might still be in flight, so the ring and its buffers are kept until we're destroyed.
+			WARN() << "io_uring failed, stat()ing one file at a time: " << LOG_STRERROR();
+			m_ring_unavailable = true;
+		}
+	}
+#endif
+
+	// Do whatever the ring didn't.
+	for(auto &entry : m_entries)
+	{
+		if(!entry.m_done)
+		{
+			int retval = fstatat_minimal(dir_fd, m_names.data() + entry.m_name_offset, &entry.m_stat, entry.m_flags,
+					dont_sync);
+			entry.m_error = (retval == 0) ? 0 : errno;
+			entry.m_done = true;
+		}
+	}
+}
+
+bool StatBatch::RunWithRing(int dir_fd, int flags_to_add)
+{
+#if HAVE_IO_URING_STATX
+	Ring &ring = *m_ring;
+	ring.m_statx_bufs.resize(m_entries.size());
+
+	// The batch is never bigger than the submission queue, so it all goes in at once.
+	unsigned tail = *ring.m_sq_tail;
+	for(size_t i = 0; i < m_entries.size(); ++i)
+	{
+		const Entry &entry = m_entries[i];
+		unsigned index = tail & ring.m_sq_mask;
+		io_uring_sqe *sqe = static_cast<io_uring_sqe*>(ring.m_sqes) + index;
+		std::memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_STATX;
+		sqe->fd = dir_fd;
+		sqe->addr = reinterpret_cast<uintptr_t>(m_names.data() + entry.m_name_offset);
+		sqe->len = f_statx_mask;
+		sqe->off = reinterpret_cast<uintptr_t>(&ring.m_statx_bufs[i]);
+		sqe->statx_flags = entry.m_flags | flags_to_add;
+		sqe->user_data = i;
+		ring.m_sq_array[index] = index;
+		++tail;
+	}
+	__atomic_store_n(ring.m_sq_tail, tail, __ATOMIC_RELEASE);
+
+	size_t num_reaped = 0;
+	unsigned cq_head = *ring.m_cq_head;
+	while(num_reaped < m_entries.size())
+	{
+		// Collect whatever has completed.
+		unsigned cq_tail = __atomic_load_n(ring.m_cq_tail, __ATOMIC_ACQUIRE);
+		for(; cq_head != cq_tail; ++cq_head, ++num_reaped)
+		{
+			const io_uring_cqe &cqe = ring.m_cqes[cq_head & ring.m_cq_mask];
+			Entry &entry = m_entries[cqe.user_data];
+			entry.m_error = (cqe.res < 0) ? -cqe.res : 0;
+			if(entry.m_error == 0)
+			{
+				f_statx_to_stat(ring.m_statx_bufs[cqe.user_data], &entry.m_stat);
+			}
+			entry.m_done = true;
+		}
+		__atomic_store_n(ring.m_cq_head, cq_head, __ATOMIC_RELEASE);
+		if(num_reaped == m_entries.size())
+		{
+			break;
+		}
+
+		// Submit whatever the kernel hasn't taken yet, and wait for at least one more to complete.
+		unsigned to_submit = tail - __atomic_load_n(ring.m_sq_head, __ATOMIC_ACQUIRE);
+		if(syscall(__NR_io_uring_enter, ring.m_fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+				&& errno != EINTR && errno != EAGAIN && errno != EBUSY)
+		{
+			return false;
+		}
+	}
+
+	return true;
+#else
+	(void)dir_fd;
+	(void)flags_to_add;
+	return false;
+#endif
+}
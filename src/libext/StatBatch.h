@@ -0,0 +1,140 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file StatBatch.h */
+
+#ifndef SRC_LIBEXT_STATBATCH_H_
+#define SRC_LIBEXT_STATBATCH_H_
+
+#include <config.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/**
+ * fstatat(), but only fetching the file's type, size, and inode number (plus the device and block size, which come
+ * for free), with statx() where it's available.  The other fields of @p statbuf are zero.  If @p name is empty,
+ * @p dir_fd itself is stat()ed, as with fstat().
+ *
+ * @param dont_sync  Pass AT_STATX_DONT_SYNC, i.e. let a network filesystem answer from its attribute cache instead
+ *                   of asking the server.  Ignored without statx().
+ * @return 0 on success, -1 with errno set on failure.
+ */
+int fstatat_minimal(int dir_fd, const char *name, struct stat *statbuf, int flags, bool dont_sync = false) noexcept;
+
+/**
+ * A batch of names in one directory to be stat()ed all at once, as with fstatat_minimal().
+ *
+ * Where the kernel supports it, the whole batch is submitted to an io_uring as IORING_OP_STATX requests with a single
+ * system call, so that on a network filesystem the requests to the server are in flight together instead of one
+ * after another.  Otherwise each name is stat()ed in turn.  The io_uring is only set up once a batch of more than one
+ * name is run, so traversals which never need to stat anything never pay for it.
+ *
+ * On network filesystems (see get_filesystem_kind()), AT_STATX_DONT_SYNC is used.  Which filesystems are on the
+ * network is remembered by device number, so that's only looked up once per filesystem.
+ *
+ * Not thread-safe; each traversal thread has its own.
+ */
+class StatBatch
+{
+public:
+	/// @param capacity  The most names a batch holds, and the size of the io_uring's submission queue.
+	explicit StatBatch(unsigned capacity = 64);
+	~StatBatch();
+
+	StatBatch(const StatBatch&) = delete;
+	StatBatch& operator=(const StatBatch&) = delete;
+
+	[[nodiscard]] size_t size() const noexcept { return m_entries.size(); };
+	[[nodiscard]] bool empty() const noexcept { return m_entries.empty(); };
+	[[nodiscard]] bool full() const noexcept { return m_entries.size() >= m_capacity; };
+
+	/**
+	 * Add @p name to the batch, to be stat()ed with the AT_* @p flags.  The name is copied.
+	 *
+	 * @param ino  The name's inode number from its dirent, passed back by GetIno().
+	 */
+	void Add(std::string_view name, ino_t ino, int flags);
+
+	/**
+	 * Stat all the names in the batch.
+	 *
+	 * @param dir_fd  The directory they're relative to.
+	 * @param dev     The device number of the directory, for remembering whether it's on a network filesystem.
+	 */
+	void Run(int dir_fd, dev_t dev);
+
+	/// @name The entries, and after Run(), their results.
+	///@{
+	/// The name, NUL-terminated.
+	[[nodiscard]] std::string_view GetName(size_t i) const noexcept;
+	[[nodiscard]] ino_t GetIno(size_t i) const noexcept { return m_entries[i].m_ino; };
+	/// The errno from stat()ing the name, or 0 on success.
+	[[nodiscard]] int GetError(size_t i) const noexcept { return m_entries[i].m_error; };
+	/// The result, if GetError() is 0.
+	[[nodiscard]] const struct stat& GetStat(size_t i) const noexcept { return m_entries[i].m_stat; };
+	///@}
+
+	/// Empty the batch.
+	void clear() noexcept;
+
+private:
+
+	/// Whether to pass AT_STATX_DONT_SYNC for the directory @p dir_fd on device @p dev.
+	bool DontSync(int dir_fd, dev_t dev);
+
+	/// Run the batch through the io_uring.  @return false if the io_uring failed, and the rest have to be done
+	/// without it.
+	bool RunWithRing(int dir_fd, int flags_to_add);
+
+	struct Entry
+	{
+		/// Offset of the name in #m_names.
+		size_t m_name_offset;
+		size_t m_name_size;
+		ino_t m_ino;
+		int m_flags;
+		int m_error;
+		bool m_done;
+		struct stat m_stat;
+	};
+
+	unsigned m_capacity;
+
+	std::vector<Entry> m_entries;
+
+	/// The names, each followed by a NUL.
+	std::string m_names;
+
+	/// Device number to whether it's a network filesystem.
+	std::unordered_map<dev_t, bool> m_dont_sync_by_dev;
+
+	/// The io_uring, if it's been set up.
+	struct Ring;
+	std::unique_ptr<Ring> m_ring;
+
+	/// Set if setting up the io_uring failed, so that it isn't tried again.
+	bool m_ring_unavailable { false };
+};
+
+#endif /* SRC_LIBEXT_STATBATCH_H_ */
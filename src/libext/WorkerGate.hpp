@@ -0,0 +1,122 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file */
+
+#ifndef SRC_LIBEXT_WORKERGATE_HPP_
+#define SRC_LIBEXT_WORKERGATE_HPP_
+
+#include <config.h>
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+/**
+ * Gate controlling how many of a fixed pool of worker threads are allowed to run at any one time.
+ *
+ * The pool is started with max() threads, each with a unique index in [0, max()).  Workers call WaitUntilActive()
+ * between work items; a worker whose index is >= the current active count parks there until the count is raised
+ * or the gate is opened.  The active count is changed at runtime via SetActive(), e.g. by the AutoTuner.
+ */
+class WorkerGate
+{
+public:
+	WorkerGate(int max_workers, int initial_active)
+		: m_max(std::max(1, max_workers)), m_active(std::clamp(initial_active, 1, m_max)) {};
+	~WorkerGate() = default;
+
+	[[nodiscard]] int max() const noexcept { return m_max; };
+
+	[[nodiscard]] int active() const noexcept { return m_active.load(std::memory_order_relaxed); };
+
+	/**
+	 * Set the number of workers allowed to run.  Clamped to [1, max()].
+	 *
+	 * @param num_active
+	 * @return  The new number of active workers.
+	 */
+	int SetActive(int num_active)
+	{
+		num_active = std::clamp(num_active, 1, m_max);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_active.store(num_active, std::memory_order_relaxed);
+		lock.unlock();
+
+		// Wake up everyone, the workers will sort out which of them is now allowed to run.
+		m_cv.notify_all();
+
+		return num_active;
+	}
+
+	/**
+	 * Permanently release all parked workers, e.g. because the work queue they're pulling from has been closed.
+	 */
+	void Open()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_open = true;
+		lock.unlock();
+		m_cv.notify_all();
+	}
+
+	/**
+	 * Non-blocking check of whether worker @p worker_index is currently allowed to run.
+	 */
+	[[nodiscard]] bool IsActive(int worker_index) const noexcept
+	{
+		return worker_index < m_active.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Block the calling worker until it's allowed to run.
+	 *
+	 * @param worker_index  The index of the calling worker, in [0, max()).
+	 * @return  true if the worker had to park, false if it was allowed to run immediately.
+	 */
+	bool WaitUntilActive(int worker_index)
+	{
+		if(IsActive(worker_index))
+		{
+			// Fast path, no locking.
+			return false;
+		}
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait(lock, [this, worker_index](){ return m_open || IsActive(worker_index); });
+		return true;
+	}
+
+private:
+
+	/// The number of workers in the pool.
+	const int m_max;
+
+	/// The number of workers currently allowed to run.
+	std::atomic<int> m_active;
+
+	std::mutex m_mutex;
+
+	std::condition_variable m_cv;
+
+	/// Set by Open(), lets all workers through unconditionally.
+	bool m_open { false };
+};
+
+#endif /* SRC_LIBEXT_WORKERGATE_HPP_ */
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file
+ * Vectorized searches for a single byte value, e.g. for finding the line boundaries around a match.
+ */
+
+#ifndef SRC_LIBEXT_BYTESEARCH_HPP_
+#define SRC_LIBEXT_BYTESEARCH_HPP_
+
+#include <config.h>
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "integer.hpp"
+#include "hints.hpp"
+
+/**
+ * Find the first occurrence of @p c in [@p begin, @p end).
+ *
+ * @note This is simply memchr(), which every libc we care about already vectorizes, in glibc's case with whatever
+ * the best instruction set the CPU supports is.  It's here for symmetry with find_byte_backward().
+ *
+ * @return  Pointer to the first @p c, or @p end if there isn't one.
+ */
+inline const char * find_byte_forward(const char * __restrict__ begin, const char * __restrict__ end, char c) noexcept
+{
+	const void *found = std::memchr(begin, c, end - begin);
+	return (found == nullptr) ? end : static_cast<const char *>(found);
+}
+
+/**
+ * Find the last occurrence of @p c in [@p begin, @p end).  The reverse analog of memchr(), which unlike the forward
+ * direction isn't portably available (memrchr() is a GNU extension).  Searches 16 bytes at a time with SSE2 where
+ * available.
+ *
+ * @return  Pointer to the last @p c, or nullptr if there isn't one.
+ */
+inline const char * find_byte_backward(const char * __restrict__ begin, const char * __restrict__ end, char c) noexcept
+{
+#if defined(__SSE2__)
+	// The character we're looking for, broadcast to all 16 bytes.
+	const __m128i looking_for = _mm_set1_epi8(c);
+
+	// Work backwards in 16-byte blocks.  These loads are unaligned, but stay within [begin, end), so we never touch
+	// a page that isn't ours.
+	while(end - begin >= 16)
+	{
+		end -= 16;
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(end));
+		uint32_t match_bitmask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, looking_for));
+		if(match_bitmask != 0)
+		{
+			// The most significant set bit is the last match in the block.
+			return end + find_last_set_bit(match_bitmask) - 1;
+		}
+	}
+#endif
+
+	// Whatever's left, or everything if we don't have SSE2.
+	while(end != begin)
+	{
+		--end;
+		if(*end == c)
+		{
+			return end;
+		}
+	}
+
+	return nullptr;
+}
+
+/**
+ * Count the UTF-8 code points in [@p begin, @p end), i.e. the bytes which aren't continuation bytes.  Invalid
+ * sequences count as one code point per byte which isn't a continuation byte.
+ *
+ * @note This is written as a simple loop with no early exit so that the compiler can vectorize it.
+ */
+inline size_t count_utf8_codepoints(const char * __restrict__ begin, const char * __restrict__ end) noexcept
+{
+	size_t count = 0;
+	for(const char *p = begin; p != end; ++p)
+	{
+		count += ((static_cast<unsigned char>(*p) & 0xC0) != 0x80);
+	}
+	return count;
+}
+
+#endif /* SRC_LIBEXT_BYTESEARCH_HPP_ */
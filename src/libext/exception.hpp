@@ -24,6 +24,7 @@
 
 #include <future/string.hpp>
 #include <exception>
+#include <iostream>
 
 inline void print_exception_stack(const std::exception& e, size_t indentation_level = 0)
 {
@@ -48,6 +48,7 @@
 #include <cstring>
 #include <cstdlib>   // For free().
 #include <string>
+#include <string_view>
 #include <iterator>   // For std::distance().
 #include <future/type_traits.hpp>
 #include <future/memory.hpp>
@@ -148,7 +149,11 @@ struct dev_ino_pair
 	dev_ino_pair(dev_t d, ino_t i) noexcept : m_dev(d), m_ino(i) { };
 	~dev_ino_pair() = default;
 
-	inline bool operator<(const dev_ino_pair& other) const noexcept { return m_dev < other.m_dev || m_ino < other.m_ino; };
+	/// Lexicographical ordering, by device and then inode.
+	inline bool operator<(const dev_ino_pair& other) const noexcept
+	{
+		return m_dev < other.m_dev || (m_dev == other.m_dev && m_ino < other.m_ino);
+	};
 
 	inline bool operator==(dev_ino_pair other) const noexcept { return m_dev == other.m_dev && m_ino == other.m_ino; };
 
@@ -170,11 +175,11 @@ namespace std
 	template <>
 	struct hash<dev_ino_pair>
 	{
-		std::size_t operator()(const dev_ino_pair p) const
+		std::size_t operator()(const dev_ino_pair p) const noexcept
 		{
-			const std::size_t h1 (std::hash<dev_t>{}(p.m_dev));
-			const std::size_t h2 (std::hash<dev_t>{}(p.m_ino));
-			return h1 ^ (h2 << 1);
+			// std::hash<> of an integer is usually the identity, and inode numbers on a device tend to be
+			// clustered, so mix all the bits of both together.
+			return static_cast<std::size_t>(hash_128_to_64(static_cast<uint64_t>(p.m_dev), static_cast<uint64_t>(p.m_ino)));
 		}
 	};
 }
@@ -363,10 +368,10 @@ inline std::string canonicalize_file_name(const std::string &path)
  * @param path
  * @return
  */
-inline bool is_pathname_absolute(const std::string &path) noexcept
+inline bool is_pathname_absolute(std::string_view path) noexcept
 {
 #if 1 // == IS_POSIX
-	if(path[0] == '/')
+	if(!path.empty() && path[0] == '/')
 	{
 		return true;
 	}
@@ -320,4 +320,46 @@ inline uint8_t find_first_set_bit(uint64_t bits) noexcept
 #error "generic find_first_set_bit() not yet implemented."
 #endif
 
+/**
+ * Find the last (most significant) set bit in @p bits.
+ * @param bits
+ * @return  0 if no bits set. 1+bit_index for the last set bit.
+ */
+inline uint8_t find_last_set_bit(uint32_t bits) noexcept ATTR_CONST ATTR_ARTIFICIAL;
+inline uint8_t find_last_set_bit(uint32_t bits) noexcept
+{
+#if defined(HAVE___BUILTIN_CLZ)
+	// __builtin_clz() is undefined for 0.
+	return (bits == 0) ? 0 : 32 - __builtin_clz(bits);
+#else
+	uint8_t retval = 0;
+	while(bits != 0)
+	{
+		++retval;
+		bits >>= 1;
+	}
+	return retval;
+#endif
+}
+
+/**
+ * Mix the 128 bits @p hi:@p lo down to a 64-bit hash value, with every input bit affecting every output bit.
+ * This is the Murmur-inspired Hash128to64() from Google's CityHash.  Unlike combining two std::hash<>es, which
+ * for integers are usually the identity function, this gives well-distributed low *and* high bits.
+ *
+ * @param hi
+ * @param lo
+ * @return
+ */
+constexpr inline uint64_t hash_128_to_64(uint64_t hi, uint64_t lo) noexcept
+{
+	constexpr uint64_t k_mul = 0x9ddfea08eb382d69ULL;
+	uint64_t a = (lo ^ hi) * k_mul;
+	a ^= (a >> 47);
+	uint64_t b = (hi ^ a) * k_mul;
+	b ^= (b >> 47);
+	b *= k_mul;
+	return b;
+}
+
 #endif /* SRC_LIBEXT_INTEGER_HPP_ */
@@ -0,0 +1,216 @@
+/*
+ * Copyright 2016 Gary R. Van Sickle (grvs@users.sourceforge.net).
+ *
+ * This file is part of UniversalCodeGrep.
+ *
+ * UniversalCodeGrep is free software: you can redistribute it and/or modify it under the
+ * terms of version 3 of the GNU General Public License as published by the Free
+ * Software Foundation.
+ *
+ * UniversalCodeGrep is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * UniversalCodeGrep.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** @file serialize.hpp
+ * Encoders for machine-readable output.  These all append straight to a std::string output buffer, with no
+ * intermediate streams or temporary strings.
+ */
+
+#ifndef SRC_LIBEXT_SERIALIZE_HPP_
+#define SRC_LIBEXT_SERIALIZE_HPP_
+
+#include <config.h>
+
+#include <cstdint>
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * Append the decimal representation of @p value to @p out.
+ */
+template <typename T>
+inline void append_decimal(std::string &out, T value)
+{
+	static_assert(std::is_integral<T>::value, "append_decimal() requires an integral type");
+
+	char buffer[24];
+	auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+	out.append(buffer, result.ptr - buffer);
+}
+
+/**
+ * Append @p value to @p out as sizeof(T) bytes, least significant byte first, whatever the host byte order.
+ */
+template <typename T>
+inline void append_le(std::string &out, T value)
+{
+	static_assert(std::is_unsigned<T>::value, "append_le() requires an unsigned type");
+
+	char buffer[sizeof(T)];
+	for(size_t i = 0; i < sizeof(T); ++i)
+	{
+		buffer[i] = static_cast<char>(value & 0xFF);
+		value = static_cast<T>(value >> 8);
+	}
+	out.append(buffer, sizeof(T));
+}
+
+/**
+ * Check if @p s is well-formed UTF-8, i.e. has no stray continuation bytes, truncated sequences, overlong encodings,
+ * surrogates, or code points past U+10FFFF.
+ */
+inline bool is_valid_utf8(std::string_view s) noexcept
+{
+	const auto *p = reinterpret_cast<const unsigned char *>(s.data());
+	const auto *end = p + s.size();
+
+	while(p != end)
+	{
+		if(*p < 0x80)
+		{
+			++p;
+			continue;
+		}
+
+		// The number of continuation bytes, and the range the second byte has to be in to rule out overlong
+		// encodings, surrogates, and values which are too large.
+		size_t num_continuation;
+		unsigned char second_min = 0x80, second_max = 0xBF;
+		if(*p >= 0xC2 && *p <= 0xDF)
+		{
+			num_continuation = 1;
+		}
+		else if(*p >= 0xE0 && *p <= 0xEF)
+		{
+			num_continuation = 2;
+			if(*p == 0xE0) { second_min = 0xA0; }
+			else if(*p == 0xED) { second_max = 0x9F; }
+		}
+		else if(*p >= 0xF0 && *p <= 0xF4)
+		{
+			num_continuation = 3;
+			if(*p == 0xF0) { second_min = 0x90; }
+			else if(*p == 0xF4) { second_max = 0x8F; }
+		}
+		else
+		{
+			return false;
+		}
+
+		if(static_cast<size_t>(end - p) <= num_continuation || p[1] < second_min || p[1] > second_max)
+		{
+			return false;
+		}
+		for(size_t i = 2; i <= num_continuation; ++i)
+		{
+			if((p[i] & 0xC0) != 0x80)
+			{
+				return false;
+			}
+		}
+		p += num_continuation + 1;
+	}
+
+	return true;
+}
+
+/**
+ * Append @p bytes to @p out, base64-encoded (RFC 4648, with padding).
+ */
+inline void append_base64(std::string &out, std::string_view bytes)
+{
+	static constexpr char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	const auto *p = reinterpret_cast<const unsigned char *>(bytes.data());
+	size_t len = bytes.size();
+
+	out.reserve(out.size() + 4*((len+2)/3));
+	for(; len >= 3; p += 3, len -= 3)
+	{
+		uint32_t triple = (p[0] << 16) | (p[1] << 8) | p[2];
+		out += alphabet[(triple >> 18) & 0x3F];
+		out += alphabet[(triple >> 12) & 0x3F];
+		out += alphabet[(triple >> 6) & 0x3F];
+		out += alphabet[triple & 0x3F];
+	}
+	if(len > 0)
+	{
+		uint32_t triple = (p[0] << 16) | ((len == 2) ? (p[1] << 8) : 0);
+		out += alphabet[(triple >> 18) & 0x3F];
+		out += alphabet[(triple >> 12) & 0x3F];
+		out += (len == 2) ? alphabet[(triple >> 6) & 0x3F] : '=';
+		out += '=';
+	}
+}
+
+/**
+ * Append @p s to @p out as a quoted JSON string.  @p s must be valid UTF-8.
+ */
+inline void append_json_string(std::string &out, std::string_view s)
+{
+	static constexpr char hex_digits[] = "0123456789abcdef";
+
+	out += '"';
+
+	// Copy runs of characters which don't need escaping in one go.
+	size_t run_start = 0;
+	for(size_t i = 0; i < s.size(); ++i)
+	{
+		unsigned char c = s[i];
+		if(c >= 0x20 && c != '"' && c != '\\')
+		{
+			continue;
+		}
+
+		out.append(s.data() + run_start, i - run_start);
+		run_start = i + 1;
+
+		out += '\\';
+		switch(c)
+		{
+		case '"': out += '"'; break;
+		case '\\': out += '\\'; break;
+		case '\n': out += 'n'; break;
+		case '\r': out += 'r'; break;
+		case '\t': out += 't'; break;
+		case '\b': out += 'b'; break;
+		case '\f': out += 'f'; break;
+		default:
+			out += "u00";
+			out += hex_digits[c >> 4];
+			out += hex_digits[c & 0xF];
+			break;
+		}
+	}
+	out.append(s.data() + run_start, s.size() - run_start);
+
+	out += '"';
+}
+
+/**
+ * Append @p data to @p out as a JSON object holding arbitrary bytes, in the form ripgrep's --json output uses:
+ * @c {"text":"..."} if @p data is valid UTF-8, or @c {"bytes":"<base64>"} if it isn't.
+ */
+inline void append_json_data(std::string &out, std::string_view data)
+{
+	if(is_valid_utf8(data))
+	{
+		out += "{\"text\":";
+		append_json_string(out, data);
+	}
+	else
+	{
+		out += "{\"bytes\":\"";
+		append_base64(out, data);
+		out += '"';
+	}
+	out += '}';
+}
+
+#endif /* SRC_LIBEXT_SERIALIZE_HPP_ */
@@ -24,7 +24,10 @@
 
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
 #include <queue>
+#include <algorithm>
+#include <iterator>
 #include <libext/hints.hpp>
 
 #if TODO
@@ -80,6 +83,13 @@ public:
 		return m_underlying_queue.size();
 	}
 
+	/// The most items the queue has held at once.
+	size_type high_water() const noexcept
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		return m_high_water;
+	}
+
 	void close()
 	{
 		std::unique_lock<std::mutex> lock(m_mutex);
@@ -107,6 +117,7 @@ public:
 
 		// Push via copy.
 		m_underlying_queue.push_back(x);
+		m_high_water = std::max(m_high_water, m_underlying_queue.size());
 
 		// Unlock the mutex immediately prior to notify.  This prevents a waiting thread from being immediately woken up
 		// by the notify, and then blocking because we still hold the mutex.
@@ -133,6 +144,7 @@ public:
 
 		// Push via move.
 		m_underlying_queue.push_back(std::move(x));
+		m_high_water = std::max(m_high_water, m_underlying_queue.size());
 
 		// Unlock the mutex immediately prior to notify.  This prevents a waiting thread from being immediately woken up
 		// by the notify, and then blocking because we still hold the mutex.
@@ -168,6 +180,7 @@ public:
 		m_underlying_queue.insert(m_underlying_queue.end(), /// @note This should be cend() AFAICT, but that won't compile on old clang.
 				std::make_move_iterator(ContainerOfValues.begin()),
 				std::make_move_iterator(ContainerOfValues.end()));
+		m_high_water = std::max(m_high_water, m_underlying_queue.size());
 
 		// Unlock the mutex immediately prior to notify.  This prevents a waiting thread from being immediately woken up
 		// by the notify, and then blocking because we still hold the mutex.
@@ -246,6 +259,146 @@ public:
 		return queue_op_status::success;
 	}
 
+	/**
+	 * Non-blocking pull.
+	 *
+	 * @param x
+	 * @return  queue_op_status::success if an item was pulled into @p x, queue_op_status::closed if the queue is
+	 *          closed and empty, or queue_op_status::empty if the queue is open and empty.
+	 */
+	queue_op_status try_pull_front(ValueType& x) ATTR_NOINLINE
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		if(m_underlying_queue.empty())
+		{
+			return m_closed ? queue_op_status::closed : queue_op_status::empty;
+		}
+
+		x = std::move(m_underlying_queue.front());
+		m_underlying_queue.pop_front();
+
+		return queue_op_status::success;
+	}
+
+	/**
+	 * Pull up to @p max_items values off the queue in one operation, appending them to @p ContainerOfValues.
+	 * Blocks until there's at least one value to pull, or the queue is closed.  The batch analog of
+	 * push_back(T& ContainerOfValues).
+	 *
+	 * @note This is not a Boost API.
+	 *
+	 * @param ContainerOfValues
+	 * @param max_items
+	 * @return
+	 */
+	template <typename T, typename Unused = typename T::value_type>
+	queue_op_status ATTR_NOINLINE pull_front(T& ContainerOfValues, size_type max_items)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_num_waiting_threads++;
+
+		if(m_num_waiting_threads == m_num_waiting_threads_notification_level)
+		{
+			m_cv_complete.notify_all();
+		}
+
+		// Wait until the queue is not empty, or somebody closes the sync_queue<>.
+		m_cv.wait(lock, [this](){ return !m_underlying_queue.empty() || m_closed; });
+
+		m_num_waiting_threads--;
+
+		if(m_underlying_queue.empty() && m_closed)
+		{
+			return queue_op_status::closed;
+		}
+
+		auto num_to_pull = std::min(max_items, m_underlying_queue.size());
+		ContainerOfValues.insert(ContainerOfValues.end(),
+				std::make_move_iterator(m_underlying_queue.begin()),
+				std::make_move_iterator(m_underlying_queue.begin() + num_to_pull));
+		m_underlying_queue.erase(m_underlying_queue.begin(), m_underlying_queue.begin() + num_to_pull);
+
+		return queue_op_status::success;
+	}
+
+	/**
+	 * As pull_front(T& ContainerOfValues, size_type max_items), but gives up if there's still nothing to pull at
+	 * @p deadline.
+	 *
+	 * @note This is not a Boost API.
+	 *
+	 * @return  queue_op_status::timeout if @p deadline passed with the queue open and empty, otherwise as the
+	 *          untimed version.
+	 */
+	template <typename T, typename Clock, typename Duration, typename Unused = typename T::value_type>
+	queue_op_status ATTR_NOINLINE pull_front_until(T& ContainerOfValues, size_type max_items,
+			const std::chrono::time_point<Clock, Duration> &deadline)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		m_num_waiting_threads++;
+
+		if(m_num_waiting_threads == m_num_waiting_threads_notification_level)
+		{
+			m_cv_complete.notify_all();
+		}
+
+		// Wait until the queue is not empty, somebody closes the sync_queue<>, or we time out.
+		bool ready = m_cv.wait_until(lock, deadline, [this](){ return !m_underlying_queue.empty() || m_closed; });
+
+		m_num_waiting_threads--;
+
+		if(!ready)
+		{
+			return queue_op_status::timeout;
+		}
+
+		if(m_underlying_queue.empty() && m_closed)
+		{
+			return queue_op_status::closed;
+		}
+
+		auto num_to_pull = std::min(max_items, m_underlying_queue.size());
+		ContainerOfValues.insert(ContainerOfValues.end(),
+				std::make_move_iterator(m_underlying_queue.begin()),
+				std::make_move_iterator(m_underlying_queue.begin() + num_to_pull));
+		m_underlying_queue.erase(m_underlying_queue.begin(), m_underlying_queue.begin() + num_to_pull);
+
+		return queue_op_status::success;
+	}
+
+	/**
+	 * Set the number of worker threads which wait_for_worker_completion() will expect to find waiting on the queue.
+	 * Use this instead of passing a non-zero @p num_workers to wait_for_worker_completion() when some of the workers
+	 * may call adjust_num_workers() before the master thread gets around to waiting.
+	 *
+	 * @param num_workers
+	 */
+	void set_num_workers(size_t num_workers)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_num_waiting_threads_notification_level = num_workers;
+		lock.unlock();
+		m_cv_complete.notify_all();
+	}
+
+	/**
+	 * Adjust the number of worker threads which wait_for_worker_completion() expects by @p delta.  A worker which is
+	 * going to stop pulling from the queue for a while (e.g. because it's been throttled) calls this with -1 first, and
+	 * with +1 before it resumes pulling, so that the remaining workers can still be detected as complete.
+	 *
+	 * @param delta
+	 */
+	void adjust_num_workers(long delta)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_num_waiting_threads_notification_level += delta;
+		lock.unlock();
+		m_cv_complete.notify_all();
+	}
+
 	/**
 	 *  Blocks the calling thread until:
 	 *	 - The queue is empty, and
@@ -300,6 +453,9 @@ private:
 	size_t m_num_waiting_threads { 0 };
 
 	bool m_closed { false };
+
+	/// See high_water().
+	size_type m_high_water { 0 };
 };
 
 #endif /* SYNC_QUEUE_H_ */
@@ -25,6 +25,12 @@
 /// @todo Microstring testing should be moved to its own file.
 #include "../src/libext/microstring.hpp"
 
+#include "../src/libext/PerfectHashSet.h"
+#include "../src/libext/GlobSet.h"
+
+#include <fnmatch.h>
+#include <random>
+
 namespace {
 
 // The fixture for testing class Foo.
@@ -143,6 +149,163 @@ TEST_F(OptimizationsTest, microstring_length)
 	EXPECT_EQ(8, ms8.length());
 }
 
+TEST(PerfectHashSetTest, lookups)
+{
+	PerfectHashSet phs;
+	phs.Compile({"c", "cpp", "h", "hpp", "py", "12345678", "cxx"});
+
+	EXPECT_EQ(7U, phs.size());
+	EXPECT_TRUE(phs.contains("c"));
+	EXPECT_TRUE(phs.contains("cpp"));
+	EXPECT_TRUE(phs.contains("12345678"));
+	EXPECT_FALSE(phs.contains(""));
+	EXPECT_FALSE(phs.contains("cp"));
+	EXPECT_FALSE(phs.contains("cppp"));
+	EXPECT_FALSE(phs.contains("123456789"));
+	EXPECT_FALSE(phs.contains(std::string_view("c\0", 2)));
+
+	// Enough keys to need several buckets.
+	std::vector<std::string> keys;
+	for(int i = 0; i < 1000; ++i)
+	{
+		keys.push_back("k" + std::to_string(i));
+	}
+	phs.Compile(keys);
+	EXPECT_EQ(1000U, phs.size());
+	for(const auto &key : keys)
+	{
+		EXPECT_TRUE(phs.contains(key)) << key;
+	}
+	EXPECT_FALSE(phs.contains("k1000"));
+	EXPECT_FALSE(phs.contains("c"));
+}
+
+TEST(PerfectHashSetTest, long_keys_differing_in_the_middle)
+{
+	PerfectHashSet phs;
+	std::vector<std::string> keys;
+	for(char c = 'A'; c <= 'Z'; ++c)
+	{
+		keys.push_back(std::string("aaaaaaaa") + c + "bbbbbbbb");
+	}
+	keys.push_back("xqz");
+
+	phs.Compile(keys);
+
+	EXPECT_EQ(27U, phs.size());
+	for(const auto &key : keys)
+	{
+		EXPECT_TRUE(phs.contains(key)) << key;
+	}
+	EXPECT_FALSE(phs.contains("aaaaaaaa0bbbbbbbb"));
+	EXPECT_FALSE(phs.contains("aaaaaaaabbbbbbbb"));
+	EXPECT_FALSE(phs.contains("xq"));
+}
+
+TEST(PerfectHashSetTest, empty_and_duplicate_keys)
+{
+	PerfectHashSet phs;
+	EXPECT_TRUE(phs.empty());
+	EXPECT_FALSE(phs.contains(""));
+	EXPECT_FALSE(phs.contains("c"));
+
+	phs.Compile({});
+	EXPECT_TRUE(phs.empty());
+	EXPECT_FALSE(phs.contains("c"));
+
+	phs.Compile({"c", "c", "aaaaaaaaXbbbbbbbb", "aaaaaaaaXbbbbbbbb", "c"});
+	EXPECT_FALSE(phs.empty());
+	EXPECT_EQ(2U, phs.size());
+	EXPECT_TRUE(phs.contains("c"));
+	EXPECT_TRUE(phs.contains("aaaaaaaaXbbbbbbbb"));
+
+	// Keys which can't be told apart by their word alone.
+	phs.Compile({"c", std::string("c\0", 2), std::string("c\0\0", 3)});
+	EXPECT_EQ(3U, phs.size());
+	EXPECT_TRUE(phs.contains("c"));
+	EXPECT_TRUE(phs.contains(std::string_view("c\0", 2)));
+	EXPECT_TRUE(phs.contains(std::string_view("c\0\0", 3)));
+	EXPECT_FALSE(phs.contains(std::string_view("c\0\0\0", 4)));
+
+	// Recompiling replaces the old keys.
+	phs.Compile({"h"});
+	EXPECT_EQ(1U, phs.size());
+	EXPECT_FALSE(phs.contains("c"));
+	EXPECT_TRUE(phs.contains("h"));
+}
+
+/// A random glob of up to @p max_tokens tokens, built from a small alphabet so that names often match it.
+static std::string random_glob(std::mt19937 &rng, int max_tokens)
+{
+	static const char *const tokens[] = {
+		"a", "b", "c", ".", "-", "]", "!", "^",
+		"?", "*", "*", "**",
+		"[ab]", "[!a]", "[^b]", "[a-c]", "[]a]", "[!]]", "[a-]", "[.*?]", "[\\]]", "[[:alpha:]]",
+		"\\*", "\\?", "\\a", "\\[", "[", "\\"
+	};
+	std::uniform_int_distribution<int> num_tokens(0, max_tokens);
+	std::uniform_int_distribution<size_t> token(0, std::size(tokens) - 1);
+
+	std::string glob;
+	for(int n = num_tokens(rng); n > 0; --n)
+	{
+		glob += tokens[token(rng)];
+	}
+	return glob;
+}
+
+/// A random name of up to @p max_size bytes, from the bytes random_glob() uses.
+static std::string random_name(std::mt19937 &rng, int max_size)
+{
+	static const char bytes[] = "abc.-]!^*?[\\";
+	std::uniform_int_distribution<int> size(0, max_size);
+	std::uniform_int_distribution<size_t> byte(0, std::size(bytes) - 2);
+
+	std::string name;
+	for(int n = size(rng); n > 0; --n)
+	{
+		name += bytes[byte(rng)];
+	}
+	return name;
+}
+
+TEST(GlobSetTest, last_match_agrees_with_fnmatch)
+{
+	// Seeded, so any failure can be reproduced.
+	std::mt19937 rng(20161018);
+	std::uniform_int_distribution<int> num_globs(1, 6);
+
+	GlobSet glob_set;
+	std::vector<std::string> globs;
+	int num_checks = 0;
+	for(int set = 0; set < 20000; ++set)
+	{
+		globs.clear();
+		for(int n = num_globs(rng); n > 0; --n)
+		{
+			globs.push_back(random_glob(rng, 6));
+		}
+		glob_set.Compile(globs);
+
+		for(int i = 0; i < 50; ++i)
+		{
+			std::string name = random_name(rng, 8);
+
+			int expected = -1;
+			for(int g = 0; g < static_cast<int>(globs.size()); ++g)
+			{
+				if(fnmatch(globs[g].c_str(), name.c_str(), 0) == 0)
+				{
+					expected = g;
+				}
+			}
+			ASSERT_EQ(expected, glob_set.LastMatch(name)) << "name '" << name << "', globs: " << ::testing::PrintToString(globs);
+			++num_checks;
+		}
+	}
+	EXPECT_EQ(1000000, num_checks);
+}
+
 }  // namespace
 
 int main(int argc, char **argv) {